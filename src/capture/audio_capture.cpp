@@ -0,0 +1,338 @@
+/*
+ * 2020 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ * Captures audio via ALSA (if VCS has been built with USE_ALSA), for the
+ * recorder to mux into its videos.
+ *
+ * The audio is captured on a thread of its own, one period at a time, into a
+ * single-producer single-consumer ring buffer. Each period is stamped with the
+ * time at which its first frame was captured, on the same clock as video frames
+ * (std::chrono::steady_clock), so that the consumer can align the audio with the
+ * video. If the ring buffer fills up, newly captured periods are dropped whole;
+ * the timestamps of the periods that follow let the consumer tell the gap.
+ *
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include "display/display.h"
+#include "common/globals.h"
+#include "capture/audio_capture.h"
+
+#ifdef USE_ALSA
+    #include <alsa/asoundlib.h>
+#endif
+
+// How many seconds of audio the ring buffer can hold.
+static const uint RING_BUFFER_SECONDS = 4;
+
+// How many periods the capture thread reads from the device per second.
+static const uint PERIODS_PER_SECOND = 100;
+
+static struct audio_ring_s
+{
+    // A contiguous run of frames written into the ring at once, and when the
+    // first of them was captured.
+    struct period_s
+    {
+        u64 firstFrameIdx;
+        uint numFrames;
+        i64 timestamp;
+    };
+
+    std::vector<i16> samples;
+    std::vector<period_s> periods;
+
+    uint numChannels = 0;
+    uint frameCapacity = 0;
+
+    // How many frames and periods have in total been written into and read from
+    // the ring. The producer and consumer each only advance their own counters.
+    std::atomic<u64> numFramesWritten{0};
+    std::atomic<u64> numFramesRead{0};
+    std::atomic<u64> numPeriodsWritten{0};
+    std::atomic<u64> numPeriodsRead{0};
+
+    std::atomic<uint> numFramesDropped{0};
+
+    void initialize(const uint numChannels, const uint frameCapacity, const uint periodCapacity)
+    {
+        this->numChannels = numChannels;
+        this->frameCapacity = frameCapacity;
+        this->samples.assign((frameCapacity * numChannels), 0);
+        this->periods.assign(periodCapacity, period_s{0, 0, 0});
+        this->numFramesWritten = 0;
+        this->numFramesRead = 0;
+        this->numPeriodsWritten = 0;
+        this->numPeriodsRead = 0;
+        this->numFramesDropped = 0;
+
+        return;
+    }
+
+    // Appends the given frames into the ring, or drops them if there isn't room.
+    // Called by the producer.
+    void write(const i16 *const frames, const uint numFrames, const i64 timestamp)
+    {
+        const u64 writeIdx = this->numFramesWritten.load(std::memory_order_relaxed);
+        const u64 periodIdx = this->numPeriodsWritten.load(std::memory_order_relaxed);
+        const u64 numFramesInRing = (writeIdx - this->numFramesRead.load(std::memory_order_acquire));
+
+        if (((numFramesInRing + numFrames) > this->frameCapacity) ||
+            ((periodIdx - this->numPeriodsRead.load(std::memory_order_acquire)) >= this->periods.size()))
+        {
+            this->numFramesDropped += numFrames;
+            return;
+        }
+
+        for (uint i = 0; i < numFrames; i++)
+        {
+            const uint slot = ((writeIdx + i) % this->frameCapacity);
+            memcpy(&this->samples[slot * this->numChannels], &frames[i * this->numChannels], (this->numChannels * sizeof(i16)));
+        }
+
+        this->periods[periodIdx % this->periods.size()] = period_s{writeIdx, numFrames, timestamp};
+
+        this->numPeriodsWritten.store((periodIdx + 1), std::memory_order_release);
+        this->numFramesWritten.store((writeIdx + numFrames), std::memory_order_release);
+
+        return;
+    }
+
+    // Copies out of the ring up to the given number of frames, stopping at the end
+    // of the current period. Called by the consumer.
+    uint read(i16 *const dst, const uint maxNumFrames, i64 *const timestamp)
+    {
+        const u64 readIdx = this->numFramesRead.load(std::memory_order_relaxed);
+        const u64 periodIdx = this->numPeriodsRead.load(std::memory_order_relaxed);
+
+        if ((periodIdx >= this->numPeriodsWritten.load(std::memory_order_acquire)) ||
+            (readIdx >= this->numFramesWritten.load(std::memory_order_acquire)))
+        {
+            return 0;
+        }
+
+        const period_s &period = this->periods[periodIdx % this->periods.size()];
+        const uint offset = uint(readIdx - period.firstFrameIdx);
+        const uint numFrames = std::min(maxNumFrames, (period.numFrames - offset));
+        const uint sampleRate = kc_audio_capture_format().sampleRate;
+
+        *timestamp = (period.timestamp + ((i64(offset) * 1000000000) / sampleRate));
+
+        for (uint i = 0; i < numFrames; i++)
+        {
+            const uint slot = ((readIdx + i) % this->frameCapacity);
+            memcpy(&dst[i * this->numChannels], &this->samples[slot * this->numChannels], (this->numChannels * sizeof(i16)));
+        }
+
+        if ((offset + numFrames) >= period.numFrames)
+        {
+            this->numPeriodsRead.store((periodIdx + 1), std::memory_order_release);
+        }
+
+        this->numFramesRead.store((readIdx + numFrames), std::memory_order_release);
+
+        return numFrames;
+    }
+} RING;
+
+static audio_format_s FORMAT;
+
+static std::atomic<bool> IS_CAPTURE_ACTIVE{false};
+
+// Set to tell the capture thread to exit.
+static std::atomic<bool> STOP_CAPTURE{false};
+
+static std::thread CAPTURE_THREAD;
+
+#ifdef USE_ALSA
+// Whether the audio device timestamps the audio on the monotonic clock. If it
+// doesn't, its timestamps - if any - are on another clock (e.g. wall-clock
+// time), and can't be compared with those of the video.
+static bool HAS_MONOTONIC_TIMESTAMPS = false;
+
+static i64 steady_clock_now(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Runs on the audio capture thread, reading periods of audio from the given
+// device into the ring buffer until told to stop.
+//
+static void capture_function(snd_pcm_t *const pcm)
+{
+    const uint periodNumFrames = (FORMAT.sampleRate / PERIODS_PER_SECOND);
+    std::vector<i16> period(periodNumFrames * FORMAT.numChannels);
+
+    while (!STOP_CAPTURE && !PROGRAM_EXIT_REQUESTED)
+    {
+        // Wait for audio in short enough stretches that we notice being told to
+        // stop, even if the device has gone quiet.
+        if (snd_pcm_wait(pcm, 100) == 0)
+        {
+            continue;
+        }
+
+        const snd_pcm_sframes_t numFramesRead = snd_pcm_readi(pcm, period.data(), periodNumFrames);
+
+        if (numFramesRead < 0)
+        {
+            // Recovers from overruns and the like.
+            if (snd_pcm_recover(pcm, int(numFramesRead), 1) < 0)
+            {
+                NBENE(("Audio capture failed: %s", snd_strerror(int(numFramesRead))));
+                break;
+            }
+
+            continue;
+        }
+
+        // Work out when the period's first frame was captured. ALSA tells us when
+        // the device had the frames still waiting to be read (at the end of the
+        // buffer); ours came before them.
+        i64 timestamp = 0;
+        {
+            snd_pcm_uframes_t numFramesAvailable = 0;
+            snd_htimestamp_t htimestamp = {0, 0};
+
+            if (HAS_MONOTONIC_TIMESTAMPS &&
+                (snd_pcm_htimestamp(pcm, &numFramesAvailable, &htimestamp) == 0) &&
+                (htimestamp.tv_sec || htimestamp.tv_nsec))
+            {
+                timestamp = ((i64(htimestamp.tv_sec) * 1000000000) + htimestamp.tv_nsec);
+            }
+            else
+            {
+                const snd_pcm_sframes_t avail = snd_pcm_avail(pcm);
+
+                numFramesAvailable = ((avail > 0)? avail : 0);
+                timestamp = steady_clock_now();
+            }
+
+            timestamp -= (((i64(numFramesAvailable) + numFramesRead) * 1000000000) / FORMAT.sampleRate);
+        }
+
+        RING.write(period.data(), uint(numFramesRead), timestamp);
+    }
+
+    snd_pcm_close(pcm);
+
+    IS_CAPTURE_ACTIVE = false;
+
+    return;
+}
+#endif
+
+bool kc_start_audio_capture(const std::string &deviceName, const audio_format_s &format)
+{
+    k_assert(!kc_is_audio_capture_active(), "Attempting to start audio capture while it's already active.");
+
+#ifdef USE_ALSA
+    const auto fail = [](snd_pcm_t *const pcm, const std::string &reason)->bool
+    {
+        if (pcm) snd_pcm_close(pcm);
+
+        kd_show_headless_error_message("VCS can't capture audio",
+                                       ("An error was encountered while attempting to start audio capture: " + reason).c_str());
+
+        return false;
+    };
+
+    snd_pcm_t *pcm = nullptr;
+
+    int ret = snd_pcm_open(&pcm, deviceName.c_str(), SND_PCM_STREAM_CAPTURE, 0);
+    if (ret < 0)
+    {
+        return fail(nullptr, ("Couldn't open the device \"" + deviceName + "\": " + snd_strerror(ret)));
+    }
+
+    // A latency of 100 ms; the periods will be shorter.
+    ret = snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16_LE, SND_PCM_ACCESS_RW_INTERLEAVED,
+                             format.numChannels, format.sampleRate, 1, 100000);
+    if (ret < 0)
+    {
+        return fail(pcm, (std::string("Couldn't configure the device: ") + snd_strerror(ret)));
+    }
+
+    // Have ALSA timestamp the audio on the same clock as we do the video.
+    {
+        snd_pcm_sw_params_t *swParams = nullptr;
+        snd_pcm_sw_params_alloca(&swParams);
+
+        HAS_MONOTONIC_TIMESTAMPS = ((snd_pcm_sw_params_current(pcm, swParams) >= 0) &&
+                                    (snd_pcm_sw_params_set_tstamp_mode(pcm, swParams, SND_PCM_TSTAMP_ENABLE) >= 0) &&
+                                    (snd_pcm_sw_params_set_tstamp_type(pcm, swParams, SND_PCM_TSTAMP_TYPE_MONOTONIC) >= 0) &&
+                                    (snd_pcm_sw_params(pcm, swParams) >= 0));
+
+        if (!HAS_MONOTONIC_TIMESTAMPS)
+        {
+            DEBUG(("The audio device doesn't support monotonic timestamps. Timing audio by its arrival instead."));
+        }
+    }
+
+    FORMAT = format;
+    RING.initialize(format.numChannels,
+                    (format.sampleRate * RING_BUFFER_SECONDS),
+                    (PERIODS_PER_SECOND * RING_BUFFER_SECONDS * 2));
+
+    INFO(("Capturing audio from \"%s\" at %u Hz in %u channel(s).", deviceName.c_str(), format.sampleRate, format.numChannels));
+
+    STOP_CAPTURE = false;
+    IS_CAPTURE_ACTIVE = true;
+    CAPTURE_THREAD = std::thread(capture_function, pcm);
+
+    return true;
+#else
+    (void)deviceName;
+    (void)format;
+
+    kd_show_headless_error_message("VCS can't capture audio",
+                                   "Audio capture is only available when VCS has been built with ALSA (USE_ALSA).");
+
+    return false;
+#endif
+}
+
+void kc_stop_audio_capture(void)
+{
+    if (CAPTURE_THREAD.joinable())
+    {
+        STOP_CAPTURE = true;
+        CAPTURE_THREAD.join();
+
+        if (RING.numFramesDropped)
+        {
+            NBENE(("%u frames of audio were dropped during capture.", RING.numFramesDropped.load()));
+        }
+    }
+
+    IS_CAPTURE_ACTIVE = false;
+
+    return;
+}
+
+bool kc_is_audio_capture_active(void)
+{
+    return IS_CAPTURE_ACTIVE;
+}
+
+audio_format_s kc_audio_capture_format(void)
+{
+    return FORMAT;
+}
+
+uint kc_read_captured_audio(i16 *const dst, const uint maxNumFrames, i64 *const timestamp)
+{
+    return RING.read(dst, maxNumFrames, timestamp);
+}
+
+uint kc_num_audio_frames_dropped(void)
+{
+    return RING.numFramesDropped;
+}
@@ -0,0 +1,49 @@
+/*
+ * 2020 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+#ifndef AUDIO_CAPTURE_H
+#define AUDIO_CAPTURE_H
+
+#include <string>
+#include "common/types.h"
+
+// Captured audio is 16-bit signed PCM, with the channels' samples interleaved.
+struct audio_format_s
+{
+    uint sampleRate;
+
+    // 0 if there's no audio.
+    uint numChannels;
+};
+
+// Starts capturing audio from the given ALSA device (e.g. "hw:1,0"; or, for
+// testing without a capture card, the loopback device of the snd-aloop module,
+// e.g. "hw:Loopback,1,0") in the given format. The audio is captured on a thread
+// of its own, into a ring buffer from where it can be read with
+// kc_read_captured_audio(). Returns true on success; false otherwise, having
+// notified the user of the error.
+bool kc_start_audio_capture(const std::string &deviceName, const audio_format_s &format);
+
+void kc_stop_audio_capture(void);
+
+bool kc_is_audio_capture_active(void);
+
+audio_format_s kc_audio_capture_format(void);
+
+// Copies into the given buffer up to the given number of the oldest captured
+// audio frames (one sample per channel), removing them from the ring buffer.
+// The frames copied are contiguous in time: the first was captured at the time
+// returned via 'timestamp', in nanoseconds of std::chrono::steady_clock, and the
+// rest followed at the capture's sample rate. Returns the number of frames
+// copied; or 0 if no audio is waiting. Should be called from one thread only.
+uint kc_read_captured_audio(i16 *const dst, const uint maxNumFrames, i64 *const timestamp);
+
+// Returns the number of audio frames that have been discarded because the ring
+// buffer was full when they were captured.
+uint kc_num_audio_frames_dropped(void);
+
+#endif
@@ -49,6 +49,17 @@ struct captured_frame_s
 
     heap_bytes_s<u8> pixels;
 
+    // When the frame was captured, in nanoseconds of the system's monotonic
+    // clock (std::chrono::steady_clock). Taken from the capture driver if it
+    // reports one; otherwise, from when the frame was received from the driver.
+    i64 timestamp = 0;
+
+    // If the capture device has cropped or scaled the frame (see capture_api_s::
+    // set_hardware_roi() and set_hardware_scaling()), the region of the source
+    // frame that the pixels hold, scaled to 'r' if 'r' differs from the size of
+    // the region; otherwise, an empty region.
+    frame_region_s roi = {0, 0, 0, 0};
+
     // Will be set to true after the frame's data has been processed for
     // display and is no longer needed.
     bool processed = false;
@@ -463,6 +463,49 @@ struct capture_api_s
      */
     virtual bool set_resolution(const resolution_s &r) { (void)r; return false; }
 
+    /*!
+     * Tells the capture device to crop its captured frames to the given region
+     * (in the coordinates of frames of get_resolution()) before handing them to
+     * VCS, so that the pixels outside of the region needn't be transferred; or,
+     * if the region is empty, to stop cropping.
+     *
+     * Frames cropped by the capture device have their region recorded in
+     * captured_frame_s::roi. The device may crop to a larger region than was
+     * asked for, as long as it contains the one asked for.
+     *
+     * The capture device is expected to stop cropping when the video mode
+     * changes.
+     *
+     * Returns true on success; false otherwise, e.g. if the capture device
+     * doesn't support cropping.
+     *
+     * @see
+     * kf_filter_chain_roi(), set_hardware_scaling()
+     */
+    virtual bool set_hardware_roi(const frame_region_s &roi) { (void)roi; return false; }
+
+    /*!
+     * Tells the capture device to scale its captured frames (or, if it's been
+     * told to crop them, their cropped region) to the given resolution before
+     * handing them to VCS, so that fewer pixels need to be transferred and
+     * scaled by VCS; or, if the resolution is 0 x 0, to stop scaling.
+     *
+     * Frames scaled by the capture device have the region of the frame that
+     * was scaled recorded in captured_frame_s::roi. The device may scale to a
+     * resolution somewhat different from the one asked for, e.g. to meet its
+     * alignment requirements; VCS's scaler will take care of the difference.
+     *
+     * The capture device is expected to stop scaling when the video mode
+     * changes.
+     *
+     * Returns true on success; false otherwise, e.g. if the capture device
+     * can't scale to the given resolution.
+     *
+     * @see
+     * set_hardware_roi()
+     */
+    virtual bool set_hardware_scaling(const resolution_s &r) { (void)r; return false; }
+
     /*!
      * Tells the capture API to reset its count of missed frames.
      * 
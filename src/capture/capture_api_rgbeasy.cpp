@@ -8,6 +8,7 @@
 #ifdef CAPTURE_API_RGBEASY
 
 #include <atomic>
+#include <chrono>
 #include <cmath>
 #include "common/globals.h"
 #include "common/propagate/app_events.h"
@@ -112,6 +113,7 @@ namespace rgbeasy_callbacks_n
         FRAME_BUFFER.r.h = abs(frameInfo->biHeight);
         FRAME_BUFFER.r.bpp = frameInfo->biBitCount;
         FRAME_BUFFER.pixelFormat = CAPTURE_PIXEL_FORMAT;
+        FRAME_BUFFER.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
 
         // Copy the frame's data into our local buffer so we can work on it.
         memcpy(FRAME_BUFFER.pixels.ptr(), (u8*)frameData,
@@ -51,6 +51,32 @@ static bool INVALID_SIGNAL = false;
 // the API for it.
 static resolution_s CAPTURE_RESOLUTION = {640, 480, 32};
 
+// The region of the source's frames to which the capture device has been told
+// to crop the frames it sends us; or an empty region if it's sending them whole.
+// See set_hardware_roi().
+static frame_region_s HARDWARE_ROI = {0, 0, 0, 0};
+
+// The resolution to which the capture device has been told to scale the frames
+// (or their cropped region) it sends us; or 0 x 0 if it's not scaling them. See
+// set_hardware_scaling().
+static resolution_s HARDWARE_SCALING = {0, 0, 0};
+
+// The size, in bytes, of the frames the capture device sends us in its current
+// capture format (its 'sizeimage'), as of the format having last been set; or
+// 0 if unknown. Frames captured in an earlier format - e.g. before the cropping
+// or scaling changed - are told apart from current ones by their size.
+static u32 FRAME_SIZE_IMAGE = 0;
+
+// When the capture format was last changed, in nanoseconds of steady_clock.
+// Frames that the device timestamps as captured before then are of the old
+// format, even if they happen to be of the same size as the new one's.
+static i64 FORMAT_CHANGE_TIMESTAMP = 0;
+
+static i64 steady_clock_now(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 // The current refresh rate, multiplied by 1000.
 static refresh_rate_s REFRESH_RATE = refresh_rate_s(0);
 
@@ -578,9 +604,35 @@ static void capture_function(capture_api_video4linux_s *const thisPtr)
                 {
                     std::lock_guard<std::mutex> lock(thisPtr->captureMutex);
 
-                    FRAME_BUFFER.r = CAPTURE_RESOLUTION;
-                    FRAME_BUFFER.r.bpp = ((CAPTURE_PIXEL_FORMAT == capture_pixel_format_e::rgb_888)? 32 : 16);
+                    const frame_region_s region = (HARDWARE_ROI.w? HARDWARE_ROI : frame_region_s{0, 0, CAPTURE_RESOLUTION.w, CAPTURE_RESOLUTION.h});
+                    const resolution_s frameRes = {(HARDWARE_SCALING.w? HARDWARE_SCALING.w : region.w),
+                                                   (HARDWARE_SCALING.w? HARDWARE_SCALING.h : region.h),
+                                                   ((CAPTURE_PIXEL_FORMAT == capture_pixel_format_e::rgb_888)? 32u : 16u)};
+
+                    // Prefer the driver's timestamp, which isn't subject to our
+                    // thread's scheduling jitter; if it's on the same clock as
+                    // steady_clock (CLOCK_MONOTONIC), that is.
+                    const bool isDriverTimestamp = ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC);
+                    const i64 timestamp = (isDriverTimestamp? ((i64(buf.timestamp.tv_sec) * 1000000000) + (i64(buf.timestamp.tv_usec) * 1000))
+                                                            : steady_clock_now());
+
+                    // A frame captured before the cropping or scaling was last changed
+                    // is of the old format, and its pixels don't correspond to the
+                    // current region, so it's dropped. We tell such frames by their
+                    // size differing from the current format's, or by their timestamp.
+                    if ((buf.bytesused &&
+                         ((FRAME_SIZE_IMAGE && (buf.bytesused != FRAME_SIZE_IMAGE)) ||
+                          (buf.bytesused < (frameRes.w * frameRes.h * (frameRes.bpp / 8))))) ||
+                        (isDriverTimestamp && (timestamp < FORMAT_CHANGE_TIMESTAMP)))
+                    {
+                        NUM_NEW_FRAME_EVENTS_SKIPPED++;
+                        goto requeue;
+                    }
+
+                    FRAME_BUFFER.r = frameRes;
                     FRAME_BUFFER.pixelFormat = CAPTURE_PIXEL_FORMAT;
+                    FRAME_BUFFER.roi = ((HARDWARE_ROI.w || HARDWARE_SCALING.w)? region : frame_region_s{0, 0, 0, 0});
+                    FRAME_BUFFER.timestamp = timestamp;
 
                     // Copy the frame's data into our local buffer so we can work on it.
                     memcpy(FRAME_BUFFER.pixels.ptr(), (char*)buf.m.userptr,
@@ -591,6 +643,7 @@ static void capture_function(capture_api_video4linux_s *const thisPtr)
                 }
 
                 // Tell the capture device it can use its capture buffer again.
+                requeue:
                 if (!capture_apicall(VIDIOC_QBUF, &buf))
                 {
                     push_capture_event(capture_event_e::unrecoverable_error);
@@ -792,11 +845,109 @@ bool capture_api_video4linux_s::initialize_hardware(void)
     return false;
 }
 
+// Asks the capture device to crop its frames to the given region, via the crop
+// rectangle of V4L2's selection API, or not to crop them if the region is empty;
+// and to scale the cropped region to the given resolution, by setting the
+// capture format's size to it, or not to scale it if the resolution is 0 x 0.
+// Returns true on success; false otherwise, in which case the device may be left
+// cropping and scaling in some other way, and the caller should reset them.
+//
+static bool set_hardware_geometry(const frame_region_s &roi, const resolution_s &scaling)
+{
+    FORMAT_CHANGE_TIMESTAMP = steady_clock_now();
+
+    v4l2_selection selection = {};
+    selection.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    selection.target = V4L2_SEL_TGT_CROP;
+    selection.r.left = (roi.w? roi.x : 0);
+    selection.r.top = (roi.w? roi.y : 0);
+    selection.r.width = (roi.w? roi.w : CAPTURE_RESOLUTION.w);
+    selection.r.height = (roi.w? roi.h : CAPTURE_RESOLUTION.h);
+
+    // Not all devices support cropping, so a failure here isn't an error as
+    // such; hence not using capture_apicall(), which would report it. A device
+    // that can't crop isn't cropping, either.
+    if (ioctl(CAPTURE_HANDLE, VIDIOC_S_SELECTION, &selection) != 0)
+    {
+        if (roi.w)
+        {
+            return false;
+        }
+
+        selection.r.width = CAPTURE_RESOLUTION.w;
+        selection.r.height = CAPTURE_RESOLUTION.h;
+    }
+
+    // The device may have adjusted the region and the resolution, e.g. to its
+    // alignment requirements.
+    v4l2_format format = {};
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+    if (!capture_apicall(VIDIOC_G_FMT, &format))
+    {
+        return false;
+    }
+
+    format.fmt.pix.width = (scaling.w? scaling.w : selection.r.width);
+    format.fmt.pix.height = (scaling.w? scaling.h : selection.r.height);
+    format.fmt.pix.pixelformat = V4L2_PIX_FMT_RGB32;
+
+    // Until we know the new format's frame size, we can't tell its frames from
+    // those of the old one by their size.
+    FRAME_SIZE_IMAGE = 0;
+
+    if (!capture_apicall(VIDIOC_S_FMT, &format) ||
+        !capture_apicall(VIDIOC_G_FMT, &format) ||
+        !format.fmt.pix.width ||
+        !format.fmt.pix.height ||
+        (format.fmt.pix.width > selection.r.width) ||
+        (format.fmt.pix.height > selection.r.height) ||
+        (format.fmt.pix.bytesperline != (format.fmt.pix.width * 4)) ||
+        (!scaling.w && ((format.fmt.pix.width != selection.r.width) ||
+                        (format.fmt.pix.height != selection.r.height))))
+    {
+        return false;
+    }
+
+    HARDWARE_ROI = (roi.w? frame_region_s{unsigned(selection.r.left),
+                                          unsigned(selection.r.top),
+                                          selection.r.width,
+                                          selection.r.height}
+                         : frame_region_s{0, 0, 0, 0});
+
+    HARDWARE_SCALING = (scaling.w? resolution_s{format.fmt.pix.width,
+                                                format.fmt.pix.height,
+                                                32}
+                                 : resolution_s{0, 0, 0});
+
+    FRAME_SIZE_IMAGE = format.fmt.pix.sizeimage;
+
+    return true;
+}
+
 bool capture_api_video4linux_s::set_resolution(const resolution_s &r)
 {
     v4l2_format format = {};
     format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
+    FORMAT_CHANGE_TIMESTAMP = steady_clock_now();
+
+    // Any cropping and scaling were relative to the previous resolution.
+    if (HARDWARE_ROI.w ||
+        HARDWARE_SCALING.w)
+    {
+        v4l2_selection selection = {};
+        selection.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        selection.target = V4L2_SEL_TGT_CROP;
+        selection.r.width = r.w;
+        selection.r.height = r.h;
+
+        ioctl(CAPTURE_HANDLE, VIDIOC_S_SELECTION, &selection);
+
+        HARDWARE_ROI = {0, 0, 0, 0};
+        HARDWARE_SCALING = {0, 0, 0};
+    }
+
     if (!capture_apicall(VIDIOC_G_FMT, &format))
     {
         NBENE(("Failed to query the current capture format (error %d).", errno));
@@ -808,6 +959,8 @@ bool capture_api_video4linux_s::set_resolution(const resolution_s &r)
     format.fmt.pix.height = r.h;
     format.fmt.pix.pixelformat = V4L2_PIX_FMT_RGB32;
 
+    FRAME_SIZE_IMAGE = 0;
+
     if (!capture_apicall(VIDIOC_S_FMT, &format) ||
         !capture_apicall(VIDIOC_G_FMT, &format))
     {
@@ -823,12 +976,61 @@ bool capture_api_video4linux_s::set_resolution(const resolution_s &r)
     CAPTURE_RESOLUTION.h = format.fmt.pix.height;
     CAPTURE_RESOLUTION.bpp = 32;
 
+    FRAME_SIZE_IMAGE = format.fmt.pix.sizeimage;
+
     return true;
 
     fail:
     return false;
 }
 
+bool capture_api_video4linux_s::set_hardware_roi(const frame_region_s &roi)
+{
+    const frame_region_s entireFrame = {0, 0, CAPTURE_RESOLUTION.w, CAPTURE_RESOLUTION.h};
+
+    if (roi.w &&
+        set_hardware_geometry(roi, HARDWARE_SCALING) &&
+        (HARDWARE_ROI != entireFrame) &&
+        (HARDWARE_ROI.x <= roi.x) &&
+        (HARDWARE_ROI.y <= roi.y) &&
+        ((HARDWARE_ROI.x + HARDWARE_ROI.w) >= (roi.x + roi.w)) &&
+        ((HARDWARE_ROI.y + HARDWARE_ROI.h) >= (roi.y + roi.h)))
+    {
+        INFO(("The capture device is cropping frames to %lu x %lu at (%lu, %lu).",
+              HARDWARE_ROI.w, HARDWARE_ROI.h, HARDWARE_ROI.x, HARDWARE_ROI.y));
+
+        return true;
+    }
+
+    // Capture whole frames.
+    if (!set_hardware_geometry({0, 0, 0, 0}, HARDWARE_SCALING))
+    {
+        set_hardware_geometry({0, 0, 0, 0}, {0, 0, 0});
+    }
+
+    return !roi.w;
+}
+
+bool capture_api_video4linux_s::set_hardware_scaling(const resolution_s &r)
+{
+    if (r.w &&
+        set_hardware_geometry(HARDWARE_ROI, r))
+    {
+        INFO(("The capture device is scaling frames to %lu x %lu.",
+              HARDWARE_SCALING.w, HARDWARE_SCALING.h));
+
+        return true;
+    }
+
+    // Capture unscaled frames.
+    if (!set_hardware_geometry(HARDWARE_ROI, {0, 0, 0}))
+    {
+        set_hardware_geometry({0, 0, 0, 0}, {0, 0, 0});
+    }
+
+    return !r.w;
+}
+
 bool capture_api_video4linux_s::release_hardware(void)
 {
     bool successFlag = true;
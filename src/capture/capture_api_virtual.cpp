@@ -56,6 +56,8 @@ capture_event_e capture_api_virtual_s::pop_capture_event_queue(void)
     {
         startTime = std::chrono::system_clock::now();
 
+        this->frameBuffer.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
         return capture_event_e::new_frame;
     }
 }
@@ -70,6 +70,14 @@ public:
         vcs_event_c *const recordingEnded = new vcs_event_c;
     } recorder;
 
+    // Events related to outputting into a v4l2loopback device.
+    struct
+    {
+        // The output was stopped because the device failed while being written
+        // into. (The user will have been told of the error.)
+        vcs_event_c *const outputFailed = new vcs_event_c;
+    } loopback;
+
     // Events related to file IO.
     struct
     {
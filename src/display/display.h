@@ -68,6 +68,29 @@ struct resolution_s
     }
 };
 
+/*!
+ * @brief
+ * A rectangular region of a frame, in pixels from the frame's top left corner.
+ * A region whose width and height are 0 stands for the entire frame.
+ */
+struct frame_region_s
+{
+    unsigned long x, y, w, h;
+
+    bool operator==(const frame_region_s &other) const
+    {
+        return bool((this->x == other.x) &&
+                    (this->y == other.y) &&
+                    (this->w == other.w) &&
+                    (this->h == other.h));
+    }
+
+    bool operator!=(const frame_region_s &other) const
+    {
+        return !(*this == other);
+    }
+};
+
 /*!
  * @brief
  * Maps a value to a named filter graph property.
@@ -86,6 +109,27 @@ struct filter_graph_option_s
     }
 };
 
+/*!
+ * @brief
+ * Statistics about the GUI's presentation of output frames.
+ * 
+ * @see
+ * kd_presentation_stats()
+ */
+struct present_stats_s
+{
+    /*! The number of output frames that have been put on screen.*/
+    u64 numPresented;
+
+    /*! The number of output frames that were superseded by a newer frame before
+     *  they could be put on screen, and so never were.*/
+    u64 numDropped;
+
+    /*! The number of output frames that were put on screen, but not within the
+     *  display refresh following their completion.*/
+    u64 numLate;
+};
+
 /*!
  * Asks the GUI to create and open the output window. The output window is a
  * surface on which VCS's output frames are to be displayed by the GUI.
@@ -455,4 +499,18 @@ int kd_average_pipeline_latency(void);
  */
 int kd_peak_pipeline_latency(void);
 
+/*!
+ * Returns statistics about how the output frames VCS has produced have been
+ * presented on screen.
+ * 
+ * The GUI is expected to present output frames independently of their
+ * production: at most once per display refresh, choosing the newest frame
+ * available at that time. Frames that get superseded this way are counted as
+ * dropped.
+ * 
+ * @see
+ * present_stats_s
+ */
+present_stats_s kd_presentation_stats(void);
+
 #endif
@@ -281,6 +281,13 @@ uint kd_output_framerate(void)
     return WINDOW->output_framerate();
 }
 
+present_stats_s kd_presentation_stats(void)
+{
+    k_assert(WINDOW != nullptr, "Tried to query the display before it had been initialized.");
+
+    return WINDOW->presentation_stats();
+}
+
 void kd_redraw_output_window(void)
 {
     if (WINDOW == nullptr)
@@ -47,7 +47,6 @@ QRectF FilterGraphNode::boundingRect(void) const
 
 void FilterGraphNode::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
 {
-    (void)option;
     (void)widget;
 
     QFont bodyFont = painter->font();
@@ -116,6 +115,24 @@ void FilterGraphNode::paint(QPainter *painter, const QStyleOptionGraphicsItem *o
     painter->setPen(QColor(this->is_enabled()? clr : "black"));
     painter->drawText(20, 26, title);
 
+    // Draw below the node how long its filter - or, for an input gate, its
+    // filter chain - is taking per frame.
+    if (this->associatedFilter &&
+        (this->associatedFilter->metaData.type != filter_type_enum_e::output_gate) &&
+        this->associatedFilter->timing->is_current())
+    {
+        const filter_timing_s &timing = *this->associatedFilter->timing;
+        const QString label = ((this->associatedFilter->metaData.type == filter_type_enum_e::input_gate)? "Chain: " : "");
+
+        painter->setFont(bodyFont);
+        painter->setPen(option->palette.color(QPalette::WindowText));
+        painter->drawText(QRect(0, (this->height + 4), this->width, 16),
+                          (Qt::AlignLeft | Qt::AlignVCenter),
+                          QString("%1%2 ms average, %3 ms p99").arg(label)
+                                                               .arg(timing.average_ms(), 0, 'f', 2)
+                                                               .arg(timing.p99_ms(), 0, 'f', 2));
+    }
+
     return;
 }
 
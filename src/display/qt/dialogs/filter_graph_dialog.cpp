@@ -150,6 +150,22 @@ FilterGraphDialog::FilterGraphDialog(QWidget *parent) :
         });
     }
 
+    // Periodically repaint the nodes, to keep the filters' timings that they
+    // display up to date.
+    {
+        QTimer *timingUpdateTimer = new QTimer(this);
+
+        connect(timingUpdateTimer, &QTimer::timeout, this, [this]
+        {
+            if (this->isVisible())
+            {
+                this->graphicsScene->update();
+            }
+        });
+
+        timingUpdateTimer->start(500);
+    }
+
     // Restore persistent settings.
     {
         this->set_filter_graph_enabled(kpers_value_of(INI_GROUP_OUTPUT, "custom_filtering", kf_is_filtering_enabled()).toBool());
@@ -14,14 +14,42 @@
 #include <QMenuBar>
 #include <QDebug>
 #include <QMenu>
+#include <functional>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <cmath>
 #include "display/qt/dialogs/overlay_dialog.h"
 #include "display/qt/persistent_settings.h"
 #include "display/qt/utility.h"
 #include "display/display.h"
 #include "capture/capture_api.h"
 #include "capture/capture.h"
+#include "filter/filter.h"
 #include "ui_overlay_dialog.h"
 
+// The variables that can be used in the overlay, by their tag in the overlay's
+// text; and for each, a function that returns the variable's current value.
+static const std::vector<std::pair<QString, std::function<QString()>>> OVERLAY_VARIABLES =
+{
+    {"$inputResolution",      []()->QString{ const auto r = kc_capture_api().get_resolution(); return QString("%1 x %2").arg(r.w).arg(r.h); }},
+    {"$outputResolution",     []()->QString{ const auto r = ks_output_resolution(); return QString("%1 x %2").arg(r.w).arg(r.h); }},
+    {"$inputHz",              []{ return QString::number(kc_capture_api().get_refresh_rate().value<unsigned>()); }},
+    {"$outputFPS",            []{ return QString::number(kd_output_framerate()); }},
+    {"$areFramesDropped",     []{ return QString((kc_capture_api().get_missed_frames_count() > 0)? "Dropping frames" : ""); }},
+    {"$peakLatencyMs",        []{ return QString::number(kd_peak_pipeline_latency()); }},
+    {"$averageLatencyMs",     []{ return QString::number(kd_average_pipeline_latency()); }},
+    {"$presentedFrames",      []{ return QString::number(kd_presentation_stats().numPresented); }},
+    {"$droppedPresentFrames", []{ return QString::number(kd_presentation_stats().numDropped); }},
+    {"$latePresentFrames",    []{ return QString::number(kd_presentation_stats().numLate); }},
+    {"$filterChainAvgMs",     []{ return QString::number(kf_filter_chain_timing().average_ms(), 'f', 2); }},
+    {"$filterChainP99Ms",     []{ return QString::number(kf_filter_chain_timing().p99_ms(), 'f', 2); }},
+    {"$slowestFilter",        []()->QString{ const filter_c *const f = kf_slowest_filter();
+                                             return (f? QString("%1 (%2 ms)").arg(QString::fromStdString(f->metaData.name)).arg(f->timing->average_ms(), 0, 'f', 2) : ""); }},
+    {"$systemTime",           []{ return QDateTime::currentDateTime().time().toString(); }},
+    {"$systemDate",           []{ return QDateTime::currentDateTime().date().toString(); }},
+};
+
 OverlayDialog::OverlayDialog(QWidget *parent) :
     QDialog(parent),
     ui(new Ui::OverlayDialog)
@@ -118,9 +146,46 @@ OverlayDialog::OverlayDialog(QWidget *parent) :
                     this->insert_text_into_overlay_editor("$averageLatencyMs");
                 });
 
+                connect(outputMenu->addAction("Frames presented"), &QAction::triggered, this, [=]
+                {
+                    this->insert_text_into_overlay_editor("$presentedFrames");
+                });
+
+                connect(outputMenu->addAction("Frames skipped in presentation"), &QAction::triggered, this, [=]
+                {
+                    this->insert_text_into_overlay_editor("$droppedPresentFrames");
+                });
+
+                connect(outputMenu->addAction("Frames presented late"), &QAction::triggered, this, [=]
+                {
+                    this->insert_text_into_overlay_editor("$latePresentFrames");
+                });
+
                 variablesMenu->addMenu(outputMenu);
             }
 
+            // Filtering.
+            {
+                QMenu *filterMenu = new QMenu("Filters", this->menubar);
+
+                connect(filterMenu->addAction("Average chain time (ms)"), &QAction::triggered, this, [=]
+                {
+                    this->insert_text_into_overlay_editor("$filterChainAvgMs");
+                });
+
+                connect(filterMenu->addAction("99th percentile chain time (ms)"), &QAction::triggered, this, [=]
+                {
+                    this->insert_text_into_overlay_editor("$filterChainP99Ms");
+                });
+
+                connect(filterMenu->addAction("Slowest filter"), &QAction::triggered, this, [=]
+                {
+                    this->insert_text_into_overlay_editor("$slowestFilter");
+                });
+
+                variablesMenu->addMenu(filterMenu);
+            }
+
             variablesMenu->addSeparator();
 
             // System.
@@ -196,6 +261,11 @@ OverlayDialog::OverlayDialog(QWidget *parent) :
         this->layout()->setMenuBar(menubar);
     }
 
+    connect(ui->plainTextEdit, &QPlainTextEdit::textChanged, this, [=]
+    {
+        this->update_overlay_template();
+    });
+
     // Restore persistent settings.
     {
         ui->plainTextEdit->setPlainText(kpers_value_of(INI_GROUP_OVERLAY, "content", "").toString());
@@ -225,6 +295,9 @@ void OverlayDialog::set_overlay_max_width(const uint width)
 {
     overlayDocument.setTextWidth(width);
 
+    // Force the overlay to be re-rendered at the new width.
+    this->overlayImageHtml.clear();
+
     return;
 }
 
@@ -246,19 +319,74 @@ void OverlayDialog::set_overlay_enabled(const bool enabled)
     return;
 }
 
-// Renders the overlay into a QImage, and returns the image.
+// Renders the overlay into a QImage, and returns the image. The image is cropped
+// to the overlay's visible contents, and its offset() gives the position at which
+// it should be drawn over the output frame. If the overlay's contents haven't
+// changed since the previous call, the previous image is returned as is; so
+// callers can use its cacheKey() to detect changes.
 QImage OverlayDialog::overlay_as_qimage(void)
 {
+    const QString overlayHtml = parsed_overlay_string();
+
+    if (overlayHtml == this->overlayImageHtml)
+    {
+        return this->overlayImage;
+    }
+
     const resolution_s outputRes = ks_output_resolution();
 
-    QImage image = QImage(outputRes.w, outputRes.h, QImage::Format_ARGB32_Premultiplied);
-    image.fill(QColor(0, 0, 0, 0));
+    overlayDocument.setHtml(overlayHtml);
 
-    QPainter painter(&image);
-    overlayDocument.setHtml(parsed_overlay_string());
-    overlayDocument.drawContents(&painter, image.rect());
+    // Render the document into an image spanning the document's height, which
+    // we'll then crop horizontally.
+    const QRect documentRect = QRect(0, 0, outputRes.w, std::min(int(outputRes.h), int(std::ceil(overlayDocument.size().height()))));
+    QImage image;
+    if (!documentRect.isEmpty())
+    {
+        image = QImage(documentRect.size(), QImage::Format_ARGB32_Premultiplied);
+        image.fill(QColor(0, 0, 0, 0));
+
+        QPainter painter(&image);
+        overlayDocument.drawContents(&painter, documentRect);
+    }
 
-    return image;
+    // Crop the image to the bounds of its non-transparent pixels.
+    int left = image.width(), right = -1, top = image.height(), bottom = -1;
+    for (int y = 0; y < image.height(); y++)
+    {
+        const QRgb *const row = (const QRgb*)image.constScanLine(y);
+
+        for (int x = 0; x < image.width(); x++)
+        {
+            if (qAlpha(row[x]))
+            {
+                left = std::min(left, x);
+                right = std::max(right, x);
+                top = std::min(top, y);
+                bottom = std::max(bottom, y);
+            }
+        }
+    }
+
+    if (right < 0)
+    {
+        // The overlay has no visible contents, so there's nothing to draw. We
+        // return a 1 x 1 transparent image rather than a null one, since a null
+        // image would tell the caller that the overlay is disabled.
+        this->overlayImage = QImage(1, 1, QImage::Format_ARGB32_Premultiplied);
+        this->overlayImage.fill(QColor(0, 0, 0, 0));
+    }
+    else
+    {
+        const QRect cropRect = QRect(QPoint(left, top), QPoint(right, bottom));
+
+        this->overlayImage = image.copy(cropRect);
+        this->overlayImage.setOffset(cropRect.topLeft());
+    }
+
+    this->overlayImageHtml = overlayHtml;
+
+    return this->overlayImage;
 }
 
 // Appends the given bit of text into the overlay editor's text field at its
@@ -271,26 +399,46 @@ void OverlayDialog::insert_text_into_overlay_editor(const QString &text)
     return;
 }
 
+// Takes note of the overlay's current contents in the overlay editor, and of the
+// variables they use. Call this whenever the user edits the overlay.
+void OverlayDialog::update_overlay_template(void)
+{
+    this->overlayTemplate = ("<font style=\"font-size: large; color: white; background-color: black;\">" +
+                             ui->plainTextEdit->toPlainText() +
+                             "</font>");
+
+    this->overlayTemplateVariables.clear();
+    for (const auto &variable: OVERLAY_VARIABLES)
+    {
+        if (this->overlayTemplate.contains(variable.first))
+        {
+            this->overlayTemplateVariables << variable.first;
+        }
+    }
+
+    return;
+}
+
 // Parses the overlay string to replace variable tags with their corresponding
 // data, and returns the parsed version.
 QString OverlayDialog::parsed_overlay_string(void)
 {
-    QString parsed = ui->plainTextEdit->toPlainText();
-
-    const auto inRes = kc_capture_api().get_resolution();
-    const auto outRes = ks_output_resolution();
-
-    parsed.replace("$inputResolution",  QString("%1 x %2").arg(inRes.w).arg(inRes.h));
-    parsed.replace("$outputResolution", QString("%1 x %2").arg(outRes.w).arg(outRes.h));
-    parsed.replace("$inputHz",          QString::number(kc_capture_api().get_refresh_rate().value<unsigned>()));
-    parsed.replace("$outputFPS",        QString::number(kd_output_framerate()));
-    parsed.replace("$areFramesDropped", ((kc_capture_api().get_missed_frames_count() > 0)? "Dropping frames" : ""));
-    parsed.replace("$peakLatencyMs",    QString::number(kd_peak_pipeline_latency()));
-    parsed.replace("$averageLatencyMs", QString::number(kd_average_pipeline_latency()));
-    parsed.replace("$systemTime",       QDateTime::currentDateTime().time().toString());
-    parsed.replace("$systemDate",       QDateTime::currentDateTime().date().toString());
-
-    return ("<font style=\"font-size: large; color: white; background-color: black;\">" + parsed + "</font>");
+    if (this->overlayTemplateVariables.isEmpty())
+    {
+        return this->overlayTemplate;
+    }
+
+    QString parsed = this->overlayTemplate;
+
+    for (const auto &variable: OVERLAY_VARIABLES)
+    {
+        if (this->overlayTemplateVariables.contains(variable.first))
+        {
+            parsed.replace(variable.first, variable.second());
+        }
+    }
+
+    return parsed;
 }
 
 bool OverlayDialog::is_overlay_enabled(void)
@@ -8,6 +8,8 @@
 #define OVERLAY_DIALOG_H
 
 #include <QTextDocument>
+#include <QStringList>
+#include <QImage>
 #include <QDialog>
 
 class QMenu;
@@ -41,6 +43,8 @@ signals:
 private:
     void insert_text_into_overlay_editor(const QString &text);
 
+    void update_overlay_template(void);
+
     QString parsed_overlay_string(void);
 
     Ui::OverlayDialog *ui;
@@ -51,6 +55,19 @@ private:
     // Used to render the overlay's HTML into an image.
     QTextDocument overlayDocument;
 
+    // The overlay's unparsed contents, as entered by the user; and the variable
+    // tags that occur in them. Updated only when the user edits the overlay, so
+    // that parsing needs to look up just the variables actually in use.
+    QString overlayTemplate;
+    QStringList overlayTemplateVariables;
+
+    // The most recently rendered overlay image, and the HTML it was rendered
+    // from. Lets us skip re-rendering the overlay while its contents stay the same.
+    // The image is cropped to the overlay's visible contents, and its offset()
+    // gives the position of the crop within the output frame.
+    QImage overlayImage;
+    QString overlayImageHtml;
+
     QMenuBar *menubar = nullptr;
 };
 
@@ -6,14 +6,20 @@
  *
  */
 
+#include <QActionGroup>
+#include <QInputDialog>
 #include <QFileDialog>
 #include <QFileInfo>
+#include <QDateTime>
 #include <QMenuBar>
 #include "display/qt/dialogs/record_dialog.h"
 #include "display/qt/persistent_settings.h"
 #include "common/propagate/app_events.h"
+#include "capture/capture_api.h"
+#include "capture/capture.h"
 #include "display/qt/utility.h"
 #include "scaler/scaler.h"
+#include "record/libav_encoder.h"
 #include "record/record.h"
 #include "ui_record_dialog.h"
 
@@ -39,7 +45,10 @@ RecordDialog::RecordDialog(QDialog *parent) :
         // Video container.
         {
             QString containerName;
-            #if _WIN32
+            #ifdef USE_LIBAV
+                // The container depends on the codec, and is set when the codec is.
+                containerName = "MP4";
+            #elif _WIN32
                 // We'll use the x264vfw encoder on Windows, which outputs into AVI.
                 containerName = "AVI";
             #elif __linux__
@@ -54,21 +63,54 @@ RecordDialog::RecordDialog(QDialog *parent) :
 
         // Encoder for video recording.
         {
-            QString encoderName;
-            #if _WIN32
-                encoderName = "x264vfw";
-            #elif __linux__
-                encoderName = "x264";
+            #ifdef USE_LIBAV
+                ui->comboBox_recordingEncoding->addItem("H.264", int(recording_codec_e::h264));
+                ui->comboBox_recordingEncoding->addItem("H.264 (lossless)", int(recording_codec_e::h264_lossless));
+                ui->comboBox_recordingEncoding->addItem("FFV1", int(recording_codec_e::ffv1));
             #else
-                #error "Unknown platform."
+                QString encoderName;
+                #if _WIN32
+                    encoderName = "x264vfw";
+                #elif __linux__
+                    encoderName = "x264";
+                #else
+                    #error "Unknown platform."
+                #endif
+
+                ui->comboBox_recordingEncoding->addItem(encoderName);
             #endif
-
-            ui->comboBox_recordingEncoding->addItem(encoderName);
         }
 
+        // With FFmpeg, we set the codec's options directly, so the x264vfw-specific
+        // settings don't apply.
+        #ifdef USE_LIBAV
+        {
+            ui->comboBox_recordingEncoderProfile->setVisible(false);
+            ui->comboBox_recordingEncoderPixelFormat->setVisible(false);
+            ui->comboBox_recordingEncoderZeroLatency->setVisible(false);
+
+            ui->label_22->setVisible(false);
+            ui->label_15->setVisible(false);
+            ui->label_27->setVisible(false);
+
+            ui->groupBox_recordingSettings->layout()->removeWidget(ui->label_22);
+            ui->groupBox_recordingSettings->layout()->removeWidget(ui->label_15);
+            ui->groupBox_recordingSettings->layout()->removeWidget(ui->label_27);
+
+            ui->groupBox_recordingSettings->layout()->removeWidget(ui->comboBox_recordingEncoderProfile);
+            ui->groupBox_recordingSettings->layout()->removeWidget(ui->comboBox_recordingEncoderPixelFormat);
+            ui->groupBox_recordingSettings->layout()->removeWidget(ui->comboBox_recordingEncoderZeroLatency);
+
+            ui->lineEdit_recordingEncoderArguments->setToolTip("FFmpeg codec options, as key=value:key=value; e.g. threads=4:g=120");
+
+            // As an alternative to sampling the capture at the video's frame rate,
+            // frames can be stored at the times they were captured.
+            ui->comboBox_recordingLinearFrameInsertion->addItem("Variable frame rate");
+        }
         // Disable recording settings not available under Linux. (To customize them,
         // you'll need to edit the relevant OpenCV source code and recompile it;
         // e.g. https://www.researchgate.net/post/Is_it_possible_to_set_the_lossfree_option_for_the_X264_codec_in_OpenCV).
+        #else
         {
             #if __linux__
                 ui->comboBox_recordingEncoderProfile->setVisible(false);
@@ -100,6 +142,7 @@ RecordDialog::RecordDialog(QDialog *parent) :
                 ui->groupBox_recordingSettings->layout()->removeWidget(ui->comboBox_recordingEncoderZeroLatency);
             #endif
         }
+        #endif
     }
 
     // Create the dialog's menu bar.
@@ -143,6 +186,243 @@ RecordDialog::RecordDialog(QDialog *parent) :
 
             recordMenu->addAction(enable);
 
+            recordMenu->addSeparator();
+
+            // Overflow policy.
+            {
+                QMenu *overflowMenu = new QMenu("If the encoder falls behind", this->menubar);
+
+                QActionGroup *overflowGroup = new QActionGroup(this);
+
+                QAction *dropFrames = new QAction("Drop frames", this->menubar);
+                dropFrames->setActionGroup(overflowGroup);
+                dropFrames->setCheckable(true);
+                overflowMenu->addAction(dropFrames);
+
+                QAction *block = new QAction("Wait for the encoder", this->menubar);
+                block->setActionGroup(overflowGroup);
+                block->setCheckable(true);
+                overflowMenu->addAction(block);
+
+                connect(dropFrames, &QAction::triggered, this, [=]
+                {
+                    krecord_set_overflow_policy(recording_overflow_e::drop_frames);
+                    kpers_set_value(INI_GROUP_RECORDING, "overflow_policy", "drop");
+                });
+
+                connect(block, &QAction::triggered, this, [=]
+                {
+                    krecord_set_overflow_policy(recording_overflow_e::block);
+                    kpers_set_value(INI_GROUP_RECORDING, "overflow_policy", "block");
+                });
+
+                if (kpers_value_of(INI_GROUP_RECORDING, "overflow_policy", "drop").toString() == "block")
+                {
+                    block->trigger();
+                }
+                else
+                {
+                    dropFrames->trigger();
+                }
+
+                recordMenu->addMenu(overflowMenu);
+            }
+
+            // Video resolution. Videos are scaled separately from the output window,
+            // so their resolution needn't match the window's.
+            {
+                QMenu *resolutionMenu = new QMenu("Video resolution", this->menubar);
+
+                QActionGroup *resolutionGroup = new QActionGroup(this);
+
+                const auto add_mode = [=](const QString &text, const QString &mode)->QAction*
+                {
+                    QAction *action = new QAction(text, this->menubar);
+                    action->setActionGroup(resolutionGroup);
+                    action->setCheckable(true);
+                    resolutionMenu->addAction(action);
+
+                    connect(action, &QAction::triggered, this, [=]
+                    {
+                        this->videoResolutionMode = mode;
+                        kpers_set_value(INI_GROUP_RECORDING, "video_resolution", mode);
+                    });
+
+                    return action;
+                };
+
+                QAction *sameAsOutput = add_mode("Same as output", "output");
+                QAction *sameAsCapture = add_mode("Same as capture", "capture");
+                QAction *custom = add_mode("Custom...", "custom");
+
+                connect(custom, &QAction::triggered, this, [=]
+                {
+                    bool ok = false;
+                    const QString resolutionString = QInputDialog::getText(this, "VCS - Video resolution",
+                                                                           "Video resolution (width x height):",
+                                                                           QLineEdit::Normal,
+                                                                           QString("%1 x %2").arg(this->customVideoResolution.width())
+                                                                                             .arg(this->customVideoResolution.height()),
+                                                                           &ok);
+                    if (!ok) return;
+
+                    const QStringList dimensions = resolutionString.split("x");
+                    if (dimensions.size() == 2)
+                    {
+                        this->customVideoResolution = QSize(dimensions.at(0).trimmed().toInt(), dimensions.at(1).trimmed().toInt());
+                        kpers_set_value(INI_GROUP_RECORDING, "custom_video_resolution", this->customVideoResolution);
+                    }
+                });
+
+                this->customVideoResolution = kpers_value_of(INI_GROUP_RECORDING, "custom_video_resolution", this->customVideoResolution).toSize();
+
+                const QString mode = kpers_value_of(INI_GROUP_RECORDING, "video_resolution", "output").toString();
+                if (mode == "capture") sameAsCapture->setChecked(true);
+                else if (mode == "custom") custom->setChecked(true);
+                else sameAsOutput->setChecked(true);
+                this->videoResolutionMode = mode;
+
+                recordMenu->addMenu(resolutionMenu);
+            }
+
+            // Scaling filter for the video.
+            {
+                QMenu *filterMenu = new QMenu("Video scaling filter", this->menubar);
+
+                QActionGroup *filterGroup = new QActionGroup(this);
+
+                const QString currentFilterName = kpers_value_of(INI_GROUP_RECORDING, "scaling_filter", "").toString();
+
+                const auto add_filter = [=](const QString &text, const QString &filterName)
+                {
+                    QAction *action = new QAction(text, this->menubar);
+                    action->setActionGroup(filterGroup);
+                    action->setCheckable(true);
+                    action->setChecked(filterName == currentFilterName);
+                    filterMenu->addAction(action);
+
+                    connect(action, &QAction::triggered, this, [=]
+                    {
+                        ks_set_recorder_scaling_filter(filterName.toStdString());
+                        kpers_set_value(INI_GROUP_RECORDING, "scaling_filter", filterName);
+                    });
+                };
+
+                add_filter("Same as output", "");
+                filterMenu->addSeparator();
+                for (const auto &filterName: ks_list_of_scaling_filter_names())
+                {
+                    add_filter(QString::fromStdString(filterName), QString::fromStdString(filterName));
+                }
+
+                ks_set_recorder_scaling_filter(currentFilterName.toStdString());
+
+                recordMenu->addMenu(filterMenu);
+            }
+
+            // Segmenting and pre-recording, which need access to the encoded video.
+            #ifdef USE_LIBAV
+            {
+                recordMenu->addSeparator();
+
+                // Creates a submenu for choosing between the given lengths of time,
+                // in seconds, for the given setting; a length of 0 being given the
+                // text 'offText'.
+                const auto add_length_menu = [=](const QString &title,
+                                                 const QString &settingName,
+                                                 const QString &offText,
+                                                 const std::vector<uint> &lengths,
+                                                 uint *const length)
+                {
+                    QMenu *lengthMenu = new QMenu(title, this->menubar);
+
+                    QActionGroup *lengthGroup = new QActionGroup(this);
+
+                    *length = kpers_value_of(INI_GROUP_RECORDING, settingName, 0).toUInt();
+
+                    for (const uint seconds: lengths)
+                    {
+                        const QString text = (!seconds? offText
+                                              : (seconds < 60)? QString("%1 seconds").arg(seconds)
+                                              : QString("%1 minute%2").arg(seconds / 60).arg((seconds == 60)? "" : "s"));
+
+                        QAction *action = new QAction(text, this->menubar);
+                        action->setActionGroup(lengthGroup);
+                        action->setCheckable(true);
+                        action->setChecked(seconds == *length);
+                        lengthMenu->addAction(action);
+
+                        connect(action, &QAction::triggered, this, [=]
+                        {
+                            *length = seconds;
+                            kpers_set_value(INI_GROUP_RECORDING, settingName, seconds);
+                        });
+                    }
+
+                    // The settings take effect when recording is started.
+                    connect(this, &RecordDialog::recording_enabled, this, [=]{ lengthMenu->setEnabled(false); });
+                    connect(this, &RecordDialog::recording_disabled, this, [=]{ lengthMenu->setEnabled(true); });
+
+                    recordMenu->addMenu(lengthMenu);
+                };
+
+                add_length_menu("Split into segments of", "segment_length", "Don't split",
+                                {0, 60, 300, 900}, &this->segmentLength);
+
+                add_length_menu("Pre-record instead, keeping the last", "prerecord_length", "Don't pre-record",
+                                {0, 10, 30, 60, 300}, &this->prerecordLength);
+
+                // Saves the pre-recorded video into a file named after the recording's
+                // filename and the current time.
+                QAction *savePrerecording = new QAction("Save pre-recorded video", this->menubar);
+                savePrerecording->setEnabled(false);
+                recordMenu->addAction(savePrerecording);
+
+                connect(savePrerecording, &QAction::triggered, this, [=]
+                {
+                    const QFileInfo videoFile(QString::fromStdString(krecord_video_filename()));
+                    const QString filename = QString("%1/%2_%3").arg(videoFile.path())
+                                                                .arg(videoFile.completeBaseName())
+                                                                .arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss"));
+
+                    krecord_save_prerecording(filename.toStdString().c_str());
+                });
+
+                connect(this, &RecordDialog::recording_enabled, this, [=]{ savePrerecording->setEnabled(krecord_is_prerecording()); });
+                connect(this, &RecordDialog::recording_disabled, this, [=]{ savePrerecording->setEnabled(false); });
+            }
+            #endif
+
+            // Audio, which is captured via ALSA and muxed into the video via FFmpeg.
+            #if defined(USE_LIBAV) && defined(USE_ALSA)
+            {
+                recordMenu->addSeparator();
+
+                this->audioDevice = kpers_value_of(INI_GROUP_RECORDING, "audio_device", "").toString();
+
+                QAction *audio = new QAction("Audio input...", this->menubar);
+                recordMenu->addAction(audio);
+
+                connect(audio, &QAction::triggered, this, [=]
+                {
+                    bool ok = false;
+                    const QString deviceName = QInputDialog::getText(this, "VCS - Audio input",
+                                                                     "ALSA device to record audio from (e.g. hw:1,0),\n"
+                                                                     "or leave empty to record no audio:",
+                                                                     QLineEdit::Normal,
+                                                                     this->audioDevice,
+                                                                     &ok);
+                    if (!ok) return;
+
+                    this->audioDevice = deviceName.trimmed();
+                    kpers_set_value(INI_GROUP_RECORDING, "audio_device", this->audioDevice);
+                });
+
+                connect(this, &RecordDialog::recording_enabled, this, [=]{ audio->setEnabled(false); });
+                connect(this, &RecordDialog::recording_disabled, this, [=]{ audio->setEnabled(true); });
+            }
+            #endif
+
             this->menubar->addMenu(recordMenu);
         }
 
@@ -161,15 +441,44 @@ RecordDialog::RecordDialog(QDialog *parent) :
 
             ui->lineEdit_recordingFilename->setText(filename);
         });
+
+        #ifdef USE_LIBAV
+            connect(ui->comboBox_recordingEncoding, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged), this, [this]
+            {
+                const QString containerName = QString::fromStdString(libav_encoder_c::container_suffix(this->selected_codec())).toUpper();
+
+                ui->comboBox_recordingContainer->setItemText(0, containerName);
+
+                // The options specific to x264 don't apply to the other codecs.
+                const bool isX264 = (this->selected_codec() != recording_codec_e::ffv1);
+                ui->comboBox_recordingEncoderPreset->setEnabled(isX264);
+                ui->spinBox_recordingEncoderCRF->setEnabled(this->selected_codec() == recording_codec_e::h264);
+            });
+        #endif
     }
 
     // Restore persistent settings.
     {
         ui->spinBox_recordingFramerate->setValue(kpers_value_of(INI_GROUP_RECORDING, "frame_rate", 60).toUInt());
         ui->comboBox_recordingLinearFrameInsertion->setCurrentIndex(kpers_value_of(INI_GROUP_RECORDING, "linear_sampling", true).toBool());
+        #ifdef USE_LIBAV
+            if (kpers_value_of(INI_GROUP_RECORDING, "variable_frame_rate", false).toBool())
+            {
+                ui->comboBox_recordingLinearFrameInsertion->setCurrentIndex(2);
+            }
+        #endif
         this->resize(kpers_value_of(INI_GROUP_GEOMETRY, "record", this->size()).toSize());
 
-        #if _WIN32
+        #ifdef USE_LIBAV
+            set_qcombobox_idx_c(ui->comboBox_recordingEncoding)
+                               .by_string(kpers_value_of(INI_GROUP_RECORDING, "codec", "H.264").toString());
+
+            set_qcombobox_idx_c(ui->comboBox_recordingEncoderPreset)
+                               .by_string(kpers_value_of(INI_GROUP_RECORDING, "preset", "Superfast").toString());
+
+            ui->spinBox_recordingEncoderCRF->setValue(kpers_value_of(INI_GROUP_RECORDING, "crf", 1).toUInt());
+            ui->lineEdit_recordingEncoderArguments->setText(kpers_value_of(INI_GROUP_RECORDING, "command_line", "").toString());
+        #elif _WIN32
             set_qcombobox_idx_c(ui->comboBox_recordingEncoderProfile)
                                .by_string(kpers_value_of(INI_GROUP_RECORDING, "profile", "High 4:4:4").toString());
 
@@ -219,10 +528,16 @@ RecordDialog::~RecordDialog()
     // Save persistent settings.
     {
         kpers_set_value(INI_GROUP_RECORDING, "frame_rate", ui->spinBox_recordingFramerate->value());
-        kpers_set_value(INI_GROUP_RECORDING, "linear_sampling", bool(ui->comboBox_recordingLinearFrameInsertion->currentIndex()));
+        kpers_set_value(INI_GROUP_RECORDING, "linear_sampling", (ui->comboBox_recordingLinearFrameInsertion->currentIndex() == 1));
+        kpers_set_value(INI_GROUP_RECORDING, "variable_frame_rate", (ui->comboBox_recordingLinearFrameInsertion->currentIndex() == 2));
         kpers_set_value(INI_GROUP_GEOMETRY, "record", this->size());
 
-        #if _WIN32
+        #ifdef USE_LIBAV
+            kpers_set_value(INI_GROUP_RECORDING, "codec", ui->comboBox_recordingEncoding->currentText());
+            kpers_set_value(INI_GROUP_RECORDING, "preset", ui->comboBox_recordingEncoderPreset->currentText());
+            kpers_set_value(INI_GROUP_RECORDING, "crf", ui->spinBox_recordingEncoderCRF->value());
+            kpers_set_value(INI_GROUP_RECORDING, "command_line", ui->lineEdit_recordingEncoderArguments->text());
+        #elif _WIN32
             // Encoder settings. These aren't available to the user on Linux (non-Windows) builds.
             kpers_set_value(INI_GROUP_RECORDING, "profile", ui->comboBox_recordingEncoderProfile->currentText());
             kpers_set_value(INI_GROUP_RECORDING, "pixel_format", ui->comboBox_recordingEncoderPixelFormat->currentText());
@@ -267,7 +582,7 @@ void RecordDialog::update_recording_metainfo(void)
         ui->tableWidget_status->modify_property("Resolution", QString("%1 x %2").arg(krecord_video_resolution().w)
                                                                                 .arg(krecord_video_resolution().h));
 
-        const uint fileBytesize = QFileInfo(krecord_video_filename().c_str()).size();
+        const u64 fileBytesize = krecord_video_bytesize();
         {
             double size = fileBytesize;
             QString suffix = "B";
@@ -294,6 +609,10 @@ void RecordDialog::update_recording_metainfo(void)
         ui->tableWidget_status->modify_property("Input FPS", QString::number(krecord_recording_framerate(), 'f', 2));
 
         ui->tableWidget_status->modify_property("Target FPS", QString::number(krecord_playback_framerate()));
+
+        ui->tableWidget_status->modify_property("Dropped frames", QString::number(krecord_num_frames_dropped()));
+
+        ui->tableWidget_status->modify_property("Delayed frames", QString::number(krecord_num_frames_blocked()));
     }
     else
     {
@@ -302,18 +621,20 @@ void RecordDialog::update_recording_metainfo(void)
         ui->tableWidget_status->modify_property("File size", "-");
         ui->tableWidget_status->modify_property("Input FPS", "-");
         ui->tableWidget_status->modify_property("Target FPS", "-");
+        ui->tableWidget_status->modify_property("Dropped frames", "-");
+        ui->tableWidget_status->modify_property("Delayed frames", "-");
     }
 
     return;
 }
 
 // Applies the x264 codec settings from VCS's GUI into the Windows registry, from
-// where the codec can pick them up when it starts. On Linux, no settings need be
-// written.
+// where the codec can pick them up when it starts. On Linux, and when recording
+// via FFmpeg, no settings need be written.
 //
 bool RecordDialog::apply_x264_registry_settings(void)
 {
-#if _WIN32
+#if _WIN32 && !defined(USE_LIBAV)
     const auto open_x264_registry = []()->HKEY
     {
         HKEY key;
@@ -432,12 +753,27 @@ void RecordDialog::set_recording_enabled(const bool enabled)
             // platforms.
             QFile(ui->lineEdit_recordingFilename->text()).remove();
 
-            const resolution_s videoResolution = ks_output_resolution();
+            const resolution_s videoResolution = this->video_resolution();
+
+            recording_encoder_settings_s encoderSettings;
+            #ifdef USE_LIBAV
+                encoderSettings.codec = this->selected_codec();
+                encoderSettings.preset = ui->comboBox_recordingEncoderPreset->currentText().toLower().toStdString();
+                encoderSettings.crf = ui->spinBox_recordingEncoderCRF->value();
+                encoderSettings.numThreads = kpers_value_of(INI_GROUP_RECORDING, "encoder_threads", 0).toUInt();
+                encoderSettings.keyframeInterval = kpers_value_of(INI_GROUP_RECORDING, "keyframe_interval", 0).toUInt();
+                encoderSettings.extraOptions = ui->lineEdit_recordingEncoderArguments->text().toStdString();
+                encoderSettings.segmentLength = this->segmentLength;
+                encoderSettings.prerecordLength = this->prerecordLength;
+                encoderSettings.isVariableFrameRate = (ui->comboBox_recordingLinearFrameInsertion->currentIndex() == 2);
+                encoderSettings.audioDevice = this->audioDevice.toStdString();
+            #endif
 
             krecord_start_recording(ui->lineEdit_recordingFilename->text().toStdString().c_str(),
                                     videoResolution.w, videoResolution.h,
                                     ui->spinBox_recordingFramerate->value(),
-                                    ui->comboBox_recordingLinearFrameInsertion->currentIndex());
+                                    (ui->comboBox_recordingLinearFrameInsertion->currentIndex() == 1),
+                                    encoderSettings);
 
             if (krecord_is_recording())
             {
@@ -455,6 +791,34 @@ void RecordDialog::set_recording_enabled(const bool enabled)
     return;
 }
 
+// Returns the resolution at which a video would be recorded, given the user's
+// current settings.
+resolution_s RecordDialog::video_resolution(void)
+{
+    if (this->videoResolutionMode == "capture")
+    {
+        return kc_capture_api().get_resolution();
+    }
+    else if (this->videoResolutionMode == "custom")
+    {
+        return {uint(this->customVideoResolution.width()), uint(this->customVideoResolution.height()), 32};
+    }
+    else
+    {
+        return ks_output_resolution();
+    }
+}
+
+// Returns the codec selected in the dialog's codec list.
+recording_codec_e RecordDialog::selected_codec(void)
+{
+    #ifdef USE_LIBAV
+        return recording_codec_e(ui->comboBox_recordingEncoding->currentData().toInt());
+    #else
+        return recording_codec_e::h264;
+    #endif
+}
+
 bool RecordDialog::is_recording_enabled(void)
 {
     return this->isEnabled;
@@ -2,8 +2,11 @@
 #define D_RECORD_DIALOG_H
 
 #include <QDialog>
+#include <QSize>
+#include "common/types.h"
 
 class QMenuBar;
+enum class recording_codec_e;
 
 namespace Ui {
 class RecordDialog;
@@ -37,11 +40,29 @@ signals:
 private:
     bool apply_x264_registry_settings(void);
 
+    recording_codec_e selected_codec(void);
+
+    resolution_s video_resolution(void);
+
     Ui::RecordDialog *ui;
 
     // Whether recording is enabled (on).
     bool isEnabled = false;
 
+    // The resolution at which videos are recorded: "output" for the output
+    // window's current resolution, "capture" for the capture's native resolution,
+    // or "custom" for customVideoResolution.
+    QString videoResolutionMode = "output";
+    QSize customVideoResolution = QSize(640, 480);
+
+    // The length, in seconds, of the video's segment files, and of the video kept
+    // in memory when pre-recording; or 0 if not segmenting or pre-recording.
+    uint segmentLength = 0;
+    uint prerecordLength = 0;
+
+    // The ALSA device from which to record audio; or empty for no audio.
+    QString audioDevice;
+
     QMenuBar *menubar = nullptr;
 };
 
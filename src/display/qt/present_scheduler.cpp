@@ -0,0 +1,151 @@
+/*
+ * 2020 Tarpeeksi Hyvae Soft
+ * 
+ * Software: VCS
+ * 
+ * Schedules the presentation of output frames independently of their production.
+ *
+ */
+
+#include <QTimer>
+#include "display/qt/present_scheduler.h"
+#include "common/globals.h"
+
+present_scheduler_c::present_scheduler_c(std::function<void()> request_present) :
+    request_present_f(request_present)
+{
+    this->clock.start();
+
+    this->refreshTimer = new QTimer(this);
+    this->refreshTimer->setTimerType(Qt::PreciseTimer);
+    this->refreshTimer->setSingleShot(true);
+
+    connect(this->refreshTimer, &QTimer::timeout, this, [=]
+    {
+        if (this->isFramePending)
+        {
+            this->request_present();
+        }
+
+        this->schedule_next_tick();
+    });
+
+    this->set_refresh_rate(60);
+
+    return;
+}
+
+void present_scheduler_c::frame_completed(void)
+{
+    // The previous frame never made it to the screen before being superseded.
+    if (this->isFramePending)
+    {
+        this->presentStats.numDropped++;
+    }
+
+    this->isFramePending = true;
+    this->pendingFrameTimestamp = this->clock.nsecsElapsed();
+
+    if (this->isVsyncDriven)
+    {
+        this->request_present();
+    }
+
+    return;
+}
+
+void present_scheduler_c::frame_presented(void)
+{
+    this->isPresentRequested = false;
+
+    // The renderer may also present e.g. in response to the window being exposed,
+    // in which case there's no new frame to account for.
+    if (!this->isFramePending)
+    {
+        return;
+    }
+
+    this->isFramePending = false;
+    this->presentStats.numPresented++;
+
+    // A frame is late if it wasn't presented within the refresh following its
+    // completion.
+    if ((this->clock.nsecsElapsed() - this->pendingFrameTimestamp) > this->refreshIntervalNs)
+    {
+        this->presentStats.numLate++;
+    }
+
+    return;
+}
+
+void present_scheduler_c::request_present(void)
+{
+    // Presentation requests are coalesced until the renderer gets to presenting.
+    if (this->isPresentRequested)
+    {
+        return;
+    }
+
+    this->isPresentRequested = true;
+    this->request_present_f();
+
+    return;
+}
+
+void present_scheduler_c::set_vsync_driven(const bool isVsyncDriven)
+{
+    this->isVsyncDriven = isVsyncDriven;
+
+    // Any outstanding request was made of the previous renderer, which may no
+    // longer be around to fulfill it.
+    this->isPresentRequested = false;
+
+    if (isVsyncDriven)
+    {
+        this->refreshTimer->stop();
+    }
+    else
+    {
+        this->nextTickNs = this->clock.nsecsElapsed();
+        this->schedule_next_tick();
+    }
+
+    return;
+}
+
+// Arms the refresh timer to tick at the next refresh deadline. The deadline is
+// advanced by whole refresh intervals rather than the timer being re-armed with
+// a fixed interval, so that rounding the interval to the timer's millisecond
+// precision doesn't make the ticks drift from the refresh rate.
+//
+void present_scheduler_c::schedule_next_tick(void)
+{
+    const qint64 now = this->clock.nsecsElapsed();
+
+    this->nextTickNs += this->refreshIntervalNs;
+
+    // If we've fallen behind by more than a refresh, skip the missed ticks.
+    if (this->nextTickNs <= now)
+    {
+        this->nextTickNs = (now + this->refreshIntervalNs - ((now - this->nextTickNs) % this->refreshIntervalNs));
+    }
+
+    // Round up, so that the timer doesn't tick before the deadline.
+    this->refreshTimer->start(int((this->nextTickNs - now + 999999) / 1000000));
+
+    return;
+}
+
+void present_scheduler_c::set_refresh_rate(const double hz)
+{
+    k_assert((hz > 0), "Expected a positive refresh rate.");
+
+    this->refreshIntervalNs = qint64(1000000000 / hz);
+
+    return;
+}
+
+present_stats_s present_scheduler_c::stats(void) const
+{
+    return this->presentStats;
+}
@@ -0,0 +1,84 @@
+/*
+ * 2020 Tarpeeksi Hyvae Soft
+ * 
+ * Software: VCS
+ *
+ */
+
+#ifndef PRESENT_SCHEDULER_H
+#define PRESENT_SCHEDULER_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <functional>
+#include "display/display.h"
+
+class QTimer;
+
+// Decouples the presentation of output frames from their production. The
+// producer (the scaler) reports each completed frame via frame_completed(), which
+// returns right away; and the renderer reports via frame_presented() when it has
+// actually put the newest completed frame on screen. In between, the scheduler
+// asks the renderer to present at most once per display refresh; so that if
+// several frames complete within one refresh, only the newest is presented and
+// the rest are counted as dropped.
+//
+// For renderers whose presentation is already paced by vsync (e.g. OpenGL with
+// a swap interval of 1), presentation is requested as soon as a frame completes.
+// For others, a timer ticking at the display's refresh rate stands in for vsync.
+// The timer's ticks are scheduled against a deadline that advances by exactly
+// one refresh interval per tick, so that they keep to the refresh rate on
+// average even though the timer itself only has millisecond precision.
+class present_scheduler_c : public QObject
+{
+    Q_OBJECT
+
+public:
+    present_scheduler_c(std::function<void()> request_present);
+
+    // Call when a new frame has been completed and is ready to be presented.
+    void frame_completed(void);
+
+    // Call when the renderer has presented the newest completed frame.
+    void frame_presented(void);
+
+    // Set whether the renderer's presentation is paced by vsync.
+    void set_vsync_driven(const bool isVsyncDriven);
+
+    void set_refresh_rate(const double hz);
+
+    present_stats_s stats(void) const;
+
+private:
+    void request_present(void);
+
+    void schedule_next_tick(void);
+
+    std::function<void()> request_present_f;
+
+    // Ticks at the display's refresh rate, when presentation isn't paced by vsync.
+    QTimer *refreshTimer = nullptr;
+
+    // Time since the scheduler was created. Used to timestamp frames.
+    QElapsedTimer clock;
+
+    // The duration of one display refresh, in nanoseconds.
+    qint64 refreshIntervalNs = (1000000000 / 60);
+
+    // When the refresh timer should next tick, in nanoseconds of 'clock'.
+    qint64 nextTickNs = 0;
+
+    // Whether there's a completed frame that hasn't yet been presented, and
+    // when it was completed.
+    bool isFramePending = false;
+    qint64 pendingFrameTimestamp = 0;
+
+    // Whether we've asked the renderer to present, and it hasn't yet done so.
+    bool isPresentRequested = false;
+
+    bool isVsyncDriven = false;
+
+    present_stats_s presentStats = {0, 0, 0};
+};
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ * 2020 Tarpeeksi Hyvae Soft
+ * 
+ * Software: VCS
+ * 
+ * Draws a texture (the output frame or the overlay) for the OpenGL renderer,
+ * scaling it with the selected filter. The texture is expected to be sampled
+ * with GL_NEAREST and GL_CLAMP_TO_EDGE, since the filters interpolate by hand.
+ *
+ * The filters have been written to be cheap enough to run on software
+ * implementations like Mesa's llvmpipe, too.
+ *
+ */
+
+#version 330 core
+
+// Values of scalingFilter. These must match SHADER_SCALING_FILTERS in
+// QOpenGLWidget_opengl_renderer.cpp.
+const int FILTER_NEAREST = 0;
+const int FILTER_LINEAR  = 1;
+const int FILTER_AREA    = 2;
+const int FILTER_CUBIC   = 3;
+const int FILTER_LANCZOS = 4;
+
+uniform sampler2D frame;
+uniform int scalingFilter;
+uniform vec2 frameSize;  // The resolution of the texture.
+uniform vec2 outputSize; // The resolution to which the texture is being scaled.
+
+in vec2 texCoord;
+
+out vec4 fragColor;
+
+vec4 texel(vec2 p)
+{
+    return texture(frame, ((p + 0.5) / frameSize));
+}
+
+vec4 filter_nearest(void)
+{
+    return texel(floor(texCoord * frameSize));
+}
+
+vec4 filter_linear(void)
+{
+    vec2 p = ((texCoord * frameSize) - 0.5);
+    vec2 i = floor(p);
+    vec2 f = (p - i);
+
+    return mix(mix(texel(i),                  texel(i + vec2(1.0, 0.0)), f.x),
+               mix(texel(i + vec2(0.0, 1.0)), texel(i + vec2(1.0, 1.0)), f.x),
+               f.y);
+}
+
+// Approximates the average of the texels under the output pixel's footprint
+// with a 4 x 4 grid of samples.
+vec4 filter_area(void)
+{
+    vec2 footprint = (frameSize / outputSize);
+    vec2 origin = ((texCoord * frameSize) - (footprint * 0.5));
+    vec4 sum = vec4(0.0);
+
+    for (int y = 0; y < 4; y++)
+    {
+        for (int x = 0; x < 4; x++)
+        {
+            sum += texel(floor(origin + (footprint * ((vec2(x, y) + 0.5) / 4.0))));
+        }
+    }
+
+    return (sum / 16.0);
+}
+
+// The weights of a 4-tap cubic convolution kernel, with the same coefficient
+// (-0.75) as OpenCV's INTER_CUBIC.
+vec4 cubic_weights(float t)
+{
+    const float A = -0.75;
+
+    vec4 w;
+    w.x = ((((A * (t + 1.0)) - (5.0 * A)) * (t + 1.0) + (8.0 * A)) * (t + 1.0) - (4.0 * A));
+    w.y = (((((A + 2.0) * t) - (A + 3.0)) * t * t) + 1.0);
+    w.z = (((((A + 2.0) * (1.0 - t)) - (A + 3.0)) * (1.0 - t) * (1.0 - t)) + 1.0);
+    w.w = (1.0 - w.x - w.y - w.z);
+
+    return w;
+}
+
+vec4 filter_cubic(void)
+{
+    vec2 p = ((texCoord * frameSize) - 0.5);
+    vec2 i = floor(p);
+    vec2 f = (p - i);
+    vec4 wx = cubic_weights(f.x);
+    vec4 wy = cubic_weights(f.y);
+    vec4 sum = vec4(0.0);
+
+    for (int y = 0; y < 4; y++)
+    {
+        vec4 row = ((texel(i + vec2(-1.0, y - 1)) * wx.x) +
+                    (texel(i + vec2( 0.0, y - 1)) * wx.y) +
+                    (texel(i + vec2( 1.0, y - 1)) * wx.z) +
+                    (texel(i + vec2( 2.0, y - 1)) * wx.w));
+
+        sum += (row * wy[y]);
+    }
+
+    return clamp(sum, 0.0, 1.0);
+}
+
+// A three-lobed Lanczos kernel; OpenCV's INTER_LANCZOS4 uses four, but three
+// keeps the filter affordable in software implementations.
+float lanczos_weight(float x)
+{
+    const float PI = 3.14159265;
+    const float LOBES = 3.0;
+
+    if (abs(x) < 0.00001)
+    {
+        return 1.0;
+    }
+
+    float px = (PI * x);
+
+    return ((LOBES * sin(px) * sin(px / LOBES)) / (px * px));
+}
+
+vec4 filter_lanczos(void)
+{
+    vec2 p = ((texCoord * frameSize) - 0.5);
+    vec2 i = floor(p);
+    vec2 f = (p - i);
+    vec4 sum = vec4(0.0);
+    float weightSum = 0.0;
+
+    for (int y = -2; y <= 3; y++)
+    {
+        float wy = lanczos_weight(float(y) - f.y);
+
+        for (int x = -2; x <= 3; x++)
+        {
+            float w = (lanczos_weight(float(x) - f.x) * wy);
+
+            sum += (texel(i + vec2(x, y)) * w);
+            weightSum += w;
+        }
+    }
+
+    return clamp((sum / weightSum), 0.0, 1.0);
+}
+
+void main()
+{
+    switch (scalingFilter)
+    {
+        case FILTER_LINEAR:  fragColor = filter_linear(); break;
+        case FILTER_AREA:    fragColor = filter_area(); break;
+        case FILTER_CUBIC:   fragColor = filter_cubic(); break;
+        case FILTER_LANCZOS: fragColor = filter_lanczos(); break;
+        default:             fragColor = filter_nearest(); break;
+    }
+}
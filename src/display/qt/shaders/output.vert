@@ -0,0 +1,27 @@
+/*
+ * 2020 Tarpeeksi Hyvae Soft
+ * 
+ * Software: VCS
+ * 
+ * Transforms the OpenGL renderer's unit quad into the given rectangle of the
+ * window, whose coordinates are in pixels with the origin at the top left.
+ *
+ */
+
+#version 330 core
+
+in vec2 vertexPos;
+
+uniform vec4 targetRect; // x, y, width, height.
+uniform vec2 windowSize;
+
+out vec2 texCoord;
+
+void main()
+{
+    vec2 pixelPos = (targetRect.xy + (vertexPos * targetRect.zw));
+    vec2 ndc = (((pixelPos / windowSize) * 2.0) - 1.0);
+
+    gl_Position = vec4(ndc.x, -ndc.y, 0.0, 1.0);
+    texCoord = vertexPos;
+}
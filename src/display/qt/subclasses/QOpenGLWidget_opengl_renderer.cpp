@@ -5,24 +5,134 @@
  * Uses Qt's OpenGL implementation to draw the contents of the VCS frame buffer
  * to screen. I.e. just draws a full-window textured quad.
  *
+ * The renderer targets an OpenGL 3.3 core profile context: the quad lives in a
+ * vertex buffer, and is drawn by a single shader program (src/display/qt/shaders/)
+ * that also does any scaling of the frame.
+ *
+ * Frames are uploaded as they arrive from the scaler into a ring of three frame
+ * textures, and repaints are scheduled separately (see present_scheduler.h); so
+ * that when a repaint happens (at vsync, if the platform honors the swap
+ * interval), the newest complete frame is presented, and any frames that arrived
+ * in between are skipped rather than each being drawn in turn.
+ *
+ * Each frame texture's storage is allocated only when the resolution of its
+ * frames changes. Where the OpenGL implementation allows, the pixel data travel
+ * through a ring of persistently mapped pixel buffer objects; else through a
+ * pair of orphaned PBOs; or, failing that, directly from client memory.
+ *
+ * If the scaler has been told to defer scaling to the renderer, the frames will
+ * arrive at their native resolution, and we'll scale them to the window in the
+ * fragment shader.
+ *
  */
 
+#include <QOpenGLVertexArrayObject>
+#include <QOpenGLShaderProgram>
 #include <QCoreApplication>
+#include <QOpenGLContext>
+#include <QOpenGLBuffer>
 #include <QOpenGLWidget>
-#include <QMatrix4x4>
+#include <QVector4D>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
 #include "display/qt/subclasses/QOpenGLWidget_opengl_renderer.h"
 #include "capture/capture.h"
 #include "common/globals.h"
+#include "display/display.h"
 #include "scaler/scaler.h"
 
-// The texture into which we'll stream the captured frames.
-GLuint FRAMEBUFFER_TEXTURE;
+// The textures into which we'll stream the captured frames. At any given time,
+// one of them holds the frame being presented, one holds the newest complete
+// frame (which may be the same one), and the rest are free to receive new frames.
+static const uint NUM_FRAME_TEXTURES = 3;
+static struct
+{
+    GLuint textures[NUM_FRAME_TEXTURES] = {0};
+
+    // The resolution of each texture's storage, and of the frame it holds.
+    resolution_s resolutions[NUM_FRAME_TEXTURES] = {};
+
+    // Whether the frame in each texture was left unscaled by the scaler, in
+    // which case it's for us to scale.
+    bool isDeferred[NUM_FRAME_TEXTURES] = {false};
+
+    // The texture holding the newest complete frame, and the texture whose frame
+    // was last presented; or -1 if there's no such texture yet.
+    int newestIdx = -1;
+    int presentedIdx = -1;
+} FRAME_TEXTURES;
 
 // The texture in which we'll display the current output overlay, if any.
-GLuint OVERLAY_TEXTURE;
+static GLuint OVERLAY_TEXTURE = 0;
 
 // A function that returns the current overlay as a QImage.
-std::function<QImage()> OVERLAY_AS_QIMAGE_F;
+static std::function<QImage()> OVERLAY_AS_QIMAGE_F;
+
+// Identifies the overlay image that was last uploaded into the overlay texture;
+// so that we don't upload it again unless it has changed.
+static qint64 OVERLAY_TEXTURE_CACHE_KEY = 0;
+static QSize OVERLAY_TEXTURE_SIZE;
+
+// The shader program with which all drawing is done, and the unit quad it draws.
+static QOpenGLShaderProgram *OUTPUT_SHADER = nullptr;
+static QOpenGLVertexArrayObject *QUAD_VAO = nullptr;
+static QOpenGLBuffer *QUAD_VBO = nullptr;
+
+// The scaling filters implemented by the output shader, keyed by the name of
+// the corresponding scaling filter in SCALING_FILTERS (scaler.cpp). The values
+// must match the filter indices in output.frag.
+static const std::unordered_map<std::string, int> SHADER_SCALING_FILTERS =
+{
+    {"Nearest", 0},
+    {"Linear",  1},
+    {"Area",    2},
+    {"Cubic",   3},
+    {"Lanczos", 4},
+};
+
+// The ways in which we can move frame data into a frame texture. The best one
+// supported by the OpenGL implementation is chosen at initialization.
+enum class frame_upload_method_e
+{
+    direct,         // glTexSubImage2D() straight from the scaler's output buffer.
+    pbo,            // Alternate between pixel buffer objects, orphaning each before writing.
+    pbo_persistent  // A ring of pixel buffer objects that remain mapped for their lifetime.
+};
+
+static frame_upload_method_e FRAME_UPLOAD_METHOD = frame_upload_method_e::direct;
+
+// Whether the texture storage can be allocated as immutable (glTexStorage2D()).
+static bool IMMUTABLE_TEXTURE_STORAGE_AVAILABLE = false;
+
+// The pixel buffer objects through which frames are streamed. The persistent
+// method uses three, so that while we write one frame, the GPU can still be
+// consuming the previous two; the orphaning method uses two.
+static const uint MAX_NUM_FRAME_PBOS = 3;
+static struct
+{
+    GLuint buffers[MAX_NUM_FRAME_PBOS] = {0};
+    GLsync fences[MAX_NUM_FRAME_PBOS] = {0};
+    u8 *mappedPtrs[MAX_NUM_FRAME_PBOS] = {nullptr};
+    uint numBuffers = 0;
+    uint bufferSize = 0;
+    uint nextIdx = 0;
+} FRAME_PBOS;
+
+// OpenGL entry points that the streaming upload needs but which QOpenGLFunctions
+// doesn't provide. These are resolved at run-time and left null if the
+// implementation lacks them.
+static struct
+{
+    PFNGLMAPBUFFERPROC mapBuffer = nullptr;
+    PFNGLUNMAPBUFFERPROC unmapBuffer = nullptr;
+    PFNGLBUFFERSTORAGEPROC bufferStorage = nullptr;
+    PFNGLMAPBUFFERRANGEPROC mapBufferRange = nullptr;
+    PFNGLFENCESYNCPROC fenceSync = nullptr;
+    PFNGLCLIENTWAITSYNCPROC clientWaitSync = nullptr;
+    PFNGLDELETESYNCPROC deleteSync = nullptr;
+    PFNGLTEXSTORAGE2DPROC texStorage2D = nullptr;
+} GL_STREAMING;
 
 OGLWidget::OGLWidget(std::function<QImage()> overlay_as_qimage, QWidget *parent) : QOpenGLWidget(parent)
 {
@@ -31,6 +141,51 @@ OGLWidget::OGLWidget(std::function<QImage()> overlay_as_qimage, QWidget *parent)
     // Needed for auto-hiding the parent window's menu bar to work.
     this->setMouseTracking(true);
 
+    QSurfaceFormat format;
+    format.setDepthBufferSize(0);
+    format.setStencilBufferSize(0);
+    format.setVersion(3, 3);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+    format.setRenderableType(QSurfaceFormat::OpenGL);
+    format.setSwapBehavior(QSurfaceFormat::TripleBuffer);
+    format.setSwapInterval(1); // Vsync.
+    format.setSamples(0);
+    this->setFormat(format);
+
+    return;
+}
+
+OGLWidget::~OGLWidget()
+{
+    // If the widget was never shown, no OpenGL objects will have been created.
+    if (!this->isValid())
+    {
+        return;
+    }
+
+    // The OpenGL objects need to be released while our context is current.
+    this->makeCurrent();
+
+    this->release_frame_pbos();
+
+    this->glDeleteTextures(NUM_FRAME_TEXTURES, FRAME_TEXTURES.textures);
+    this->glDeleteTextures(1, &OVERLAY_TEXTURE);
+
+    delete OUTPUT_SHADER;
+    OUTPUT_SHADER = nullptr;
+
+    delete QUAD_VBO;
+    QUAD_VBO = nullptr;
+
+    delete QUAD_VAO;
+    QUAD_VAO = nullptr;
+
+    FRAME_TEXTURES = {};
+    OVERLAY_TEXTURE_CACHE_KEY = 0;
+    OVERLAY_TEXTURE_SIZE = QSize();
+
+    this->doneCurrent();
+
     return;
 }
 
@@ -40,60 +195,560 @@ void OGLWidget::initializeGL()
 
     DEBUG(("OpenGL is reported to be version %s.", glGetString(GL_VERSION)));
 
+    const auto fail = [this]
+    {
+        kd_show_headless_error_message("VCS: OpenGL error",
+                                       "The OpenGL renderer couldn't be initialized. It requires OpenGL 3.3 or "
+                                       "newer, which this system may not provide.\n\n"
+                                       "VCS will use the software renderer instead.");
+
+        emit this->initialization_failed();
+    };
+
+    const QPair<int, int> version = this->context()->format().version();
+    if ((version < qMakePair(3, 3)) ||
+        (this->context()->format().profile() != QSurfaceFormat::CoreProfile))
+    {
+        NBENE(("Expected an OpenGL 3.3 core profile context, but got version %d.%d.", version.first, version.second));
+        fail();
+        return;
+    }
+
+    if (!this->create_output_shader())
+    {
+        fail();
+        return;
+    }
+
     this->glDisable(GL_DEPTH_TEST);
-    this->glEnable(GL_TEXTURE_2D);
 
-    this->glGenTextures(1, &FRAMEBUFFER_TEXTURE);
-    this->glBindTexture(GL_TEXTURE_2D, FRAMEBUFFER_TEXTURE);
-    this->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    this->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    this->glGenTextures(NUM_FRAME_TEXTURES, FRAME_TEXTURES.textures);
+    for (uint i = 0; i < NUM_FRAME_TEXTURES; i++)
+    {
+        this->set_texture_parameters(FRAME_TEXTURES.textures[i]);
+    }
 
     this->glGenTextures(1, &OVERLAY_TEXTURE);
-    this->glBindTexture(GL_TEXTURE_2D, OVERLAY_TEXTURE);
-    this->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    this->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    this->set_texture_parameters(OVERLAY_TEXTURE);
 
     // For alpha-blending the overlay image.
     this->glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    this->glEnable(GL_BLEND);
+
+    this->resolve_streaming_functions();
+    this->create_quad();
 
     k_assert(!this->glGetError(), "OpenGL initialization failed.");
 
     return;
 }
 
-void OGLWidget::resizeGL(int w, int h)
+// Find out which of the frame upload methods the OpenGL implementation supports,
+// and select the fastest of them.
+//
+void OGLWidget::resolve_streaming_functions(void)
 {
-    QMatrix4x4 m;
-    m.setToIdentity();
-    m.ortho(0, w, h, 0, -1, 1);
+    QOpenGLContext *const context = this->context();
+    const QPair<int, int> version = context->format().version();
+
+    const auto has = [context, version](const QPair<int, int> coreVersion, const char *const extensionName)
+    {
+        return ((version >= coreVersion) || context->hasExtension(extensionName));
+    };
+
+    #define RESOLVE(name, func) GL_STREAMING.name = (decltype(GL_STREAMING.name))context->getProcAddress(func);
+    RESOLVE(mapBuffer,      "glMapBuffer");
+    RESOLVE(unmapBuffer,    "glUnmapBuffer");
+    RESOLVE(bufferStorage,  "glBufferStorage");
+    RESOLVE(mapBufferRange, "glMapBufferRange");
+    RESOLVE(fenceSync,      "glFenceSync");
+    RESOLVE(clientWaitSync, "glClientWaitSync");
+    RESOLVE(deleteSync,     "glDeleteSync");
+    RESOLVE(texStorage2D,   "glTexStorage2D");
+    #undef RESOLVE
 
-    this->glLoadMatrixf(m.constData());
+    const bool hasPbo = (has(qMakePair(2, 1), "GL_ARB_pixel_buffer_object") &&
+                         GL_STREAMING.mapBuffer &&
+                         GL_STREAMING.unmapBuffer);
+
+    const bool hasPersistentPbo = (hasPbo &&
+                                   has(qMakePair(4, 4), "GL_ARB_buffer_storage") &&
+                                   has(qMakePair(3, 0), "GL_ARB_map_buffer_range") &&
+                                   has(qMakePair(3, 2), "GL_ARB_sync") &&
+                                   GL_STREAMING.bufferStorage &&
+                                   GL_STREAMING.mapBufferRange &&
+                                   GL_STREAMING.fenceSync &&
+                                   GL_STREAMING.clientWaitSync &&
+                                   GL_STREAMING.deleteSync);
+
+    IMMUTABLE_TEXTURE_STORAGE_AVAILABLE = (has(qMakePair(4, 2), "GL_ARB_texture_storage") &&
+                                           GL_STREAMING.texStorage2D);
+
+    if (hasPersistentPbo)
+    {
+        FRAME_UPLOAD_METHOD = frame_upload_method_e::pbo_persistent;
+        INFO(("Streaming frames to OpenGL via persistently mapped PBOs."));
+    }
+    else if (hasPbo)
+    {
+        FRAME_UPLOAD_METHOD = frame_upload_method_e::pbo;
+        INFO(("Streaming frames to OpenGL via double-buffered PBOs."));
+    }
+    else
+    {
+        FRAME_UPLOAD_METHOD = frame_upload_method_e::direct;
+        INFO(("Streaming frames to OpenGL directly from client memory."));
+    }
 
     return;
 }
 
-void OGLWidget::paintGL()
+// Compiles the shader program with which everything is drawn. Returns false if
+// the shader program couldn't be built; true otherwise.
+//
+bool OGLWidget::create_output_shader(void)
+{
+    OUTPUT_SHADER = new QOpenGLShaderProgram;
+
+    if (!OUTPUT_SHADER->addShaderFromSourceFile(QOpenGLShader::Vertex, ":/res/shaders/output.vert") ||
+        !OUTPUT_SHADER->addShaderFromSourceFile(QOpenGLShader::Fragment, ":/res/shaders/output.frag") ||
+        !OUTPUT_SHADER->link())
+    {
+        NBENE(("Failed to build the OpenGL renderer's shader program: %s", OUTPUT_SHADER->log().toStdString().c_str()));
+
+        delete OUTPUT_SHADER;
+        OUTPUT_SHADER = nullptr;
+
+        return false;
+    }
+
+    return true;
+}
+
+// Creates the vertex buffer of the unit quad, which the vertex shader transforms
+// into whichever rectangle of the window is being drawn to.
+//
+void OGLWidget::create_quad(void)
+{
+    static const GLfloat vertices[] =
+    {
+        0, 0,
+        1, 0,
+        0, 1,
+        1, 1,
+    };
+
+    QUAD_VAO = new QOpenGLVertexArrayObject;
+    QUAD_VAO->create();
+    QUAD_VAO->bind();
+
+    QUAD_VBO = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+    QUAD_VBO->create();
+    QUAD_VBO->setUsagePattern(QOpenGLBuffer::StaticDraw);
+    QUAD_VBO->bind();
+    QUAD_VBO->allocate(vertices, sizeof(vertices));
+
+    OUTPUT_SHADER->bind();
+    OUTPUT_SHADER->enableAttributeArray("vertexPos");
+    OUTPUT_SHADER->setAttributeBuffer("vertexPos", GL_FLOAT, 0, 2);
+    OUTPUT_SHADER->release();
+
+    QUAD_VAO->release();
+    QUAD_VBO->release();
+
+    return;
+}
+
+// Sets the sampling parameters of the given texture. The shader does its own
+// filtering, so we sample texels as they are.
+//
+void OGLWidget::set_texture_parameters(const GLuint texture)
+{
+    this->glBindTexture(GL_TEXTURE_2D, texture);
+    this->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    this->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // The scaling filters sample past the frame's edges.
+    this->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    this->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    return;
+}
+
+// (Re)allocates storage for the given frame texture to match the given resolution.
+// Leaves the texture bound.
+//
+void OGLWidget::allocate_frame_texture(const uint idx, const resolution_s &r)
+{
+    if (IMMUTABLE_TEXTURE_STORAGE_AVAILABLE)
+    {
+        // Immutable storage can't be resized, so we need a new texture object
+        // for each new resolution.
+        this->glDeleteTextures(1, &FRAME_TEXTURES.textures[idx]);
+        this->glGenTextures(1, &FRAME_TEXTURES.textures[idx]);
+        this->set_texture_parameters(FRAME_TEXTURES.textures[idx]);
+
+        GL_STREAMING.texStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, r.w, r.h);
+    }
+    else
+    {
+        this->glBindTexture(GL_TEXTURE_2D, FRAME_TEXTURES.textures[idx]);
+        this->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, r.w, r.h, 0, GL_BGRA, GL_UNSIGNED_BYTE, nullptr);
+    }
+
+    FRAME_TEXTURES.resolutions[idx] = r;
+
+    return;
+}
+
+void OGLWidget::allocate_frame_pbos(const resolution_s &r)
+{
+    this->release_frame_pbos();
+
+    FRAME_PBOS.bufferSize = (r.w * r.h * 4);
+    FRAME_PBOS.numBuffers = ((FRAME_UPLOAD_METHOD == frame_upload_method_e::pbo_persistent)? 3 : 2);
+    FRAME_PBOS.nextIdx = 0;
+
+    k_assert(FRAME_PBOS.numBuffers <= MAX_NUM_FRAME_PBOS, "Too many PBOs requested.");
+
+    this->glGenBuffers(FRAME_PBOS.numBuffers, FRAME_PBOS.buffers);
+
+    for (uint i = 0; i < FRAME_PBOS.numBuffers; i++)
+    {
+        this->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, FRAME_PBOS.buffers[i]);
+
+        if (FRAME_UPLOAD_METHOD == frame_upload_method_e::pbo_persistent)
+        {
+            const GLbitfield flags = (GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+
+            GL_STREAMING.bufferStorage(GL_PIXEL_UNPACK_BUFFER, FRAME_PBOS.bufferSize, nullptr, flags);
+            FRAME_PBOS.mappedPtrs[i] = (u8*)GL_STREAMING.mapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, FRAME_PBOS.bufferSize, flags);
+
+            // If the mapping failed, fall back to the non-persistent method.
+            if (FRAME_PBOS.mappedPtrs[i] == nullptr)
+            {
+                NBENE(("Failed to persistently map a PBO. Falling back to double-buffered PBOs."));
+
+                this->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                FRAME_UPLOAD_METHOD = frame_upload_method_e::pbo;
+                this->allocate_frame_pbos(r);
+
+                return;
+            }
+        }
+        else
+        {
+            this->glBufferData(GL_PIXEL_UNPACK_BUFFER, FRAME_PBOS.bufferSize, nullptr, GL_STREAM_DRAW);
+        }
+    }
+
+    this->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    return;
+}
+
+void OGLWidget::release_frame_pbos(void)
+{
+    if (!FRAME_PBOS.numBuffers)
+    {
+        return;
+    }
+
+    for (uint i = 0; i < FRAME_PBOS.numBuffers; i++)
+    {
+        if (FRAME_PBOS.fences[i])
+        {
+            GL_STREAMING.deleteSync(FRAME_PBOS.fences[i]);
+            FRAME_PBOS.fences[i] = 0;
+        }
+
+        if (FRAME_PBOS.mappedPtrs[i])
+        {
+            this->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, FRAME_PBOS.buffers[i]);
+            GL_STREAMING.unmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            FRAME_PBOS.mappedPtrs[i] = nullptr;
+        }
+    }
+
+    this->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    this->glDeleteBuffers(FRAME_PBOS.numBuffers, FRAME_PBOS.buffers);
+
+    FRAME_PBOS.numBuffers = 0;
+    FRAME_PBOS.bufferSize = 0;
+
+    return;
+}
+
+// Copies the given BGRA pixels into the currently bound frame texture, whose
+// storage is expected to have been allocated for the given resolution.
+//
+void OGLWidget::upload_frame(const u8 *const pixels, const resolution_s &r)
+{
+    const uint frameSize = (r.w * r.h * 4);
+
+    if ((FRAME_UPLOAD_METHOD != frame_upload_method_e::direct) &&
+        (FRAME_PBOS.bufferSize != frameSize))
+    {
+        this->allocate_frame_pbos(r);
+    }
+
+    switch (FRAME_UPLOAD_METHOD)
+    {
+        case frame_upload_method_e::pbo_persistent:
+        {
+            const uint idx = FRAME_PBOS.nextIdx;
+            FRAME_PBOS.nextIdx = ((FRAME_PBOS.nextIdx + 1) % FRAME_PBOS.numBuffers);
+
+            // Make sure the GPU is done reading this buffer's previous contents
+            // before we overwrite them. With three buffers in the ring, this
+            // should rarely if ever need to wait.
+            if (FRAME_PBOS.fences[idx])
+            {
+                const GLenum status = GL_STREAMING.clientWaitSync(FRAME_PBOS.fences[idx], GL_SYNC_FLUSH_COMMANDS_BIT, 100000000 /*100 ms*/);
+                if (status == GL_TIMEOUT_EXPIRED)
+                {
+                    DEBUG(("Timed out waiting for the GPU to release a PBO."));
+                }
+
+                GL_STREAMING.deleteSync(FRAME_PBOS.fences[idx]);
+                FRAME_PBOS.fences[idx] = 0;
+            }
+
+            memcpy(FRAME_PBOS.mappedPtrs[idx], pixels, frameSize);
+
+            this->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, FRAME_PBOS.buffers[idx]);
+            this->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, r.w, r.h, GL_BGRA, GL_UNSIGNED_BYTE, nullptr);
+            this->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+            FRAME_PBOS.fences[idx] = GL_STREAMING.fenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+            break;
+        }
+        case frame_upload_method_e::pbo:
+        {
+            const uint idx = FRAME_PBOS.nextIdx;
+            FRAME_PBOS.nextIdx = ((FRAME_PBOS.nextIdx + 1) % FRAME_PBOS.numBuffers);
+
+            this->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, FRAME_PBOS.buffers[idx]);
+
+            // Orphan the buffer's previous storage, so that mapping it won't
+            // stall if the GPU is still reading from it.
+            this->glBufferData(GL_PIXEL_UNPACK_BUFFER, frameSize, nullptr, GL_STREAM_DRAW);
+
+            u8 *const dst = (u8*)GL_STREAMING.mapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+            if (dst != nullptr)
+            {
+                memcpy(dst, pixels, frameSize);
+                GL_STREAMING.unmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+                this->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, r.w, r.h, GL_BGRA, GL_UNSIGNED_BYTE, nullptr);
+                this->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+            else
+            {
+                this->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                this->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, r.w, r.h, GL_BGRA, GL_UNSIGNED_BYTE, pixels);
+            }
+
+            break;
+        }
+        case frame_upload_method_e::direct:
+        {
+            this->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, r.w, r.h, GL_BGRA, GL_UNSIGNED_BYTE, pixels);
+
+            break;
+        }
+        default: k_assert(0, "Unknown frame upload method."); break;
+    }
+
+    return;
+}
+
+// Uploads the given overlay image into the overlay texture, unless it's the same
+// image as was uploaded last time. Expects the overlay texture to be bound.
+//
+void OGLWidget::upload_overlay(const QImage &image)
+{
+    if (image.cacheKey() == OVERLAY_TEXTURE_CACHE_KEY)
+    {
+        return;
+    }
+
+    if (image.size() == OVERLAY_TEXTURE_SIZE)
+    {
+        this->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width(), image.height(), GL_BGRA, GL_UNSIGNED_BYTE, image.constBits());
+    }
+    else
+    {
+        this->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image.width(), image.height(), 0, GL_BGRA, GL_UNSIGNED_BYTE, image.constBits());
+        OVERLAY_TEXTURE_SIZE = image.size();
+    }
+
+    OVERLAY_TEXTURE_CACHE_KEY = image.cacheKey();
+
+    return;
+}
+
+// Uploads the scaler's current output frame into a free frame texture, and marks
+// it as the newest complete frame, to be drawn on the next repaint. Call this once
+// for each new frame the scaler produces.
+//
+void OGLWidget::submit_frame(void)
 {
-    // Draw the output frame.
-    const resolution_s r = ks_output_resolution();
     const u8 *const fb = ks_scaler_output_as_raw_ptr();
-    if (fb != nullptr)
+
+    // The OpenGL objects won't exist until the widget has been shown, nor at all
+    // if its initialization failed.
+    if (!this->isValid() ||
+        !OUTPUT_SHADER ||
+        (fb == nullptr))
     {
-        this->glDisable(GL_BLEND);
+        return;
+    }
+
+    // If the scaler is deferring scaling to us, the frame will be at its native
+    // resolution rather than at the output resolution.
+    const bool isDeferred = ks_is_deferred_scaling_enabled();
+    const resolution_s r = [isDeferred]()->resolution_s
+    {
+        const resolution_s bufferRes = ks_scaler_output_resolution();
 
-        this->glBindTexture(GL_TEXTURE_2D, FRAMEBUFFER_TEXTURE);
-        this->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, r.w, r.h, 0, GL_BGRA, GL_UNSIGNED_BYTE, fb);
+        if (!bufferRes.w || !bufferRes.h)
+        {
+            return ks_output_resolution();
+        }
 
-        glBegin(GL_TRIANGLES);
-            glTexCoord2i(0, 0); glVertex2i(0,             0);
-            glTexCoord2i(0, 1); glVertex2i(0,             this->height());
-            glTexCoord2i(1, 1); glVertex2i(this->width(), this->height());
+        return (isDeferred? bufferRes : ks_output_resolution());
+    }();
 
-            glTexCoord2i(1, 1); glVertex2i(this->width(), this->height());
-            glTexCoord2i(1, 0); glVertex2i(this->width(), 0);
-            glTexCoord2i(0, 0); glVertex2i(0,             0);
-        glEnd();
+    // Find a texture that's neither being presented nor holding the newest frame.
+    // With three textures, there's always at least one.
+    uint idx = 0;
+    while ((int(idx) == FRAME_TEXTURES.newestIdx) ||
+           (int(idx) == FRAME_TEXTURES.presentedIdx))
+    {
+        idx++;
+    }
+    k_assert(idx < NUM_FRAME_TEXTURES, "Found no free frame texture.");
+
+    this->makeCurrent();
+
+    if ((FRAME_TEXTURES.resolutions[idx].w != r.w) ||
+        (FRAME_TEXTURES.resolutions[idx].h != r.h))
+    {
+        this->allocate_frame_texture(idx, r);
+    }
+    else
+    {
+        this->glBindTexture(GL_TEXTURE_2D, FRAME_TEXTURES.textures[idx]);
+    }
+
+    this->upload_frame(fb, r);
+
+    this->doneCurrent();
+
+    FRAME_TEXTURES.isDeferred[idx] = isDeferred;
+    FRAME_TEXTURES.newestIdx = idx;
+
+    return;
+}
+
+// Draws the currently bound texture into the given rectangle of the window,
+// scaling it with the given filter of the output shader.
+//
+void OGLWidget::draw_texture(const QRect &rect, const resolution_s &textureRes, const int scalingFilter)
+{
+    OUTPUT_SHADER->setUniformValue("frame", 0);
+    OUTPUT_SHADER->setUniformValue("scalingFilter", scalingFilter);
+    OUTPUT_SHADER->setUniformValue("frameSize", QSizeF(textureRes.w, textureRes.h));
+    OUTPUT_SHADER->setUniformValue("outputSize", QSizeF(rect.width(), rect.height()));
+    OUTPUT_SHADER->setUniformValue("windowSize", QSizeF(this->width(), this->height()));
+    OUTPUT_SHADER->setUniformValue("targetRect", QVector4D(rect.left(), rect.top(), rect.width(), rect.height()));
+
+    QUAD_VAO->bind();
+    this->glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    QUAD_VAO->release();
+
+    return;
+}
+
+// Returns the rectangle of the window into which a deferred frame of the given
+// resolution should be scaled, given the scaler's aspect ratio and integer
+// scaling settings.
+//
+QRect OGLWidget::deferred_frame_rect(const resolution_s &frameRes)
+{
+    const resolution_s windowRes = {uint(this->width()), uint(this->height()), 32};
+    resolution_s targetRes = ks_padded_output_resolution(frameRes, windowRes);
+
+    if (ks_is_integer_scaling_enabled())
+    {
+        const uint multiplier = std::min((windowRes.w / frameRes.w), (windowRes.h / frameRes.h));
+
+        // If the frame is larger than the window, integer scaling isn't possible,
+        // so we'll just use the regular scaling.
+        if (multiplier >= 1)
+        {
+            targetRes.w = (frameRes.w * multiplier);
+            targetRes.h = (frameRes.h * multiplier);
+        }
+    }
+
+    return QRect(((windowRes.w - targetRes.w) / 2),
+                 ((windowRes.h - targetRes.h) / 2),
+                 targetRes.w,
+                 targetRes.h);
+}
+
+// Draws the frame in the given frame texture. If the frame was left unscaled by
+// the scaler, it'll be scaled into the window using the current up- or downscaling
+// filter; otherwise, it'll be stretched over the window as is.
+//
+void OGLWidget::draw_frame(const uint idx)
+{
+    const resolution_s &frameRes = FRAME_TEXTURES.resolutions[idx];
+
+    this->glBindTexture(GL_TEXTURE_2D, FRAME_TEXTURES.textures[idx]);
+
+    if (!FRAME_TEXTURES.isDeferred[idx])
+    {
+        this->draw_texture(this->rect(), frameRes, SHADER_SCALING_FILTERS.at("Nearest"));
+        return;
+    }
+
+    const QRect rect = this->deferred_frame_rect(frameRes);
+
+    const bool isUpscaling = ((rect.width() > int(frameRes.w)) || (rect.height() > int(frameRes.h)));
+    const std::string &filterName = (isUpscaling? ks_upscaling_filter_name() : ks_downscaling_filter_name());
+
+    const auto filter = SHADER_SCALING_FILTERS.find(filterName);
+
+    this->draw_texture(rect, frameRes, ((filter == SHADER_SCALING_FILTERS.end())? 0 : filter->second));
+
+    return;
+}
+
+void OGLWidget::paintGL()
+{
+    this->glClearColor(0, 0, 0, 1);
+    this->glClear(GL_COLOR_BUFFER_BIT);
+
+    // If initialization failed, we're about to be replaced by the software
+    // renderer.
+    if (!OUTPUT_SHADER)
+    {
+        return;
+    }
+
+    OUTPUT_SHADER->bind();
+    this->glActiveTexture(GL_TEXTURE0);
+
+    // Draw the newest complete frame.
+    if (FRAME_TEXTURES.newestIdx >= 0)
+    {
+        FRAME_TEXTURES.presentedIdx = FRAME_TEXTURES.newestIdx;
+
+        this->glDisable(GL_BLEND);
+        this->draw_frame(FRAME_TEXTURES.presentedIdx);
     }
 
     // Draw the overlay, if any.
@@ -103,20 +758,16 @@ void OGLWidget::paintGL()
         this->glEnable(GL_BLEND);
 
         this->glBindTexture(GL_TEXTURE_2D, OVERLAY_TEXTURE);
-        this->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image.width(), image.height(), 0, GL_BGRA, GL_UNSIGNED_BYTE, image.constBits());
-
-        glBegin(GL_TRIANGLES);
-            glTexCoord2i(0, 0); glVertex2i(0,             0);
-            glTexCoord2i(0, 1); glVertex2i(0,             this->height());
-            glTexCoord2i(1, 1); glVertex2i(this->width(), this->height());
+        this->upload_overlay(image);
 
-            glTexCoord2i(1, 1); glVertex2i(this->width(), this->height());
-            glTexCoord2i(1, 0); glVertex2i(this->width(), 0);
-            glTexCoord2i(0, 0); glVertex2i(0,             0);
-        glEnd();
+        // The overlay image is cropped to the overlay's contents, and is drawn
+        // unscaled at its position within the output frame.
+        this->draw_texture(QRect(image.offset(), image.size()),
+                           {uint(image.width()), uint(image.height()), 32},
+                           SHADER_SCALING_FILTERS.at("Nearest"));
     }
 
-    this->glFlush();
+    OUTPUT_SHADER->release();
 
     return;
 }
@@ -7,25 +7,59 @@
 #ifndef OGL_WIDGET_H
 #define OGL_WIDGET_H
 
-#include <QOpenGLFunctions_1_2>
+#include <QOpenGLFunctions>
 #include <QOpenGLWidget>
 #include <QWidget>
 #include <functional>
 #include "common/types.h"
 
 class OverlayDialog;
+struct resolution_s;
 
-class OGLWidget : public QOpenGLWidget, protected QOpenGLFunctions_1_2
+class OGLWidget : public QOpenGLWidget, protected QOpenGLFunctions
 {
     Q_OBJECT
 
 public:
     explicit OGLWidget(std::function<QImage()> overlay_as_qimage, QWidget *parent = 0);
+    ~OGLWidget();
+
+    void submit_frame(void);
+
+signals:
+    // Emitted if the OpenGL implementation can't run the renderer, e.g. because
+    // it's older than OpenGL 3.3. The widget should then be replaced by the
+    // software renderer.
+    void initialization_failed(void);
 
 protected:
     void initializeGL();
-    void resizeGL(int w, int h);
     void paintGL();
+
+private:
+    void resolve_streaming_functions(void);
+
+    bool create_output_shader(void);
+
+    void create_quad(void);
+
+    void set_texture_parameters(const GLuint texture);
+
+    void allocate_frame_texture(const uint idx, const resolution_s &r);
+
+    void allocate_frame_pbos(const resolution_s &r);
+
+    void release_frame_pbos(void);
+
+    void upload_frame(const u8 *const pixels, const resolution_s &r);
+
+    void upload_overlay(const QImage &image);
+
+    void draw_texture(const QRect &rect, const resolution_s &textureRes, const int scalingFilter);
+
+    QRect deferred_frame_rect(const resolution_s &frameRes);
+
+    void draw_frame(const uint idx);
 };
 
 #endif
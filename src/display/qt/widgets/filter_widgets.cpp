@@ -164,12 +164,14 @@ void filter_widget_input_gate_s::create_widget(void)
     {
         k_assert(this->parameterArray, "Expected non-null filter data.");
          *(u16*)&(this->parameterArray[OFFS_WIDTH]) = newValue;
+         kf_recompile_filter_chains();
     });
 
     connect(heightSpin, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), [this](const int newValue)
     {
         k_assert(this->parameterArray, "Expected non-null filter data.");
          *(u16*)&(this->parameterArray[OFFS_HEIGHT]) = newValue;
+         kf_recompile_filter_chains();
     });
 
     frame->adjustSize();
@@ -213,12 +215,14 @@ void filter_widget_output_gate_s::create_widget(void)
     {
         k_assert(this->parameterArray, "Expected non-null filter data.");
          *(u16*)&(this->parameterArray[OFFS_WIDTH]) = newValue;
+         kf_recompile_filter_chains();
     });
 
     connect(heightSpin, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), [this](const int newValue)
     {
         k_assert(this->parameterArray, "Expected non-null filter data.");
          *(u16*)&(this->parameterArray[OFFS_HEIGHT]) = newValue;
+         kf_recompile_filter_chains();
     });
 
     frame->adjustSize();
@@ -503,6 +507,72 @@ void filter_widget_denoise_nonlocal_means_s::create_widget(void)
     return;
 }
 
+void filter_widget_denoise_guided_s::reset_parameter_data(void)
+{
+    k_assert(this->parameterArray, "Expected non-null pointer to filter data.");
+
+    memset(this->parameterArray, 0, sizeof(u8) * FILTER_PARAMETER_ARRAY_LENGTH);
+
+    this->parameterArray[OFFS_RADIUS] = 4;
+    this->parameterArray[OFFS_STRENGTH] = 10;
+    this->parameterArray[OFFS_TYPE] = FILTER_TYPE_SPATIAL;
+
+    return;
+}
+
+void filter_widget_denoise_guided_s::create_widget(void)
+{
+    QFrame *frame = new QFrame();
+    frame->setMinimumWidth(this->minWidth);
+
+    // Denoising type.
+    QLabel *typeLabel = new QLabel("Type", frame);
+    QComboBox *typeList = new QComboBox(frame);
+    typeList->addItem("Spatial");
+    typeList->addItem("Spatio-temporal");
+    typeList->setCurrentIndex(this->parameterArray[OFFS_TYPE]);
+
+    // Denoising radius.
+    QLabel *radiusLabel = new QLabel("Radius", frame);
+    QSpinBox *radiusSpin = new QSpinBox(frame);
+    radiusSpin->setRange(1, 32);
+    radiusSpin->setValue(this->parameterArray[OFFS_RADIUS]);
+
+    // Denoising strength; roughly, the amount of variation that's taken to be noise.
+    QLabel *strengthLabel = new QLabel("Strength", frame);
+    QSpinBox *strengthSpin = new QSpinBox(frame);
+    strengthSpin->setRange(0, 100);
+    strengthSpin->setValue(this->parameterArray[OFFS_STRENGTH]);
+
+    QFormLayout *l = new QFormLayout(frame);
+    l->addRow(typeLabel, typeList);
+    l->addRow(radiusLabel, radiusSpin);
+    l->addRow(strengthLabel, strengthSpin);
+
+    connect(typeList, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged), [this](const int currentIdx)
+    {
+        k_assert(this->parameterArray, "Expected non-null filter data.");
+        this->parameterArray[OFFS_TYPE] = ((currentIdx == -1)? 0 : currentIdx);
+    });
+
+    connect(radiusSpin, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), [this](const int newValue)
+    {
+        k_assert(this->parameterArray, "Expected non-null filter data.");
+        this->parameterArray[OFFS_RADIUS] = newValue;
+    });
+
+    connect(strengthSpin, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), [this](const int newValue)
+    {
+        k_assert(this->parameterArray, "Expected non-null filter data.");
+        this->parameterArray[OFFS_STRENGTH] = newValue;
+    });
+
+    frame->adjustSize();
+    this->widget = frame;
+
+    return;
+}
+
 void filter_widget_sharpen_s::reset_parameter_data(void)
 {
     k_assert(this->parameterArray, "Expected non-null pointer to filter data.");
@@ -254,6 +254,29 @@ private:
 
 
 
+struct filter_widget_denoise_guided_s : public filter_widget_s
+{
+    enum data_offset_e { OFFS_RADIUS = 0, OFFS_STRENGTH = 1, OFFS_TYPE = 2 };
+    enum filter_type_e { FILTER_TYPE_SPATIAL = 0, FILTER_TYPE_TEMPORAL = 1 };
+
+    filter_widget_denoise_guided_s(u8 *const parameterArray, const u8 *const initialParameterValues) :
+        filter_widget_s(filter_type_enum_e::denoise_guided, parameterArray, initialParameterValues)
+    {
+        if (!initialParameterValues) this->reset_parameter_data();
+        create_widget();
+        return;
+    }
+
+    void reset_parameter_data(void) override;
+
+private:
+    Q_OBJECT
+
+    void create_widget(void) override;
+};
+
+
+
 struct filter_widget_sharpen_s : public filter_widget_s
 {
     filter_widget_sharpen_s(u8 *const parameterArray, const u8 *const initialParameterValues) :
@@ -16,6 +16,7 @@
 #include <QTextDocument>
 #include <QElapsedTimer>
 #include <QFontDatabase>
+#include <QFileDialog>
 #include <QInputDialog>
 #include <QVBoxLayout>
 #include <QTreeWidget>
@@ -25,6 +26,7 @@
 #include <QPainter>
 #include <QScreen>
 #include <QImage>
+#include <QDir>
 #include <QLabel>
 #include <cmath>
 #include "display/qt/subclasses/QOpenGLWidget_opengl_renderer.h"
@@ -41,6 +43,7 @@
 #include "display/qt/dialogs/alias_dialog.h"
 #include "display/qt/dialogs/about_dialog.h"
 #include "display/qt/persistent_settings.h"
+#include "display/qt/present_scheduler.h"
 #include "filter/anti_tear.h"
 #include "common/propagate/app_events.h"
 #include "capture/video_presets.h"
@@ -48,6 +51,9 @@
 #include "capture/capture.h"
 #include "capture/alias.h"
 #include "common/globals.h"
+#include "record/loopback_output.h"
+#include "record/shared_output.h"
+#include "record/frame_export.h"
 #include "record/record.h"
 #include "scaler/scaler.h"
 #include "ui_output_window.h"
@@ -85,6 +91,30 @@ MainWindow::MainWindow(QWidget *parent) :
 
     ui->menuBar->setVisible(false);
 
+    // Set up frame presentation.
+    {
+        this->presentScheduler = new present_scheduler_c([this]
+        {
+            if (OGL_SURFACE != nullptr)
+            {
+                OGL_SURFACE->update();
+            }
+            else this->update();
+        });
+
+        this->presentScheduler->setParent(this);
+
+        // Some platforms don't report a refresh rate, in which case the scheduler's
+        // default is used.
+        const double refreshRate = QGuiApplication::primaryScreen()->refreshRate();
+        if (refreshRate > 0)
+        {
+            this->presentScheduler->set_refresh_rate(refreshRate);
+        }
+
+        this->presentScheduler->set_vsync_driven(false);
+    }
+
     // Set up the child dialogs.
     {
         outputResolutionDlg = new OutputResolutionDialog;
@@ -162,6 +192,32 @@ MainWindow::MainWindow(QWidget *parent) :
                     this->set_opengl_enabled(false);
                 });
 
+                connect(this, &MainWindow::opengl_unavailable, this, [=]
+                {
+                    software->setChecked(true);
+                });
+
+                // Lets the OpenGL renderer scale the output frames in its shaders,
+                // so that the scaler only needs to hand over the native frame.
+                {
+                    rendererMenu->addSeparator();
+
+                    QAction *gpuScaling = new QAction("Scale on GPU", this);
+                    gpuScaling->setCheckable(true);
+                    gpuScaling->setEnabled(false);
+                    rendererMenu->addAction(gpuScaling);
+
+                    connect(opengl, &QAction::toggled, gpuScaling, &QAction::setEnabled);
+
+                    connect(gpuScaling, &QAction::toggled, this, [=](const bool checked)
+                    {
+                        this->gpuScalingEnabled = checked;
+                        ks_set_deferred_scaling_enabled(checked && (OGL_SURFACE != nullptr));
+                    });
+
+                    gpuScaling->setChecked(kpers_value_of(INI_GROUP_OUTPUT, "gpu_scaling", false).toBool());
+                }
+
                 if (kpers_value_of(INI_GROUP_OUTPUT, "renderer", "Software").toString() == "Software")
                 {
                     software->setChecked(true);
@@ -471,10 +527,38 @@ MainWindow::MainWindow(QWidget *parent) :
                 else if (defaultAspectRatio == "Traditional 4:3") traditional43->setChecked(true);
             }
 
+            QAction *integerScaling = new QAction("Integer scaling (GPU)", this);
+            {
+                integerScaling->setCheckable(true);
+
+                connect(integerScaling, &QAction::toggled, this, [=](const bool checked)
+                {
+                    ks_set_integer_scaling_enabled(checked);
+                });
+
+                integerScaling->setChecked(kpers_value_of(INI_GROUP_OUTPUT, "integer_scaling", false).toBool());
+            }
+
+            // Lets the capture device scale frames down to the output resolution
+            // when nothing needs them at their full resolution, if it can.
+            QAction *hardwareScaling = new QAction("Downscale in capture hardware", this);
+            {
+                hardwareScaling->setCheckable(true);
+
+                connect(hardwareScaling, &QAction::toggled, this, [=](const bool checked)
+                {
+                    ks_set_hardware_scaling_enabled(checked);
+                });
+
+                hardwareScaling->setChecked(kpers_value_of(INI_GROUP_OUTPUT, "hardware_scaling", false).toBool());
+            }
+
             menu->addMenu(aspectRatio);
+            menu->addAction(integerScaling);
             menu->addSeparator();
             menu->addMenu(upscaler);
             menu->addMenu(downscaler);
+            menu->addAction(hardwareScaling);
             menu->addSeparator();
 
             QAction *overlay = new QAction("Overlay...", this);
@@ -501,6 +585,175 @@ MainWindow::MainWindow(QWidget *parent) :
             record->setShortcut(QKeySequence("ctrl+r"));
             menu->addAction(record);
             connect(record, &QAction::triggered, this, [=]{this->open_record_dialog();});
+
+            QMenu *exportMenu = new QMenu("Export frames", this);
+            {
+                const auto export_frames = [=](const uint duration)
+                {
+                    frame_export_settings_s settings;
+                    settings.directory = kpers_value_of(INI_GROUP_OUTPUT, "export_directory", QDir::homePath()).toString().toStdString();
+                    settings.format = ((kpers_value_of(INI_GROUP_OUTPUT, "export_format", "PNG").toString() == "QOI")? frame_export_format_e::qoi
+                                                                                                                      : frame_export_format_e::png);
+                    settings.source = (kpers_value_of(INI_GROUP_OUTPUT, "export_raw_capture", false).toBool()? frame_export_source_e::raw_capture
+                                                                                                               : frame_export_source_e::scaler_output);
+                    settings.duration = duration;
+
+                    kexport_start_export(settings);
+                };
+
+                QAction *screenshot = new QAction("Save screenshot", this);
+                screenshot->setShortcut(QKeySequence("ctrl+p"));
+                exportMenu->addAction(screenshot);
+                connect(screenshot, &QAction::triggered, this, [=]{export_frames(0);});
+
+                QAction *burst = new QAction("Export every frame for 5 seconds", this);
+                exportMenu->addAction(burst);
+                connect(burst, &QAction::triggered, this, [=]{export_frames(5000);});
+
+                exportMenu->addSeparator();
+
+                QActionGroup *formatGroup = new QActionGroup(this);
+                for (const QString &formatName: {"PNG", "QOI"})
+                {
+                    QAction *format = new QAction(formatName, this);
+                    format->setActionGroup(formatGroup);
+                    format->setCheckable(true);
+                    format->setChecked(formatName == kpers_value_of(INI_GROUP_OUTPUT, "export_format", "PNG").toString());
+                    exportMenu->addAction(format);
+
+                    connect(format, &QAction::triggered, this, [=]
+                    {
+                        kpers_set_value(INI_GROUP_OUTPUT, "export_format", formatName);
+                    });
+                }
+
+                exportMenu->addSeparator();
+
+                QAction *rawCapture = new QAction("Export captured frames unscaled", this);
+                rawCapture->setCheckable(true);
+                rawCapture->setChecked(kpers_value_of(INI_GROUP_OUTPUT, "export_raw_capture", false).toBool());
+                exportMenu->addAction(rawCapture);
+                connect(rawCapture, &QAction::toggled, this, [=](const bool isChecked)
+                {
+                    kpers_set_value(INI_GROUP_OUTPUT, "export_raw_capture", isChecked);
+                });
+
+                QAction *directory = new QAction("Export directory...", this);
+                exportMenu->addAction(directory);
+                connect(directory, &QAction::triggered, this, [=]
+                {
+                    const QString dirName = QFileDialog::getExistingDirectory(this, "Select the directory to export frames into",
+                                                                              kpers_value_of(INI_GROUP_OUTPUT, "export_directory", QDir::homePath()).toString());
+                    if (!dirName.isEmpty())
+                    {
+                        kpers_set_value(INI_GROUP_OUTPUT, "export_directory", dirName);
+                    }
+                });
+            }
+            menu->addMenu(exportMenu);
+
+            QMenu *sharedOutputMenu = new QMenu("Shared memory output", this);
+            {
+                const auto persisted_source = []
+                {
+                    return (kpers_value_of(INI_GROUP_OUTPUT, "shared_memory_raw_capture", false).toBool()? shared_output_source_e::raw_capture
+                                                                                                         : shared_output_source_e::scaler_output);
+                };
+
+                QAction *enable = new QAction("Publish frames", this);
+                enable->setCheckable(true);
+                sharedOutputMenu->addAction(enable);
+                connect(enable, &QAction::toggled, this, [=](const bool isChecked)
+                {
+                    if (isChecked)
+                    {
+                        if (!kshm_start_output(persisted_source()))
+                        {
+                            enable->setChecked(false);
+                            return;
+                        }
+                    }
+                    else
+                    {
+                        kshm_stop_output();
+                    }
+
+                    kpers_set_value(INI_GROUP_OUTPUT, "shared_memory_output", isChecked);
+                });
+
+                QAction *rawCapture = new QAction("Publish captured frames unscaled", this);
+                rawCapture->setCheckable(true);
+                rawCapture->setChecked(persisted_source() == shared_output_source_e::raw_capture);
+                sharedOutputMenu->addAction(rawCapture);
+                connect(rawCapture, &QAction::toggled, this, [=](const bool isChecked)
+                {
+                    kpers_set_value(INI_GROUP_OUTPUT, "shared_memory_raw_capture", isChecked);
+                    kshm_set_output_source(persisted_source());
+                });
+
+                enable->setChecked(kpers_value_of(INI_GROUP_OUTPUT, "shared_memory_output", false).toBool());
+            }
+            menu->addMenu(sharedOutputMenu);
+
+            QMenu *loopbackMenu = new QMenu("Virtual camera output", this);
+            {
+                const auto persisted_device = []
+                {
+                    return kpers_value_of(INI_GROUP_OUTPUT, "loopback_device", "/dev/video10").toString();
+                };
+
+                QAction *enable = new QAction("Output into v4l2loopback", this);
+                enable->setCheckable(true);
+                loopbackMenu->addAction(enable);
+                connect(enable, &QAction::toggled, this, [=](const bool isChecked)
+                {
+                    if (isChecked)
+                    {
+                        if (!kloopback_start_output(persisted_device().toStdString()))
+                        {
+                            enable->setChecked(false);
+                            return;
+                        }
+                    }
+                    else
+                    {
+                        kloopback_stop_output();
+                    }
+
+                    kpers_set_value(INI_GROUP_OUTPUT, "loopback_output", isChecked);
+                });
+
+                QAction *device = new QAction("Device...", this);
+                loopbackMenu->addAction(device);
+                connect(device, &QAction::triggered, this, [=]
+                {
+                    bool isOk = false;
+                    const QString deviceName = QInputDialog::getText(this, "VCS - Virtual camera output",
+                                                                     "The v4l2loopback device to output into:",
+                                                                     QLineEdit::Normal, persisted_device(), &isOk);
+                    if (!isOk || deviceName.isEmpty())
+                    {
+                        return;
+                    }
+
+                    kpers_set_value(INI_GROUP_OUTPUT, "loopback_device", deviceName);
+
+                    // Restart the output into the new device.
+                    if (enable->isChecked() &&
+                        !kloopback_start_output(deviceName.toStdString()))
+                    {
+                        enable->setChecked(false);
+                    }
+                });
+
+                ke_events().loopback.outputFailed->subscribe([=]
+                {
+                    enable->setChecked(false);
+                });
+
+                enable->setChecked(kpers_value_of(INI_GROUP_OUTPUT, "loopback_output", false).toBool());
+            }
+            menu->addMenu(loopbackMenu);
         }
 
         // Help...
@@ -633,12 +886,6 @@ MainWindow::MainWindow(QWidget *parent) :
             if (!PROGRAM_EXIT_REQUESTED)
             {
                 this->update_window_title();
-
-                // The output resolution might have changed while we were recording, but
-                // since we also prevent the size of the output window from changing while
-                // recording, we should now - that recording has stopped - tell the window
-                // to update its size to match the current proper output size.
-                this->update_window_size();
             }
         });
     }
@@ -695,6 +942,9 @@ MainWindow::~MainWindow()
 
         kpers_set_value(INI_GROUP_OUTPUT, "aspect_mode", aspectMode);
         kpers_set_value(INI_GROUP_OUTPUT, "renderer", (OGL_SURFACE? "OpenGL" : "Software"));
+        kpers_set_value(INI_GROUP_OUTPUT, "gpu_scaling", this->gpuScalingEnabled);
+        kpers_set_value(INI_GROUP_OUTPUT, "integer_scaling", ks_is_integer_scaling_enabled());
+        kpers_set_value(INI_GROUP_OUTPUT, "hardware_scaling", ks_is_hardware_scaling_enabled());
         kpers_set_value(INI_GROUP_OUTPUT, "upscaler", QString::fromStdString(ks_upscaling_filter_name()));
         kpers_set_value(INI_GROUP_OUTPUT, "downscaler", QString::fromStdString(ks_downscaling_filter_name()));
     }
@@ -824,15 +1074,23 @@ void MainWindow::open_antitear_dialog(void)
 
 void MainWindow::redraw(void)
 {
+    // The OpenGL renderer uploads each frame as it arrives, so that the frame
+    // is ready to be drawn once presentation comes around.
     if (OGL_SURFACE != nullptr)
     {
-        OGL_SURFACE->repaint();
+        OGL_SURFACE->submit_frame();
     }
-    else this->repaint();
+
+    this->presentScheduler->frame_completed();
 
     return;
 }
 
+present_stats_s MainWindow::presentation_stats(void)
+{
+    return this->presentScheduler->stats();
+}
+
 void MainWindow::set_opengl_enabled(const bool enabled)
 {
     if (enabled)
@@ -845,15 +1103,22 @@ void MainWindow::set_opengl_enabled(const bool enabled)
         OGL_SURFACE->show();
         OGL_SURFACE->raise();
 
-        QSurfaceFormat format;
-        format.setDepthBufferSize(24);
-        format.setStencilBufferSize(8);
-        format.setVersion(1, 2);
-        format.setSwapInterval(0); // Vsync.
-        format.setSamples(0);
-        format.setProfile(QSurfaceFormat::CompatibilityProfile);
-        format.setRenderableType(QSurfaceFormat::OpenGL);
-        QSurfaceFormat::setDefaultFormat(format);
+        // The OpenGL surface swaps at vsync, so it paces presentation by itself.
+        connect(OGL_SURFACE, &QOpenGLWidget::frameSwapped, this, [this]
+        {
+            this->presentScheduler->frame_presented();
+        });
+
+        // The surface can't be deleted from within its own initialization, so
+        // fall back to the software renderer once that has returned.
+        connect(OGL_SURFACE, &OGLWidget::initialization_failed, this, [this]
+        {
+            if (OGL_SURFACE)
+            {
+                this->set_opengl_enabled(false);
+                emit this->opengl_unavailable();
+            }
+        }, Qt::QueuedConnection);
 
         ui->centralwidget->layout()->addWidget(OGL_SURFACE);
     }
@@ -866,6 +1131,11 @@ void MainWindow::set_opengl_enabled(const bool enabled)
         OGL_SURFACE = nullptr;
     }
 
+    // Only the OpenGL renderer knows how to scale frames by itself.
+    ks_set_deferred_scaling_enabled(enabled && this->gpuScalingEnabled);
+
+    this->presentScheduler->set_vsync_driven(enabled);
+
     return;
 }
 
@@ -1003,8 +1273,7 @@ void MainWindow::keyPressEvent(QKeyEvent *event)
 
 bool MainWindow::is_mouse_wheel_scaling_allowed(void)
 {
-    return (!kd_is_fullscreen() && // On my virtual machine, at least, wheel scaling while in full-screen messes up the full-screen mode.
-            !krecord_is_recording());
+    return !kd_is_fullscreen(); // On my virtual machine, at least, wheel scaling while in full-screen messes up the full-screen mode.
 }
 
 QImage MainWindow::overlay_image(void)
@@ -1049,9 +1318,11 @@ void MainWindow::paintEvent(QPaintEvent *)
     const QImage overlayImg = overlay_image();
     if (!overlayImg.isNull())
     {
-        painter.drawImage(0, 0, overlayImg);
+        painter.drawImage(overlayImg.offset(), overlayImg);
     }
 
+    this->presentScheduler->frame_presented();
+
     // Show a magnifying glass effect which blows up part of the captured image.
     static QLabel *magnifyingGlass = nullptr;
     if (!kc_capture_api().has_no_signal() &&
@@ -22,6 +22,7 @@ class RecordDialog;
 class SignalDialog;
 class AliasDialog;
 class AboutDialog;
+class present_scheduler_c;
 
 struct signal_info_s;
 struct mode_alias_s;
@@ -70,10 +71,15 @@ public:
 
     void set_opengl_enabled(const bool enabled);
 
+    // Tells the window that the scaler has a new output frame. The frame will be
+    // presented asynchronously, at the window's present scheduler's discretion.
     void redraw(void);
 
-    // Returns the current overlay as a QImage, or a null QImage if the overlay
-    // should not be shown at this time.
+    present_stats_s presentation_stats(void);
+
+    // Returns the current overlay as a QImage cropped to its contents, with the
+    // image's offset() giving its position over the output frame; or a null QImage
+    // if the overlay should not be shown at this time.
     QImage overlay_image(void);
 
     void update_recording_metainfo(void);
@@ -120,6 +126,10 @@ signals:
     void entered_fullscreen(void);
     void left_fullscreen(void);
 
+    // Emitted when the OpenGL renderer couldn't be initialized, and the
+    // software renderer has been switched to instead.
+    void opengl_unavailable(void);
+
     // Emitted when the window border is toggled.
     void border_hidden(void);
     void border_revealed(void);
@@ -164,6 +174,9 @@ private:
 
     mouse_activity_monitor_c mouseActivityMonitor;
 
+    // Decides when the output frames get presented on screen.
+    present_scheduler_c *presentScheduler = nullptr;
+
     // Set to true when the user has selected to close the
     // main window.
     bool userExiting = false;
@@ -171,6 +184,11 @@ private:
     // Set to true if the program failed to initialize the capture card.
     bool captureInitFail = false;
 
+    // Whether the user has asked for the OpenGL renderer to do the final scaling
+    // of output frames (in shaders) rather than the scaler. Has no effect with
+    // the software renderer.
+    bool gpuScalingEnabled = false;
+
     // A user-definable custom title for the output window.
     QString windowTitleOverride = "";
 
@@ -8,11 +8,16 @@
  */
 
 #include <unordered_map>
+#include <algorithm>
 #include <cstring>
+#include <chrono>
 #include <vector>
+#include <memory>
+#include <atomic>
 #include <cmath>
 #include <map>
 #include "display/qt/widgets/filter_widgets.h"
+#include "common/propagate/app_events.h"
 #include "display/display.h"
 #include "capture/capture.h"
 #include "common/globals.h"
@@ -30,21 +35,22 @@ static bool FILTERING_ENABLED = false;
 //
 static const std::unordered_map<std::string, const filter_c::filter_metadata_s> KNOWN_FILTER_TYPES =
 {
-    {"a5426f2e-b060-48a9-adf8-1646a2d3bd41", {"Blur",                filter_type_enum_e::blur,                   filter_func_blur                   }},
-    {"fc85a109-c57a-4317-994f-786652231773", {"Delta histogram",     filter_type_enum_e::delta_histogram,        filter_func_delta_histogram        }},
-    {"badb0129-f48c-4253-a66f-b0ec94e225a0", {"Frame rate estimate", filter_type_enum_e::unique_count,           filter_func_unique_count           }},
-    {"03847778-bb9c-4e8c-96d5-0c10335c4f34", {"Unsharp mask",        filter_type_enum_e::unsharp_mask,           filter_func_unsharp_mask           }},
-    {"eb586eb4-2d9d-41b4-9e32-5cbcf0bbbf03", {"Decimate",            filter_type_enum_e::decimate,               filter_func_decimate               }},
-    {"94adffac-be42-43ac-9839-9cc53a6d615c", {"Denoise (temporal)",  filter_type_enum_e::denoise_temporal,       filter_func_denoise_temporal       }},
-    {"e31d5ee3-f5df-4e7c-81b8-227fc39cbe76", {"Denoise (NL means)",  filter_type_enum_e::denoise_nonlocal_means, filter_func_denoise_nonlocal_means }},
-    {"1c25bbb1-dbf4-4a03-93a1-adf24b311070", {"Sharpen",             filter_type_enum_e::sharpen,                filter_func_sharpen                }},
-    {"de60017c-afe5-4e5e-99ca-aca5756da0e8", {"Median",              filter_type_enum_e::median,                 filter_func_median                 }},
-    {"2448cf4a-112d-4d70-9fc1-b3e9176b6684", {"Crop",                filter_type_enum_e::crop,                   filter_func_crop                   }},
-    {"80a3ac29-fcec-4ae0-ad9e-bbd8667cc680", {"Flip",                filter_type_enum_e::flip,                   filter_func_flip                   }},
-    {"140c514d-a4b0-4882-abc6-b4e9e1ff4451", {"Rotate",              filter_type_enum_e::rotate,                 filter_func_rotate                 }},
-
-    {"136deb34-ac79-46b1-a09c-d57dcfaa84ad", {"Input gate",          filter_type_enum_e::input_gate,             nullptr                            }},
-    {"be8443e2-4355-40fd-aded-63cebcbfb8ce", {"Output gate",         filter_type_enum_e::output_gate,            nullptr                            }},
+    {"a5426f2e-b060-48a9-adf8-1646a2d3bd41", {"Blur",                filter_type_enum_e::blur,                   filter_func_blur,                   nullptr                      }},
+    {"fc85a109-c57a-4317-994f-786652231773", {"Delta histogram",     filter_type_enum_e::delta_histogram,        filter_func_delta_histogram,        nullptr                      }},
+    {"badb0129-f48c-4253-a66f-b0ec94e225a0", {"Frame rate estimate", filter_type_enum_e::unique_count,           filter_func_unique_count,           nullptr                      }},
+    {"03847778-bb9c-4e8c-96d5-0c10335c4f34", {"Unsharp mask",        filter_type_enum_e::unsharp_mask,           filter_func_unsharp_mask,           nullptr                      }},
+    {"eb586eb4-2d9d-41b4-9e32-5cbcf0bbbf03", {"Decimate",            filter_type_enum_e::decimate,               filter_func_decimate,               nullptr                      }},
+    {"94adffac-be42-43ac-9839-9cc53a6d615c", {"Denoise (temporal)",  filter_type_enum_e::denoise_temporal,       filter_func_denoise_temporal,       filter_span_denoise_temporal }},
+    {"e31d5ee3-f5df-4e7c-81b8-227fc39cbe76", {"Denoise (NL means)",  filter_type_enum_e::denoise_nonlocal_means, filter_func_denoise_nonlocal_means, nullptr                      }},
+    {"5423a9e8-45f2-4d0f-9a8f-b1ba07cd6dfe", {"Denoise (guided)",    filter_type_enum_e::denoise_guided,         filter_func_denoise_guided,         nullptr                      }},
+    {"1c25bbb1-dbf4-4a03-93a1-adf24b311070", {"Sharpen",             filter_type_enum_e::sharpen,                filter_func_sharpen,                nullptr                      }},
+    {"de60017c-afe5-4e5e-99ca-aca5756da0e8", {"Median",              filter_type_enum_e::median,                 filter_func_median,                 nullptr                      }},
+    {"2448cf4a-112d-4d70-9fc1-b3e9176b6684", {"Crop",                filter_type_enum_e::crop,                   filter_func_crop,                   nullptr                      }},
+    {"80a3ac29-fcec-4ae0-ad9e-bbd8667cc680", {"Flip",                filter_type_enum_e::flip,                   filter_func_flip,                   nullptr                      }},
+    {"140c514d-a4b0-4882-abc6-b4e9e1ff4451", {"Rotate",              filter_type_enum_e::rotate,                 filter_func_rotate,                 nullptr                      }},
+
+    {"136deb34-ac79-46b1-a09c-d57dcfaa84ad", {"Input gate",          filter_type_enum_e::input_gate,             nullptr,                            nullptr                      }},
+    {"be8443e2-4355-40fd-aded-63cebcbfb8ce", {"Output gate",         filter_type_enum_e::output_gate,            nullptr,                            nullptr                      }},
 };
 
 // All filters the user has added to the filter graph.
@@ -55,10 +61,80 @@ static std::vector<filter_c*> FILTER_POOL;
 // frames.
 static std::vector<std::vector<const filter_c*>> FILTER_CHAINS;
 
+// A filter chain in the form in which it's applied to frames: the resolutions
+// of its gates decoded, and its filters reduced to the functions that apply
+// them and the parameters to call the functions with.
+struct compiled_filter_chain_s
+{
+    struct step_s
+    {
+        // A single filter.
+        filter_function_t apply;
+        const u8 *params;
+        filter_state_s *state;
+
+        // A run of filters fused into one step; if set, used instead of the above.
+        void (*applyFused)(u8 *const, const resolution_s *const, const std::vector<fused_filter_s>&);
+        std::vector<fused_filter_s> fusedFilters;
+
+        // The timing statistics of the step's filter(s), between which the
+        // step's time is shared.
+        std::vector<filter_timing_s*> timings;
+    };
+
+    unsigned inputGateWidth;
+    unsigned inputGateHeight;
+    unsigned outputGateWidth;
+    unsigned outputGateHeight;
+
+    std::vector<step_s> steps;
+
+    // If the chain begins with a crop, the crop's parameters; or null. The crop
+    // is then the chain's first step, and may be done instead by cropping the
+    // frame down to its region before it's filtered (see kf_filter_chain_roi()).
+    const u8 *headCropParams;
+
+    // Whether any of the chain's filters depend on the frame's resolution, e.g.
+    // by having a radius or coordinates in pixels; so that the frame mustn't be
+    // scaled before the chain is applied. Point-wise filters, flipping, and
+    // rotation about the frame's center work on frames of any size.
+    bool needsFullResolution;
+
+    // The timing statistics of the chain as a whole; those of its input gate.
+    filter_timing_s *timing;
+
+    // The chain's index in FILTER_CHAINS.
+    int idx;
+};
+
+// The chain, if any, to apply to frames of a given resolution when the output
+// resolution is of a given size.
+struct filter_plan_s
+{
+    // The compiled chains from which the chain was selected.
+    std::shared_ptr<const std::vector<compiled_filter_chain_s>> chains;
+
+    resolution_s inputRes;
+    resolution_s outputRes;
+
+    // Points into 'chains'; or null if no chain matches.
+    const compiled_filter_chain_s *chain;
+};
+
+// The compiled form of FILTER_CHAINS, and the plan most recently used for
+// filtering frames. Both are immutable once created, and are replaced - via
+// std::atomic_load() and std::atomic_store() - rather than modified, so that
+// frames can be filtered on another thread than the one modifying the chains.
+static std::shared_ptr<const std::vector<compiled_filter_chain_s>> COMPILED_CHAINS;
+static std::shared_ptr<const filter_plan_s> PLAN;
+
 // The index in the list of filter chains of the chain that was most recently used.
 // Generally, this will be the filter chain that matches the current input/output
 // resolution.
-static int MOST_RECENT_FILTER_CHAIN_IDX = -1;
+static std::atomic<int> MOST_RECENT_FILTER_CHAIN_IDX(-1);
+
+// How long each application of a filter chain has taken, whichever the chain.
+static filter_timing_s CHAIN_TIMING;
 
 std::string kf_filter_name_for_type(const filter_type_enum_e type)
 {
@@ -100,82 +176,322 @@ std::string kf_filter_id_for_type(const filter_type_enum_e type)
     return "(unknown)";
 }
 
-// Apply to the given pixel buffer the chain of filters (if any) whose input gate
-// matches the frame's resolution and output gate that of the current output resolution.
-void kf_apply_filter_chain(u8 *const pixels, const resolution_s &r)
+// How a filter can be fused with its neighbors in a filter chain.
+enum class filter_fusion_e
 {
-    if (!FILTERING_ENABLED) return;
+    none,
 
-    k_assert((r.bpp == 32), "Filters can only be applied to 32-bit pixel data.");
+    // Point-wise filters (see filter_c::filter_metadata_s::applyToSpan).
+    pointwise,
 
-    std::pair<const std::vector<const filter_c*>*, unsigned> partialMatch = {nullptr, 0};
-    std::pair<const std::vector<const filter_c*>*, unsigned> openMatch = {nullptr, 0};
-    const resolution_s outputRes = ks_output_resolution();
+    // Filters that only move pixels around: flipping, rotating, cropping.
+    remap,
+};
 
-    static const auto apply_chain = [=](const std::vector<const filter_c*> &chain, const unsigned idx)
+static filter_fusion_e fusion_of(const filter_c::filter_metadata_s &filterType)
+{
+    if (filterType.applyToSpan)
+    {
+        return filter_fusion_e::pointwise;
+    }
+
+    switch (filterType.type)
+    {
+        case filter_type_enum_e::flip:
+        case filter_type_enum_e::rotate:
+        case filter_type_enum_e::crop: return filter_fusion_e::remap;
+        default: return filter_fusion_e::none;
+    }
+}
+
+// Compiles the given filter chain, whose index in FILTER_CHAINS is given.
+//
+static compiled_filter_chain_s compile_filter_chain(const std::vector<const filter_c*> &chain, const int idx)
+{
+    compiled_filter_chain_s compiled;
+
+    compiled.inputGateWidth = *(u16*)&(chain.front()->parameterData[0]);
+    compiled.inputGateHeight = *(u16*)&(chain.front()->parameterData[2]);
+    compiled.outputGateWidth = *(u16*)&(chain.back()->parameterData[0]);
+    compiled.outputGateHeight = *(u16*)&(chain.back()->parameterData[2]);
+    compiled.timing = chain.front()->timing;
+    compiled.idx = idx;
+    compiled.headCropParams = nullptr;
+    compiled.needsFullResolution = false;
+
+    // Group the filters into runs that can be fused together: consecutive
+    // point-wise filters, which can share a single pass over the frame; and
+    // consecutive geometric filters, whose transformations can be combined where
+    // that doesn't change the result (see filter_func_fused_remap()). Any other
+    // filter is a run of its own.
+    std::vector<std::pair<filter_fusion_e, std::vector<const filter_c*>>> runs;
+
+    // The gate filters are expected to be #first and #last, while the actual
+    // applicable filters are the ones in-between.
+    for (unsigned c = 1; c < (chain.size() - 1); c++)
     {
-        // The gate filters are expected to be #first and #last, while the actual
-        // applicable filters are the ones in-between.
-        for (unsigned c = 1; c < (chain.size() - 1); c++)
+        const filter_fusion_e fusion = fusion_of(chain[c]->metaData);
+
+        if ((fusion != filter_fusion_e::pointwise) &&
+            (chain[c]->metaData.type != filter_type_enum_e::flip) &&
+            (chain[c]->metaData.type != filter_type_enum_e::rotate))
+        {
+            compiled.needsFullResolution = true;
+        }
+
+        // A crop at the head of the chain is kept out of any fused run, so that
+        // it can be skipped if the frame has already been cropped.
+        if ((c == 1) &&
+            (chain[c]->metaData.type == filter_type_enum_e::crop))
         {
-            chain[c]->metaData.apply(pixels, &r, chain[c]->parameterData.ptr());
+            compiled.headCropParams = chain[c]->parameterData.ptr();
+            runs.push_back({filter_fusion_e::none, {chain[c]}});
+            continue;
         }
 
-        MOST_RECENT_FILTER_CHAIN_IDX = idx;
+        if ((fusion == filter_fusion_e::none) ||
+            runs.empty() ||
+            (runs.back().first != fusion))
+        {
+            runs.push_back({fusion, {}});
+        }
 
-        return;
-    };
+        runs.back().second.push_back(chain[c]);
+    }
+
+    for (const auto &run: runs)
+    {
+        compiled_filter_chain_s::step_s step = {nullptr, nullptr, nullptr, nullptr, {}, {}};
+
+        if (run.second.size() == 1)
+        {
+            step.apply = run.second[0]->metaData.apply;
+            step.params = run.second[0]->parameterData.ptr();
+            step.state = run.second[0]->state;
+        }
+        else
+        {
+            step.applyFused = ((run.first == filter_fusion_e::pointwise)? filter_func_fused_pointwise : filter_func_fused_remap);
+
+            for (const filter_c *const filter: run.second)
+            {
+                step.fusedFilters.push_back({filter->metaData.type,
+                                             filter->metaData.applyToSpan,
+                                             filter->parameterData.ptr(),
+                                             filter->state});
+            }
+        }
+
+        for (const filter_c *const filter: run.second)
+        {
+            step.timings.push_back(filter->timing);
+        }
+
+        compiled.steps.push_back(step);
+    }
+
+    return compiled;
+}
+
+// Compiles FILTER_CHAINS, and publishes the result for kf_apply_filter_chain().
+//
+static void compile_filter_chains(void)
+{
+    auto compiledChains = std::make_shared<std::vector<compiled_filter_chain_s>>();
 
-    // Apply the first filter chain, if any, whose input and output resolution matches
-    // those of the frame and the current scaler. If no such chain is found, we'll secondarily
-    // apply a matching partially or fully open chain (a chain being open if its input or
-    // output node's resolution contains one or more 0 values).
     for (unsigned i = 0; i < FILTER_CHAINS.size(); i++)
     {
-        const auto &filterChain = FILTER_CHAINS[i];
+        compiledChains->push_back(compile_filter_chain(FILTER_CHAINS[i], i));
+    }
+
+    std::atomic_store(&COMPILED_CHAINS, std::shared_ptr<const std::vector<compiled_filter_chain_s>>(compiledChains));
+
+    return;
+}
+
+// Selects from the given compiled chains the one to apply to frames of the
+// given input resolution when the output resolution is as given.
+//
+static std::shared_ptr<const filter_plan_s> create_filter_plan(const std::shared_ptr<const std::vector<compiled_filter_chain_s>> &chains,
+                                                               const resolution_s &r,
+                                                               const resolution_s &outputRes)
+{
+    auto plan = std::make_shared<filter_plan_s>();
+    plan->chains = chains;
+    plan->inputRes = r;
+    plan->outputRes = outputRes;
+    plan->chain = nullptr;
 
-        const unsigned inputGateWidth = *(u16*)&(filterChain.front()->parameterData[0]);
-        const unsigned inputGateHeight = *(u16*)&(filterChain.front()->parameterData[2]);
+    if (!chains)
+    {
+        return plan;
+    }
 
-        const unsigned outputGateWidth = *(u16*)&(filterChain.back()->parameterData[0]);
-        const unsigned outputGateHeight = *(u16*)&(filterChain.back()->parameterData[2]);
+    const compiled_filter_chain_s *partialMatch = nullptr;
+    const compiled_filter_chain_s *openMatch = nullptr;
 
+    // Select the first filter chain, if any, whose input and output resolution matches
+    // those of the frame and the current scaler. If no such chain is found, we'll secondarily
+    // select a matching partially or fully open chain (a chain being open if its input or
+    // output node's resolution contains one or more 0 values).
+    for (const compiled_filter_chain_s &chain: *chains)
+    {
         // A gate size of 0 in either dimension means pass all values. Otherwise, the
         // value must match the corresponding size of the frame or output.
-        if (!inputGateWidth &&
-            !inputGateHeight &&
-            !outputGateWidth &&
-            !outputGateHeight)
+        if (!chain.inputGateWidth &&
+            !chain.inputGateHeight &&
+            !chain.outputGateWidth &&
+            !chain.outputGateHeight)
         {
-            openMatch = {&filterChain, i};
+            openMatch = &chain;
         }
-        else if ((!inputGateWidth || inputGateWidth == r.w) &&
-                 (!inputGateHeight || inputGateHeight == r.h) &&
-                 (!outputGateWidth || outputGateWidth == outputRes.w) &&
-                 (!outputGateHeight || outputGateHeight == outputRes.h))
+        else if ((!chain.inputGateWidth || chain.inputGateWidth == r.w) &&
+                 (!chain.inputGateHeight || chain.inputGateHeight == r.h) &&
+                 (!chain.outputGateWidth || chain.outputGateWidth == outputRes.w) &&
+                 (!chain.outputGateHeight || chain.outputGateHeight == outputRes.h))
         {
-            partialMatch = {&filterChain, i};
+            partialMatch = &chain;
         }
-        else if ((r.w == inputGateWidth) &&
-                 (r.h == inputGateHeight) &&
-                 (outputRes.w == outputGateWidth) &&
-                 (outputRes.h == outputGateHeight))
+        else if ((r.w == chain.inputGateWidth) &&
+                 (r.h == chain.inputGateHeight) &&
+                 (outputRes.w == chain.outputGateWidth) &&
+                 (outputRes.h == chain.outputGateHeight))
         {
-            apply_chain(filterChain, i);
+            plan->chain = &chain;
 
-            return;
+            return plan;
         }
     }
 
-    if (partialMatch.first)
+    plan->chain = (partialMatch? partialMatch : openMatch);
+
+    return plan;
+}
+
+// Returns the plan for filtering frames of the given resolution at the current
+// output resolution; creating the plan anew if the chains or either resolution
+// has changed since the previous one.
+//
+static std::shared_ptr<const filter_plan_s> current_filter_plan(const resolution_s &r)
+{
+    const resolution_s outputRes = ks_output_resolution();
+    const auto chains = std::atomic_load(&COMPILED_CHAINS);
+    std::shared_ptr<const filter_plan_s> plan = std::atomic_load(&PLAN);
+
+    if (!plan ||
+        (plan->chains != chains) ||
+        (plan->inputRes.w != r.w) ||
+        (plan->inputRes.h != r.h) ||
+        (plan->outputRes.w != outputRes.w) ||
+        (plan->outputRes.h != outputRes.h))
+    {
+        plan = create_filter_plan(chains, r, outputRes);
+        std::atomic_store(&PLAN, plan);
+    }
+
+    return plan;
+}
+
+frame_region_s kf_filter_chain_roi(const resolution_s &r)
+{
+    const frame_region_s entireFrame = {0, 0, 0, 0};
+
+    if (!FILTERING_ENABLED) return entireFrame;
+
+    const std::shared_ptr<const filter_plan_s> plan = current_filter_plan(r);
+
+    if (!plan->chain ||
+        !plan->chain->headCropParams)
     {
-        apply_chain(*partialMatch.first, partialMatch.second);
+        return entireFrame;
     }
-    else if (openMatch.first)
+
+    const u8 *const params = plan->chain->headCropParams;
+    const frame_region_s roi = {*(u16*)&(params[filter_widget_crop_s::OFFS_X]),
+                                *(u16*)&(params[filter_widget_crop_s::OFFS_Y]),
+                                *(u16*)&(params[filter_widget_crop_s::OFFS_WIDTH]),
+                                *(u16*)&(params[filter_widget_crop_s::OFFS_HEIGHT])};
+
+    // A crop that only blacks out the frame around its region (scaler 2) keeps
+    // the frame's size, so the frame can't be shrunk to the region for it. The
+    // crop filter ignores invalid regions, and so shall we.
+    if ((params[filter_widget_crop_s::OFFS_SCALER] == 2) ||
+        !roi.w ||
+        !roi.h ||
+        ((roi.x + roi.w) > r.w) ||
+        ((roi.y + roi.h) > r.h) ||
+        ((roi.w == r.w) && (roi.h == r.h)))
     {
-        apply_chain(*openMatch.first, openMatch.second);
+        return entireFrame;
     }
 
+    return roi;
+}
+
+bool kf_filter_chain_needs_full_resolution(const resolution_s &r)
+{
+    if (!FILTERING_ENABLED) return false;
+
+    const std::shared_ptr<const filter_plan_s> plan = current_filter_plan(r);
+
+    return (plan->chain && plan->chain->needsFullResolution);
+}
+
+// Apply to the given pixel buffer the chain of filters (if any) whose input gate
+// matches the frame's resolution and output gate that of the current output resolution.
+void kf_apply_filter_chain(u8 *const pixels,
+                           const resolution_s &r,
+                           const resolution_s *const uncroppedRes,
+                           const bool isCroppedToRoi)
+{
+    if (!FILTERING_ENABLED) return;
+
+    k_assert((r.bpp == 32), "Filters can only be applied to 32-bit pixel data.");
+
+    const std::shared_ptr<const filter_plan_s> plan = current_filter_plan(uncroppedRes? *uncroppedRes : r);
+
+    if (!plan->chain)
+    {
+        return;
+    }
+
+    // If the frame has been cropped to the chain's region of interest, the
+    // chain's head crop has been done already.
+    const unsigned firstStep = ((isCroppedToRoi && plan->chain->headCropParams)? 1 : 0);
+
+    const auto chainStartTime = std::chrono::steady_clock::now();
+    auto stepStartTime = chainStartTime;
+
+    for (unsigned i = firstStep; i < plan->chain->steps.size(); i++)
+    {
+        const auto &step = plan->chain->steps[i];
+
+        if (step.applyFused)
+        {
+            step.applyFused(pixels, &r, step.fusedFilters);
+        }
+        else
+        {
+            step.apply(pixels, &r, step.params, step.state);
+        }
+
+        const auto stepEndTime = std::chrono::steady_clock::now();
+        const i64 stepNs = std::chrono::duration_cast<std::chrono::nanoseconds>(stepEndTime - stepStartTime).count();
+
+        for (filter_timing_s *const timing: step.timings)
+        {
+            timing->add_sample(stepNs / i64(step.timings.size()));
+        }
+
+        stepStartTime = stepEndTime;
+    }
+
+    const i64 chainNs = std::chrono::duration_cast<std::chrono::nanoseconds>(stepStartTime - chainStartTime).count();
+    plan->chain->timing->add_sample(chainNs);
+    CHAIN_TIMING.add_sample(chainNs);
+
+    MOST_RECENT_FILTER_CHAIN_IDX = plan->chain->idx;
+
     return;
 }
 
@@ -199,6 +515,14 @@ void kf_add_filter_chain(std::vector<const filter_c*> newChain)
              "Detected a malformed filter chain.");
 
     FILTER_CHAINS.push_back(newChain);
+    compile_filter_chains();
+
+    return;
+}
+
+void kf_recompile_filter_chains(void)
+{
+    compile_filter_chains();
 
     return;
 }
@@ -206,6 +530,7 @@ void kf_add_filter_chain(std::vector<const filter_c*> newChain)
 void kf_remove_all_filter_chains(void)
 {
     FILTER_CHAINS.clear();
+    compile_filter_chains();
     MOST_RECENT_FILTER_CHAIN_IDX = -1;
 
     return;
@@ -271,6 +596,9 @@ void kf_release_filters(void)
 {
     DEBUG(("Releasing custom filtering."));
 
+    FILTER_CHAINS.clear();
+    std::atomic_store(&COMPILED_CHAINS, std::shared_ptr<const std::vector<compiled_filter_chain_s>>());
+    std::atomic_store(&PLAN, std::shared_ptr<const filter_plan_s>());
     MOST_RECENT_FILTER_CHAIN_IDX = -1;
 
     for (auto filter: FILTER_POOL)
@@ -376,16 +704,128 @@ int kf_current_filter_chain_idx(void)
     return MOST_RECENT_FILTER_CHAIN_IDX;
 }
 
+const filter_timing_s& kf_filter_chain_timing(void)
+{
+    return CHAIN_TIMING;
+}
+
+const filter_c* kf_slowest_filter(void)
+{
+    const int chainIdx = MOST_RECENT_FILTER_CHAIN_IDX;
+
+    if ((chainIdx < 0) ||
+        (unsigned(chainIdx) >= FILTER_CHAINS.size()) ||
+        !FILTER_CHAINS[chainIdx].front()->timing->is_current())
+    {
+        return nullptr;
+    }
+
+    const filter_c *slowest = nullptr;
+    const auto &chain = FILTER_CHAINS[chainIdx];
+
+    // The gate filters are expected to be #first and #last, while the actual
+    // applicable filters are the ones in-between.
+    for (unsigned c = 1; c < (chain.size() - 1); c++)
+    {
+        if (!slowest ||
+            (chain[c]->timing->average_ms() > slowest->timing->average_ms()))
+        {
+            slowest = chain[c];
+        }
+    }
+
+    return slowest;
+}
+
+void filter_timing_s::add_sample(const i64 nanoseconds)
+{
+    const u64 idx = this->numSamples.load(std::memory_order_relaxed);
+
+    this->samples[idx % NUM_SAMPLES].store(u32(std::max(i64(0), std::min(i64(UINT32_MAX), nanoseconds))), std::memory_order_relaxed);
+    this->latestSampleTime.store(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(), std::memory_order_relaxed);
+    this->numSamples.store((idx + 1), std::memory_order_release);
+
+    return;
+}
+
+unsigned filter_timing_s::copy_samples(u32 *const dst) const
+{
+    const unsigned count = unsigned(std::min(u64(NUM_SAMPLES), this->numSamples.load(std::memory_order_acquire)));
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        dst[i] = this->samples[i].load(std::memory_order_relaxed);
+    }
+
+    return count;
+}
+
+double filter_timing_s::average_ms(void) const
+{
+    u32 samples[NUM_SAMPLES];
+    const unsigned count = this->copy_samples(samples);
+
+    if (!count)
+    {
+        return 0;
+    }
+
+    u64 sum = 0;
+    for (unsigned i = 0; i < count; i++)
+    {
+        sum += samples[i];
+    }
+
+    return ((sum / double(count)) / 1000000.0);
+}
+
+double filter_timing_s::p99_ms(void) const
+{
+    u32 samples[NUM_SAMPLES];
+    const unsigned count = this->copy_samples(samples);
+
+    if (!count)
+    {
+        return 0;
+    }
+
+    u32 *const p99 = (samples + unsigned(std::ceil(count * 0.99) - 1));
+    std::nth_element(samples, p99, (samples + count));
+
+    return (*p99 / 1000000.0);
+}
+
+bool filter_timing_s::is_current(void) const
+{
+    const i64 now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    return (this->numSamples.load(std::memory_order_acquire) &&
+            ((now - this->latestSampleTime.load(std::memory_order_relaxed)) < 1000000000));
+}
+
 void kf_initialize_filters(void)
 {
     DEBUG(("Initializing custom filtering."));
 
+    // Frames of the new video mode are likely of a different size, so the
+    // filters' buffers would need to be reallocated anyway; and the filters
+    // that won't be applied in the new mode needn't hold on to theirs.
+    ke_events().capture.newVideoMode->subscribe([]
+    {
+        for (auto filter: FILTER_POOL)
+        {
+            filter->state->release();
+        }
+    });
+
     return;
 }
 
 filter_c::filter_c(const std::string &id, const u8 *initialParameterValues) :
     metaData(KNOWN_FILTER_TYPES.at(id)),
     parameterData(heap_bytes_s<u8>(FILTER_PARAMETER_ARRAY_LENGTH, "Filter parameter data")),
+    state(new filter_state_s),
+    timing(new filter_timing_s),
     guiWidget(create_gui_widget(initialParameterValues))
 {
     return;
@@ -394,6 +834,8 @@ filter_c::filter_c(const std::string &id, const u8 *initialParameterValues) :
 filter_c::~filter_c()
 {
     delete this->guiWidget;
+    delete this->state;
+    delete this->timing;
     this->parameterData.release_memory();
 
     return;
@@ -414,6 +856,7 @@ filter_widget_s *filter_c::create_gui_widget(const u8 *const initialParameterVal
         case filter_type_enum_e::median:                 return new filter_widget_median_s(arguments);
         case filter_type_enum_e::denoise_temporal:       return new filter_widget_denoise_temporal_s(arguments);
         case filter_type_enum_e::denoise_nonlocal_means: return new filter_widget_denoise_nonlocal_means_s(arguments);
+        case filter_type_enum_e::denoise_guided:         return new filter_widget_denoise_guided_s(arguments);
         case filter_type_enum_e::sharpen:                return new filter_widget_sharpen_s(arguments);
         case filter_type_enum_e::unsharp_mask:           return new filter_widget_unsharp_mask_s(arguments);
         case filter_type_enum_e::decimate:               return new filter_widget_decimate_s(arguments);
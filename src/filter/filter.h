@@ -70,7 +70,7 @@
 #ifndef FILTER_H_
 #define FILTER_H_
 
-#include <functional>
+#include <atomic>
 #include "common/memory/memory_interface.h"
 #include "display/display.h"
 #include "common/globals.h"
@@ -105,6 +105,7 @@ enum class filter_type_enum_e
     decimate,
     denoise_temporal,
     denoise_nonlocal_means,
+    denoise_guided,
     sharpen,
     median,
     crop,
@@ -120,10 +121,64 @@ enum class filter_type_enum_e
     output_gate,
 };
 
+/*!
+ * @brief
+ * Rolling statistics of how long a filter instance - or, for an input gate,
+ * its whole filter chain - has taken to process each of the most recent
+ * frames it was applied to.
+ *
+ * The statistics are updated by kf_apply_filter_chain() and can be read from
+ * any thread while frames are being filtered.
+ */
+struct filter_timing_s
+{
+    /*!
+     * Adds to the statistics a frame that took @p nanoseconds to process.
+     */
+    void add_sample(const i64 nanoseconds);
+
+    /*!
+     * Returns the average time, in milliseconds, taken to process a frame over
+     * the most recent frames; or 0 if there are none.
+     */
+    double average_ms(void) const;
+
+    /*!
+     * Returns the 99th percentile of the time, in milliseconds, taken to
+     * process a frame over the most recent frames; or 0 if there are none.
+     */
+    double p99_ms(void) const;
+
+    /*!
+     * Returns true if a frame has been processed within the past second; false
+     * otherwise, e.g. if the filter's chain doesn't match the current video
+     * mode, in which case the statistics are out of date.
+     */
+    bool is_current(void) const;
+
+private:
+    // The number of most recent frames over which the statistics are taken.
+    static const unsigned NUM_SAMPLES = 256;
+
+    // A ring buffer of the time, in nanoseconds, taken to process each of the
+    // most recent frames.
+    std::atomic<u32> samples[NUM_SAMPLES];
+
+    std::atomic<u64> numSamples{0};
+
+    // When the most recent frame was processed, in nanoseconds of
+    // std::chrono::steady_clock.
+    std::atomic<i64> latestSampleTime{0};
+
+    // Copies into the given array the samples currently in the ring buffer,
+    // returning their count.
+    unsigned copy_samples(u32 *const dst) const;
+};
+
 /*!
  * @brief
  * An image filter.
- * 
+ *
  * Applies a pre-set effect (e.g blurring, sharpening, or the like) onto the
  * pixels of an image.
  */
@@ -162,7 +217,15 @@ public:
          * This function is allowed only to alter the image's pixel values, not
          * e.g. its size.
          */
-        std::function<void(FILTER_FUNC_PARAMS)> apply;
+        filter_function_t apply;
+
+        /*!
+         * For point-wise filters, a function that applies the filter to a
+         * span of an image's pixels, allowing the filter to be fused with
+         * adjacent point-wise filters into a single pass over the image; or
+         * @a nullptr for other filters.
+         */
+        filter_span_function_t applyToSpan;
     };
 
     /*!
@@ -181,6 +244,27 @@ public:
      */
     heap_bytes_s<u8> parameterData;
 
+    /*!
+     * The data that this filter instance keeps between frames, e.g. the
+     * previous frame for a temporal filter, and its scratch buffers. Passed
+     * to the filter function along with @ref parameterData.
+     * 
+     * The state's buffers are allocated on first use, sized for the frame, and
+     * are released when the capture's video mode changes or the filter
+     * instance is deleted.
+     */
+    filter_state_s *const state;
+
+    /*!
+     * How long this filter instance has taken to apply to frames. For an
+     * input gate, the time taken to apply its whole filter chain.
+     *
+     * When filters have been fused together into a single pass over the frame
+     * (see filter_c::filter_metadata_s::applyToSpan), the time of the pass is
+     * shared evenly between them.
+     */
+    filter_timing_s *const timing;
+
     /*!
      * The filter's GUI widget, which provides the end-user with controls
      * for adjusting the filter's parameters.
@@ -228,6 +312,21 @@ void kf_release_filters(void);
  */
 void kf_add_filter_chain(std::vector<const filter_c*> newChain);
 
+/*!
+ * Asks the filter subsystem to recompile its filter chains, e.g. after the
+ * resolution of one of the chains' input or output gates has changed.
+ * 
+ * The filter subsystem doesn't apply filter chains as such but rather a
+ * compiled form of them, in which the gates' resolutions have been decoded and
+ * the filters reduced to the functions that apply them. The chains are
+ * compiled when added via kf_add_filter_chain(); changes to their gates made
+ * afterwards take effect only once this function has been called.
+ * 
+ * @see
+ * kf_add_filter_chain()
+ */
+void kf_recompile_filter_chains(void);
+
 /*!
  * Asks the filter subsystem to clear its list of known filter chains. This
  * will effectively disable filtering until new filter chains are added.
@@ -282,10 +381,77 @@ filter_type_enum_e kf_filter_type_for_id(const std::string id);
  * 
  * If no matching filter chain is found, no filter will be applied.
  * 
+ * The matching chain is looked up only when the frame's resolution or the
+ * output resolution differs from that of the previous call, or the filter
+ * chains have changed. The filter chains can be changed from another thread
+ * while this function is executing.
+ * 
+ * If the image has been cropped or scaled down, @p uncroppedRes gives the
+ * resolution of the image before that, and the chain is matched against that
+ * resolution rather than @p r. If the image has been cropped down to exactly
+ * the region returned by kf_filter_chain_roi(), @p isCroppedToRoi should be
+ * true, and the crop at the head of the chain, having thus been done already,
+ * is skipped; otherwise, the chain is applied in full.
+ * 
  * @see
- * kf_add_filter_chain()
+ * kf_add_filter_chain(), kf_filter_chain_roi()
+ */
+void kf_apply_filter_chain(u8 *const pixels,
+                           const resolution_s &r,
+                           const resolution_s *const uncroppedRes = nullptr,
+                           const bool isCroppedToRoi = false);
+
+/*!
+ * Returns the region of interest of the filter chain that kf_apply_filter_chain()
+ * would apply to an image of resolution @p r; or an empty region if the chain
+ * has none.
+ * 
+ * A chain's region of interest is that of a crop at the head of the chain
+ * which stretches the cropped region to fill the frame. None of the chain's
+ * later filters see the pixels outside of the region, so the image can be
+ * cropped down to the region before the chain is applied, and passed on to
+ * the scaler at the region's size rather than being stretched back to its
+ * original size. Cropping the image beforehand - possibly already in the
+ * capture device (see capture_api_s::set_hardware_roi()) - means that the
+ * pipeline's every stage from then on works on fewer pixels.
+ */
+frame_region_s kf_filter_chain_roi(const resolution_s &r);
+
+/*!
+ * Returns true if the filter chain that kf_apply_filter_chain() would apply to
+ * an image of resolution @p r has filters whose effect depends on the image's
+ * resolution - e.g. a blur, whose radius is in pixels - so that the image
+ * should be passed to the chain at its full resolution; false otherwise.
+ * 
+ * If this returns false, the image can be scaled down to the output resolution
+ * before the chain is applied; e.g. by the capture device, see
+ * capture_api_s::set_hardware_scaling(). The chain is still matched against
+ * @p r, by passing @p r as kf_apply_filter_chain()'s @a uncroppedRes.
+ */
+bool kf_filter_chain_needs_full_resolution(const resolution_s &r);
+
+/*!
+ * Returns how long kf_apply_filter_chain() has taken per frame to apply a
+ * filter chain, whichever chain it was.
+ *
+ * The time taken by a particular filter, or by a particular chain, is given by
+ * the @ref filter_c::timing of the filter or of the chain's input gate.
+ */
+const filter_timing_s& kf_filter_chain_timing(void);
+
+/*!
+ * Returns the filter that has on average taken the longest time per frame in
+ * the filter chain most recently applied by kf_apply_filter_chain(); or
+ * @a nullptr if no chain is currently being applied or the chain has no
+ * filters.
+ *
+ * This function should be called from the thread that modifies the filter
+ * chains.
+ *
+ * @see
+ * kf_filter_chain_timing()
  */
-void kf_apply_filter_chain(u8 *const pixels, const resolution_s &r);
+const filter_c* kf_slowest_filter(void);
 
 /*!
  * Returns a list of the filter types that're available in the filter
@@ -5,11 +5,26 @@
  *
  */
 
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <deque>
+#include <mutex>
+#include <cmath>
 #include <ctime>
 #include "common/globals.h"
 #include "display/qt/widgets/filter_widgets.h"
 #include "filter/filter_funcs.h"
 
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
 #ifdef USE_OPENCV
     #include <opencv2/imgproc/imgproc.hpp>
     #include <opencv2/photo/photo.hpp>
@@ -22,8 +37,266 @@ static const unsigned NUM_COLOR_CHANNELS = (32 / 8);
 // Invoke this macro at the start of each filter_func_*() function, to verify
 // that the parameters passed are valid to operate on.
 #define VALIDATE_FILTER_INPUT  k_assert(r->bpp == 32, "This filter expects 32-bit source color.");\
-                               if (pixels == nullptr || params == nullptr || r == nullptr) return;
+                               if (pixels == nullptr || params == nullptr || r == nullptr || state == nullptr) return;
+
+
+// Returns the number of bands into which a dimension of the given length is to
+// be split for processing in parallel, each band being at least the given length.
+//
+static uint num_parallel_bands(const uint length, const uint minBandLength)
+{
+    const uint numCores = std::max(1u, std::thread::hardware_concurrency());
+
+    return std::max(1u, std::min(numCores, (length / minBandLength)));
+}
+
+// Worker threads onto which process_in_parallel_bands() hands out its bands.
+// They're started on first use and kept until the program exits, rather than
+// created anew for every frame.
+static struct band_workers_s
+{
+    ~band_workers_s(void)
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->stop = true;
+        }
+
+        this->bandAvailable.notify_all();
+
+        for (auto &thread: this->threads)
+        {
+            thread.join();
+        }
+    }
+
+    // Calls the given function for each of the given number of bands, with the
+    // band's index; for band 0 on the calling thread, and for the others on the
+    // worker threads, in parallel. Returns once all of the bands are done.
+    void run(const uint numBands, const std::function<void(const uint bandIdx)> &process)
+    {
+        // Guarded by the mutex.
+        uint numBandsLeft = numBands;
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+
+            // One thread per core, counting the calling thread.
+            if (this->threads.empty())
+            {
+                for (uint i = 1; i < std::max(1u, std::thread::hardware_concurrency()); i++)
+                {
+                    this->threads.emplace_back([this]{ this->work(); });
+                }
+            }
+
+            for (uint i = 1; i < numBands; i++)
+            {
+                this->bands.push_back({&process, i, &numBandsLeft});
+            }
+        }
+
+        this->bandAvailable.notify_all();
+
+        process(0);
+
+        std::unique_lock<std::mutex> lock(this->mutex);
+
+        numBandsLeft--;
+
+        // Rather than just wait for the workers, help them with any bands still
+        // waiting - whether ours, or another caller's.
+        while (numBandsLeft)
+        {
+            if (!this->bands.empty())
+            {
+                this->process_next_band(lock);
+            }
+            else
+            {
+                this->bandDone.wait(lock);
+            }
+        }
+    }
+
+private:
+    struct band_s
+    {
+        const std::function<void(const uint bandIdx)> *process;
+        uint bandIdx;
+        uint *numBandsLeft;
+    };
+
+    // Takes the next band off the queue and processes it, unlocking the given
+    // lock (on the mutex) meanwhile.
+    void process_next_band(std::unique_lock<std::mutex> &lock)
+    {
+        const band_s band = this->bands.front();
+        this->bands.pop_front();
+
+        lock.unlock();
+        (*band.process)(band.bandIdx);
+        lock.lock();
+
+        if (!--(*band.numBandsLeft))
+        {
+            this->bandDone.notify_all();
+        }
+    }
+
+    void work(void)
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+
+        while (true)
+        {
+            this->bandAvailable.wait(lock, [this]{ return (this->stop || !this->bands.empty()); });
+
+            if (this->stop)
+            {
+                break;
+            }
+
+            this->process_next_band(lock);
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable bandAvailable;
+    std::condition_variable bandDone;
+    std::deque<band_s> bands;
+    std::vector<std::thread> threads;
+    bool stop = false;
+} BAND_WORKERS;
+
+// Splits a dimension of the given length into bands (see num_parallel_bands()),
+// and calls the given function for each band, in parallel with the other bands
+// (see band_workers_s). Returns once all of the bands are done.
+//
+static void process_in_parallel_bands(const uint length,
+                                      const uint minBandLength,
+                                      const std::function<void(const uint first, const uint end, const uint bandIdx)> &process)
+{
+    const uint numBands = num_parallel_bands(length, minBandLength);
 
+    if (numBands == 1)
+    {
+        process(0, length, 0);
+        return;
+    }
+
+    BAND_WORKERS.run(numBands, [=, &process](const uint i)
+    {
+        process(((length * i) / numBands), ((length * (i + 1)) / numBands), i);
+    });
+
+    return;
+}
+
+
+#if defined(__SSE2__)
+// Returns a mask in which each 32-bit lane is set if the corresponding pixels
+// of a and b differ by more than the threshold in any of their color channels.
+//
+static inline __m128i sse2_pixels_exceeding(const __m128i a, const __m128i b, const __m128i threshold)
+{
+    const __m128i absDiff = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+    const __m128i excess = _mm_and_si128(_mm_subs_epu8(absDiff, threshold), _mm_set1_epi32(0x00ffffff));
+
+    return _mm_xor_si128(_mm_cmpeq_epi32(excess, _mm_setzero_si128()), _mm_set1_epi32(-1));
+}
+#endif
+
+#if defined(__AVX2__)
+// As sse2_pixels_exceeding(), for 8 pixels.
+//
+static inline __m256i avx2_pixels_exceeding(const __m256i a, const __m256i b, const __m256i threshold)
+{
+    const __m256i absDiff = _mm256_or_si256(_mm256_subs_epu8(a, b), _mm256_subs_epu8(b, a));
+    const __m256i excess = _mm256_and_si256(_mm256_subs_epu8(absDiff, threshold), _mm256_set1_epi32(0x00ffffff));
+
+    return _mm256_xor_si256(_mm256_cmpeq_epi32(excess, _mm256_setzero_si256()), _mm256_set1_epi32(-1));
+}
+#endif
+
+struct pixel_difference_s
+{
+    // Whether any of the pixels differ at all, including in their alpha.
+    bool isDifferent;
+
+    // Whether any of the pixels differ by more than the threshold in a color
+    // channel.
+    bool exceedsThreshold;
+};
+
+// Compares the given number of 32-bit BGRA pixels of a and b. Returns as soon as
+// a difference exceeding the threshold has been found.
+//
+static pixel_difference_s compare_pixels(const u8 *const a, const u8 *const b, const uint numPixels, const u8 threshold)
+{
+    pixel_difference_s difference = {false, false};
+    uint i = 0;
+
+#if defined(__AVX2__)
+    {
+        const __m256i thresholdV = _mm256_set1_epi8(char(threshold));
+        __m256i anyDifferent = _mm256_setzero_si256();
+
+        for (; (i + 8) <= numPixels; i += 8)
+        {
+            const __m256i pa = _mm256_loadu_si256((const __m256i*)&a[i * NUM_COLOR_CHANNELS]);
+            const __m256i pb = _mm256_loadu_si256((const __m256i*)&b[i * NUM_COLOR_CHANNELS]);
+
+            anyDifferent = _mm256_or_si256(anyDifferent, _mm256_xor_si256(pa, pb));
+
+            if (!_mm256_testz_si256(avx2_pixels_exceeding(pa, pb, thresholdV), _mm256_set1_epi32(-1)))
+            {
+                return {true, true};
+            }
+        }
+
+        difference.isDifferent = !_mm256_testz_si256(anyDifferent, anyDifferent);
+    }
+#endif
+#if defined(__SSE2__)
+    {
+        const __m128i thresholdV = _mm_set1_epi8(char(threshold));
+        __m128i anyDifferent = _mm_setzero_si128();
+
+        for (; (i + 4) <= numPixels; i += 4)
+        {
+            const __m128i pa = _mm_loadu_si128((const __m128i*)&a[i * NUM_COLOR_CHANNELS]);
+            const __m128i pb = _mm_loadu_si128((const __m128i*)&b[i * NUM_COLOR_CHANNELS]);
+
+            anyDifferent = _mm_or_si128(anyDifferent, _mm_xor_si128(pa, pb));
+
+            if (_mm_movemask_epi8(sse2_pixels_exceeding(pa, pb, thresholdV)))
+            {
+                return {true, true};
+            }
+        }
+
+        difference.isDifferent = (difference.isDifferent ||
+                                  (_mm_movemask_epi8(_mm_cmpeq_epi8(anyDifferent, _mm_setzero_si128())) != 0xffff));
+    }
+#endif
+
+    for (; i < numPixels; i++)
+    {
+        const u32 idx = i * NUM_COLOR_CHANNELS;
+
+        if (abs(a[idx + 0] - b[idx + 0]) > threshold ||
+            abs(a[idx + 1] - b[idx + 1]) > threshold ||
+            abs(a[idx + 2] - b[idx + 2]) > threshold)
+        {
+            return {true, true};
+        }
+
+        difference.isDifferent = (difference.isDifferent || (*(const u32*)&a[idx] != *(const u32*)&b[idx]));
+    }
+
+    return difference;
+}
 
 // Counts the number of unique frames per second, i.e. frames in which the pixels
 // change between frames by less than a set threshold (which is to account for
@@ -34,42 +307,65 @@ void filter_func_unique_count(FILTER_FUNC_PARAMS)
     VALIDATE_FILTER_INPUT
 
 #ifdef USE_OPENCV
-    static heap_bytes_s<u8> prevPixels(MAX_FRAME_SIZE, "Unique count filter buffer");
+    const uint frameSize = (r->w * r->h * NUM_COLOR_CHANNELS);
+    u8 *const prevPixels = state->buffer(0, frameSize);
 
     const u8 threshold = params[filter_widget_unique_count_s::OFFS_THRESHOLD];
     const u8 corner = params[filter_widget_unique_count_s::OFFS_CORNER];
 
-    static u32 uniqueFramesProcessed = 0;
-    static u32 uniqueFramesPerSecond = 0;
-    static time_t timer = time(NULL);
+    if (!state->timer)
+    {
+        state->timer = time(NULL);
+    }
 
-    for (u32 i = 0; i < (r->w * r->h); i++)
+    // Compare the frame against the previous one tile by tile, updating the
+    // previous frame as we go. Tiles identical to the previous frame's needn't be
+    // copied; and once the frame has been found to be unique, the rest of it is
+    // copied without comparing.
     {
-        const u32 idx = i * NUM_COLOR_CHANNELS;
+        const uint numPixels = (r->w * r->h);
+        const uint tileNumPixels = 4096;
+        bool isUnique = false;
 
-        if (abs(pixels[idx + 0] - prevPixels[idx + 0]) > threshold ||
-            abs(pixels[idx + 1] - prevPixels[idx + 1]) > threshold ||
-            abs(pixels[idx + 2] - prevPixels[idx + 2]) > threshold)
+        for (uint firstPixel = 0; firstPixel < numPixels; firstPixel += tileNumPixels)
         {
-            uniqueFramesProcessed++;
+            const uint tileNumBytes = (std::min(tileNumPixels, (numPixels - firstPixel)) * NUM_COLOR_CHANNELS);
+            const u8 *const tile = &pixels[firstPixel * NUM_COLOR_CHANNELS];
+            u8 *const prevTile = &prevPixels[firstPixel * NUM_COLOR_CHANNELS];
 
-            break;
+            if (isUnique)
+            {
+                memcpy(prevTile, tile, tileNumBytes);
+                continue;
+            }
+
+            const pixel_difference_s difference = compare_pixels(tile, prevTile, (tileNumBytes / NUM_COLOR_CHANNELS), threshold);
+
+            if (difference.isDifferent)
+            {
+                memcpy(prevTile, tile, tileNumBytes);
+            }
+
+            isUnique = difference.exceedsThreshold;
         }
-    }
 
-    memcpy(prevPixels.ptr(), pixels, prevPixels.up_to(r->w * r->h * (r->bpp / 8)));
+        if (isUnique)
+        {
+            state->numUniqueFrames++;
+        }
+    }
 
-    const double secsElapsed = difftime(time(NULL), timer);
+    const double secsElapsed = difftime(time(NULL), state->timer);
     if (secsElapsed >= 1)
     {
-        uniqueFramesPerSecond = round(uniqueFramesProcessed / secsElapsed);
-        uniqueFramesProcessed = 0;
-        timer = time(NULL);
+        state->uniqueFramesPerSecond = round(state->numUniqueFrames / secsElapsed);
+        state->numUniqueFrames = 0;
+        state->timer = time(NULL);
     }
 
     // Draw the counter into the frame.
     {
-        std::string counterString = std::to_string(uniqueFramesPerSecond);
+        std::string counterString = std::to_string(state->uniqueFramesPerSecond);
         cv::Size textSize = cv::getTextSize(counterString, cv::FONT_HERSHEY_DUPLEX, 1, 2, nullptr);
 
         const auto cornerPos = [&]()->cv::Point
@@ -97,7 +393,8 @@ void filter_func_unique_count(FILTER_FUNC_PARAMS)
     return;
 }
 
-// Non-local means denoising. Slow.
+// Non-local means denoising. Slow, but of higher quality than the guided filter of
+// filter_func_denoise_guided().
 //
 void filter_func_denoise_nonlocal_means(FILTER_FUNC_PARAMS)
 {
@@ -123,11 +420,63 @@ void filter_func_denoise_temporal(FILTER_FUNC_PARAMS)
 {
     VALIDATE_FILTER_INPUT
 
+    filter_span_denoise_temporal(pixels, 0, (r->w * r->h), r, params, state);
+
+    return;
+}
+
+void filter_span_denoise_temporal(FILTER_SPAN_FUNC_PARAMS)
+{
 #ifdef USE_OPENCV
     const u8 threshold = params[filter_widget_denoise_temporal_s::OFFS_THRESHOLD];
-    static heap_bytes_s<u8> prevPixels(MAX_FRAME_SIZE, "Denoising filter buffer");
+    u8 *const prevPixels = state->buffer(0, (r->w * r->h * NUM_COLOR_CHANNELS));
+
+    const uint endPixel = (firstPixel + numPixels);
+    uint i = firstPixel;
 
-    for (uint i = 0; i < (r->h * r->w); i++)
+    // Where a pixel's color differs from the previous frame's by more than the
+    // threshold, copy it into the previous frame; otherwise, copy the previous
+    // frame's color into it. The alpha channels are left as they are.
+#if defined(__AVX2__)
+    {
+        const __m256i thresholdV = _mm256_set1_epi8(char(threshold));
+        const __m256i colorMask = _mm256_set1_epi32(0x00ffffff);
+
+        for (; (i + 8) <= endPixel; i += 8)
+        {
+            __m256i *const cur = (__m256i*)&pixels[i * NUM_COLOR_CHANNELS];
+            __m256i *const prev = (__m256i*)&prevPixels[i * NUM_COLOR_CHANNELS];
+            const __m256i a = _mm256_loadu_si256(cur);
+            const __m256i b = _mm256_loadu_si256(prev);
+            const __m256i changed = avx2_pixels_exceeding(a, b, thresholdV);
+
+            _mm256_storeu_si256(prev, _mm256_blendv_epi8(b, a, _mm256_and_si256(changed, colorMask)));
+            _mm256_storeu_si256(cur, _mm256_blendv_epi8(a, b, _mm256_andnot_si256(changed, colorMask)));
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    {
+        const __m128i thresholdV = _mm_set1_epi8(char(threshold));
+        const __m128i colorMask = _mm_set1_epi32(0x00ffffff);
+
+        for (; (i + 4) <= endPixel; i += 4)
+        {
+            __m128i *const cur = (__m128i*)&pixels[i * NUM_COLOR_CHANNELS];
+            __m128i *const prev = (__m128i*)&prevPixels[i * NUM_COLOR_CHANNELS];
+            const __m128i a = _mm_loadu_si128(cur);
+            const __m128i b = _mm_loadu_si128(prev);
+            const __m128i changed = sse2_pixels_exceeding(a, b, thresholdV);
+            const __m128i toPrev = _mm_and_si128(changed, colorMask);
+            const __m128i toCur = _mm_andnot_si128(changed, colorMask);
+
+            _mm_storeu_si128(prev, _mm_or_si128(_mm_and_si128(toPrev, a), _mm_andnot_si128(toPrev, b)));
+            _mm_storeu_si128(cur, _mm_or_si128(_mm_and_si128(toCur, b), _mm_andnot_si128(toCur, a)));
+        }
+    }
+#endif
+
+    for (; i < endPixel; i++)
     {
         const u32 idx = i * NUM_COLOR_CHANNELS;
 
@@ -146,6 +495,13 @@ void filter_func_denoise_temporal(FILTER_FUNC_PARAMS)
             pixels[idx + 2] = prevPixels[idx + 2];
         }
     }
+#else
+    (void)pixels;
+    (void)firstPixel;
+    (void)numPixels;
+    (void)r;
+    (void)params;
+    (void)state;
 #endif
 
     return;
@@ -158,7 +514,8 @@ void filter_func_delta_histogram(FILTER_FUNC_PARAMS)
     VALIDATE_FILTER_INPUT
 
 #ifdef USE_OPENCV
-    static heap_bytes_s<u8> prevFramePixels(MAX_FRAME_SIZE, "Delta histogram buffer");
+    const uint frameSize = (r->w * r->h * NUM_COLOR_CHANNELS);
+    u8 *const prevFramePixels = state->buffer(0, frameSize);
 
     const uint numBins = 512;
 
@@ -207,7 +564,7 @@ void filter_func_delta_histogram(FILTER_FUNC_PARAMS)
         cv::line(output, cv::Point(x1, y1r), cv::Point(x2, y2r), cv::Scalar(0, 0, 255), 2, CV_AA);
     }
 
-    memcpy(prevFramePixels.ptr(), pixels, prevFramePixels.up_to(r->w * r->h * (r->bpp / 8)));
+    memcpy(prevFramePixels, pixels, frameSize);
 #endif
 
     return;
@@ -218,11 +575,11 @@ void filter_func_unsharp_mask(FILTER_FUNC_PARAMS)
     VALIDATE_FILTER_INPUT
 
 #ifdef USE_OPENCV
-    static heap_bytes_s<u8> TMP_BUF(MAX_FRAME_SIZE, "Unsharp mask buffer");
+    u8 *const scratch = state->buffer(0, (r->w * r->h * NUM_COLOR_CHANNELS));
     const real str = params[filter_widget_unsharp_mask_s::OFFS_STRENGTH] / 100.0;
     const real rad = params[filter_widget_unsharp_mask_s::OFFS_RADIUS] / 10.0;
 
-    cv::Mat tmp = cv::Mat(r->h, r->w, CV_8UC4, TMP_BUF.ptr());
+    cv::Mat tmp = cv::Mat(r->h, r->w, CV_8UC4, scratch);
     cv::Mat output = cv::Mat(r->h, r->w, CV_8UC4, pixels);
     cv::GaussianBlur(output, tmp, cv::Size(0, 0), rad);
     cv::addWeighted(output, 1 + str, tmp, -str, 0, output);
@@ -308,111 +665,739 @@ void filter_func_decimate(FILTER_FUNC_PARAMS)
     return;
 }
 
-// Takes a subregion of the frame and either scales it up to fill the whole frame or
-// fills its surroundings with black.
-//
-void filter_func_crop(FILTER_FUNC_PARAMS)
+#ifdef USE_OPENCV
+// The transformation applied to the frame by a geometric filter: an affine
+// mapping of the filter's input coordinates to its output coordinates, after
+// which the output outside of 'mask' (unless it's empty) is blacked out.
+struct geometric_transform_s
 {
-    VALIDATE_FILTER_INPUT
+    cv::Matx33d matrix;
+    cv::Rect mask;
 
-    uint x = *(u16*)&(params[filter_widget_crop_s::OFFS_X]);
-    uint y = *(u16*)&(params[filter_widget_crop_s::OFFS_Y]);
-    uint w = *(u16*)&(params[filter_widget_crop_s::OFFS_WIDTH]);
-    uint h = *(u16*)&(params[filter_widget_crop_s::OFFS_HEIGHT]);
+    // Whether the filter samples the frame with linear interpolation rather than
+    // by nearest neighbor.
+    bool isInterpolated;
+};
 
-    #ifdef USE_OPENCV
-        int scaler = -1;
-        switch (params[filter_widget_crop_s::OFFS_SCALER])
+static geometric_transform_s geometric_transform(const fused_filter_s &filter, const resolution_s &r)
+{
+    geometric_transform_s transform = {cv::Matx33d::eye(), cv::Rect(), false};
+    const u8 *const params = filter.params;
+
+    switch (filter.type)
+    {
+        // As filter_func_flip().
+        case filter_type_enum_e::flip:
         {
-            case 0: scaler = cv::INTER_LINEAR; break;
-            case 1: scaler = cv::INTER_NEAREST; break;
-            case 2: scaler = -1 /*Don't scale.*/; break;
-            default: k_assert(0, "Unknown scaler type for the crop filter."); break;
+            // 0 = vertical, 1 = horizontal, 2 = both.
+            const u8 axis = params[filter_widget_flip_s::OFFS_AXIS];
+
+            if (axis != 0)
+            {
+                transform.matrix(0, 0) = -1;
+                transform.matrix(0, 2) = (r.w - 1);
+            }
+
+            if (axis != 1)
+            {
+                transform.matrix(1, 1) = -1;
+                transform.matrix(1, 2) = (r.h - 1);
+            }
+
+            break;
         }
 
-        if (((x + w) > r->w) || ((y + h) > r->h))
+        // As filter_func_rotate().
+        case filter_type_enum_e::rotate:
         {
-            /// TODO: Signal a user-facing but non-obtrusive message about the crop
-            /// params being invalid.
+            const double angle = (*(i16*)&(params[filter_widget_rotate_s::OFFS_ROT]) / 10.0);
+            const double scale = (*(i16*)&(params[filter_widget_rotate_s::OFFS_SCALE]) / 100.0);
+            const cv::Mat rotation = cv::getRotationMatrix2D(cv::Point2d((r.w / 2), (r.h / 2)), -angle, scale);
+
+            for (uint row = 0; row < 2; row++)
+            {
+                for (uint col = 0; col < 3; col++)
+                {
+                    transform.matrix(row, col) = rotation.at<double>(row, col);
+                }
+            }
+
+            transform.isInterpolated = true;
+
+            break;
         }
-        else
+
+        // As filter_func_crop().
+        case filter_type_enum_e::crop:
         {
-            cv::Mat output = cv::Mat(r->h, r->w, CV_8UC4, pixels);
-            cv::Mat cropped = output(cv::Rect(x, y, w, h)).clone();
+            const uint x = *(u16*)&(params[filter_widget_crop_s::OFFS_X]);
+            const uint y = *(u16*)&(params[filter_widget_crop_s::OFFS_Y]);
+            const uint w = *(u16*)&(params[filter_widget_crop_s::OFFS_WIDTH]);
+            const uint h = *(u16*)&(params[filter_widget_crop_s::OFFS_HEIGHT]);
+
+            // Invalid crop parameters leave the frame as it is.
+            if (!w || !h || ((x + w) > r.w) || ((y + h) > r.h))
+            {
+                break;
+            }
+
+            // 2 = don't scale.
+            if (params[filter_widget_crop_s::OFFS_SCALER] == 2)
+            {
+                transform.mask = cv::Rect(x, y, w, h);
+            }
+            else
+            {
+                // Stretch the cropped region over the frame, with pixel centers
+                // aligned as in cv::resize().
+                const double scaleX = (double(r.w) / w);
+                const double scaleY = (double(r.h) / h);
+
+                transform.matrix(0, 0) = scaleX;
+                transform.matrix(0, 2) = (((0.5 - x) * scaleX) - 0.5);
+                transform.matrix(1, 1) = scaleY;
+                transform.matrix(1, 2) = (((0.5 - y) * scaleY) - 0.5);
+                transform.isInterpolated = (params[filter_widget_crop_s::OFFS_SCALER] == 0);
+            }
 
-            // If the user doesn't want scaling, just append some black borders around the
-            // cropping. Otherwise, stretch the cropped region to fill the entire frame.
-            if (scaler < 0) cv::copyMakeBorder(cropped, output, y, (r->h - (h + y)), x, (r->w - (w + x)), cv::BORDER_CONSTANT, 0);
-            else cv::resize(cropped, output, output.size(), 0, 0, scaler);
+            break;
         }
-    #else
-        (void)x;
-        (void)y;
-        (void)w;
-        (void)h;
-    #endif
 
-    return;
+        default: k_assert(0, "Unsupported filter type for remapping."); break;
+    }
+
+    return transform;
 }
 
-// Flips the frame horizontally and/or vertically.
+// Returns true if the given transformation moves each of the frame's pixels
+// onto another of its pixels, as flips do; i.e. if it neither samples between
+// pixels nor moves any pixel out of the frame (or an outside pixel into it), so
+// that no information is lost that a following transformation could bring back.
 //
-void filter_func_flip(FILTER_FUNC_PARAMS)
+static bool is_pixel_permutation(const cv::Matx33d &matrix, const resolution_s &r)
 {
-    VALIDATE_FILTER_INPUT
+    for (uint row = 0; row < 2; row++)
+    {
+        for (uint col = 0; col < 3; col++)
+        {
+            const double value = matrix(row, col);
+
+            if ((std::abs(value - std::round(value)) > 1e-9) ||
+                ((col < 2) && (std::abs(value) > 1)))
+            {
+                return false;
+            }
+        }
+    }
 
-    static heap_bytes_s<u8> scratch(MAX_FRAME_SIZE, "Flip filter scratch buffer");
+    if (std::abs(std::abs((matrix(0, 0) * matrix(1, 1)) - (matrix(0, 1) * matrix(1, 0))) - 1) > 1e-9)
+    {
+        return false;
+    }
 
-    // 0 = vertical, 1 = horizontal, -1 = both.
-    const uint axis = ((params[filter_widget_flip_s::OFFS_AXIS] == 2)? -1 : params[filter_widget_flip_s::OFFS_AXIS]);
+    const cv::Vec3d corners[] = {cv::Vec3d(0, 0, 1),
+                                 cv::Vec3d((r.w - 1), 0, 1),
+                                 cv::Vec3d(0, (r.h - 1), 1),
+                                 cv::Vec3d((r.w - 1), (r.h - 1), 1)};
 
-    #ifdef USE_OPENCV
-        cv::Mat output = cv::Mat(r->h, r->w, CV_8UC4, pixels);
-        cv::Mat temp = cv::Mat(r->h, r->w, CV_8UC4, scratch.ptr());
+    for (const cv::Vec3d &corner: corners)
+    {
+        const cv::Vec3d mapped = (matrix * corner);
 
-        cv::flip(output, temp, axis);
-        temp.copyTo(output);
-    #else
-        (void)axis;
-    #endif
+        if ((std::round(mapped[0]) < 0) || (std::round(mapped[0]) > (r.w - 1)) ||
+            (std::round(mapped[1]) < 0) || (std::round(mapped[1]) > (r.h - 1)))
+        {
+            return false;
+        }
+    }
 
-    return;
+    return true;
 }
 
-void filter_func_rotate(FILTER_FUNC_PARAMS)
+// Blacks out the parts of the given image outside of the given rectangle.
+//
+static void black_out_around(cv::Mat &image, const cv::Rect &rect)
 {
-    VALIDATE_FILTER_INPUT
-
-    static heap_bytes_s<u8> scratch(MAX_FRAME_SIZE, "Rotate filter scratch buffer");
-
-    const double angle = (*(i16*)&(params[filter_widget_rotate_s::OFFS_ROT]) / 10.0);
-    const double scale = (*(i16*)&(params[filter_widget_rotate_s::OFFS_SCALE]) / 100.0);
-
-    #ifdef USE_OPENCV
-        cv::Mat output = cv::Mat(r->h, r->w, CV_8UC4, pixels);
-        cv::Mat temp = cv::Mat(r->h, r->w, CV_8UC4, scratch.ptr());
-
-        cv::Mat transf = cv::getRotationMatrix2D(cv::Point2d((r->w / 2), (r->h / 2)), -angle, scale);
-        cv::warpAffine(output, temp, transf, cv::Size(r->w, r->h));
-        temp.copyTo(output);
-    #else
-        (void)angle;
-        (void)scale;
-    #endif
+    image(cv::Rect(0, 0, image.cols, rect.y)).setTo(0);
+    image(cv::Rect(0, (rect.y + rect.height), image.cols, (image.rows - (rect.y + rect.height)))).setTo(0);
+    image(cv::Rect(0, rect.y, rect.x, rect.height)).setTo(0);
+    image(cv::Rect((rect.x + rect.width), rect.y, (image.cols - (rect.x + rect.width)), rect.height)).setTo(0);
 
     return;
 }
 
-void filter_func_median(FILTER_FUNC_PARAMS)
+// Transforms the given frame by the given affine mapping of its coordinates, as
+// cv::warpAffine() would, using the given filter state's buffers for scratch
+// and for caching.
+//
+static void apply_geometric_transform(u8 *const pixels,
+                                      const resolution_s &r,
+                                      const cv::Matx33d &matrix,
+                                      const bool isInterpolated,
+                                      filter_state_s *const state)
+{
+    if (matrix == cv::Matx33d::eye())
+    {
+        return;
+    }
+
+    const uint frameSize = (r.w * r.h * NUM_COLOR_CHANNELS);
+    const cv::Matx33d inverse = matrix.inv();
+    cv::Mat output = cv::Mat(r.h, r.w, CV_8UC4, pixels);
+
+    // Transformations that only move whole pixels around - flips, and rotations
+    // by multiples of 90 degrees - are done by copying the pixels directly.
+    const bool isPermutation = [&inverse]
+    {
+        for (uint row = 0; row < 2; row++)
+        {
+            for (uint col = 0; col < 3; col++)
+            {
+                const double value = inverse(row, col);
+
+                if ((std::abs(value - std::round(value)) > 1e-9) ||
+                    ((col < 2) && (std::abs(value) > 1)))
+                {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }();
+
+    if (isPermutation)
+    {
+        const int w = r.w;
+        const int h = r.h;
+        const int a = int(std::round(inverse(0, 0))), b = int(std::round(inverse(0, 1))), c = int(std::round(inverse(0, 2)));
+        const int d = int(std::round(inverse(1, 0))), e = int(std::round(inverse(1, 1))), f = int(std::round(inverse(1, 2)));
+
+        // A flip of the whole frame can be done in place.
+        if (!b && !d &&
+            (c == ((a < 0)? (w - 1) : 0)) &&
+            (f == ((e < 0)? (h - 1) : 0)))
+        {
+            cv::flip(output, output, (((a < 0) && (e < 0))? -1 : (a < 0)? 1 : 0));
+
+            return;
+        }
+
+        const u32 *const src = (const u32*)pixels;
+        u32 *const dst = (u32*)state->buffer(1, frameSize);
+
+        process_in_parallel_bands(h, 16, [=](const uint y0, const uint y1, const uint)
+        {
+            for (int y = int(y0); y < int(y1); y++)
+            {
+                for (int x = 0; x < w; x++)
+                {
+                    const int srcX = ((a * x) + (b * y) + c);
+                    const int srcY = ((d * x) + (e * y) + f);
+
+                    dst[(y * w) + x] = (((srcX >= 0) && (srcX < w) && (srcY >= 0) && (srcY < h))? src[(srcY * w) + srcX] : 0);
+                }
+            }
+        });
+
+        memcpy(pixels, dst, frameSize);
+
+        return;
+    }
+
+    // Otherwise, the frame is sampled through fixed-point remap tables, which
+    // are computed when the transformation changes and reused until then.
+    {
+        cv::Mat coordinates = cv::Mat(r.h, r.w, CV_16SC2, state->buffer(2, (r.w * r.h * 2 * sizeof(i16))));
+        cv::Mat weights = cv::Mat(r.h, r.w, CV_16UC1, state->buffer(3, (r.w * r.h * sizeof(u16))));
+
+        const std::vector<double> tablesKey = {matrix(0, 0), matrix(0, 1), matrix(0, 2),
+                                               matrix(1, 0), matrix(1, 1), matrix(1, 2),
+                                               double(r.w), double(r.h), double(isInterpolated)};
+
+        if (state->remapTablesKey != tablesKey)
+        {
+            cv::Mat mapX = cv::Mat(r.h, r.w, CV_32FC1);
+            cv::Mat mapY = cv::Mat(r.h, r.w, CV_32FC1);
+
+            for (uint y = 0; y < r.h; y++)
+            {
+                for (uint x = 0; x < r.w; x++)
+                {
+                    mapX.at<float>(y, x) = ((inverse(0, 0) * x) + (inverse(0, 1) * y) + inverse(0, 2));
+                    mapY.at<float>(y, x) = ((inverse(1, 0) * x) + (inverse(1, 1) * y) + inverse(1, 2));
+                }
+            }
+
+            cv::convertMaps(mapX, mapY, coordinates, weights, CV_16SC2, !isInterpolated);
+            state->remapTablesKey = tablesKey;
+        }
+
+        cv::Mat temp = cv::Mat(r.h, r.w, CV_8UC4, state->buffer(1, frameSize));
+        cv::remap(output, temp, coordinates, (isInterpolated? weights : cv::Mat()),
+                  (isInterpolated? cv::INTER_LINEAR : cv::INTER_NEAREST),
+                  cv::BORDER_CONSTANT, cv::Scalar(0, 0, 0, 0));
+        temp.copyTo(output);
+    }
+
+    return;
+}
+#endif
+
+// Takes a subregion of the frame and either scales it up to fill the whole frame or
+// fills its surroundings with black.
+//
+void filter_func_crop(FILTER_FUNC_PARAMS)
 {
     VALIDATE_FILTER_INPUT
 
-#ifdef USE_OPENCV
-    const u8 kernelS = params[filter_widget_median_s::OFFS_KERNEL_SIZE];
+    uint x = *(u16*)&(params[filter_widget_crop_s::OFFS_X]);
+    uint y = *(u16*)&(params[filter_widget_crop_s::OFFS_Y]);
+    uint w = *(u16*)&(params[filter_widget_crop_s::OFFS_WIDTH]);
+    uint h = *(u16*)&(params[filter_widget_crop_s::OFFS_HEIGHT]);
 
-    cv::Mat output = cv::Mat(r->h, r->w, CV_8UC4, pixels);
-    cv::medianBlur(output, output, kernelS);
+    #ifdef USE_OPENCV
+        int scaler = -1;
+        switch (params[filter_widget_crop_s::OFFS_SCALER])
+        {
+            case 0: scaler = cv::INTER_LINEAR; break;
+            case 1: scaler = cv::INTER_NEAREST; break;
+            case 2: scaler = -1 /*Don't scale.*/; break;
+            default: k_assert(0, "Unknown scaler type for the crop filter."); break;
+        }
+
+        if (((x + w) > r->w) || ((y + h) > r->h))
+        {
+            /// TODO: Signal a user-facing but non-obtrusive message about the crop
+            /// params being invalid.
+        }
+        else
+        {
+            cv::Mat output = cv::Mat(r->h, r->w, CV_8UC4, pixels);
+            const cv::Rect region = cv::Rect(x, y, w, h);
+
+            // If the user doesn't want scaling, just black out the frame around the
+            // cropping. Otherwise, stretch the cropped region to fill the entire
+            // frame, scaling from a view into the frame rather than a copy of it.
+            if (scaler < 0)
+            {
+                black_out_around(output, region);
+            }
+            else
+            {
+                cv::Mat temp = cv::Mat(r->h, r->w, CV_8UC4, state->buffer(1, (r->w * r->h * NUM_COLOR_CHANNELS)));
+                cv::resize(output(region), temp, temp.size(), 0, 0, scaler);
+                temp.copyTo(output);
+            }
+        }
+    #else
+        (void)x;
+        (void)y;
+        (void)w;
+        (void)h;
+    #endif
+
+    return;
+}
+
+// Flips the frame horizontally and/or vertically.
+//
+void filter_func_flip(FILTER_FUNC_PARAMS)
+{
+    VALIDATE_FILTER_INPUT
+
+    // 0 = vertical, 1 = horizontal, -1 = both.
+    const uint axis = ((params[filter_widget_flip_s::OFFS_AXIS] == 2)? -1 : params[filter_widget_flip_s::OFFS_AXIS]);
+
+    #ifdef USE_OPENCV
+        // OpenCV flips in place by swapping the pixels pairwise.
+        cv::Mat output = cv::Mat(r->h, r->w, CV_8UC4, pixels);
+        cv::flip(output, output, axis);
+    #else
+        (void)axis;
+    #endif
+
+    return;
+}
+
+void filter_func_rotate(FILTER_FUNC_PARAMS)
+{
+    VALIDATE_FILTER_INPUT
+
+    #ifdef USE_OPENCV
+        const geometric_transform_s transform = geometric_transform({filter_type_enum_e::rotate, nullptr, params, state}, *r);
+        apply_geometric_transform(pixels, *r, transform.matrix, transform.isInterpolated, state);
+    #endif
+
+    return;
+}
+
+// Adds to 'dst' the given number (a multiple of 8) of histogram bins from 'add',
+// and subtracts from it those from 'sub', if given.
+//
+static inline void add_histogram_bins(u16 *const dst, const u16 *const add, const u16 *const sub, const uint numBins)
+{
+    uint i = 0;
+
+#if defined(__SSE2__)
+    for (; i < numBins; i += 8)
+    {
+        __m128i bins = _mm_add_epi16(_mm_loadu_si128((const __m128i*)&dst[i]), _mm_loadu_si128((const __m128i*)&add[i]));
+
+        if (sub)
+        {
+            bins = _mm_sub_epi16(bins, _mm_loadu_si128((const __m128i*)&sub[i]));
+        }
+
+        _mm_storeu_si128((__m128i*)&dst[i], bins);
+    }
+#endif
+
+    for (; i < numBins; i++)
+    {
+        dst[i] += (add[i] - (sub? sub[i] : 0));
+    }
+
+    return;
+}
+
+// Median-filters the BGR channels of the columns [x0, x1) of the given image,
+// reading from 'src' and writing into 'dst'. Uses the constant-time algorithm of
+// Perreault & Hebert (2007): each column keeps a histogram of its pixels within
+// the kernel's vertical reach, and the kernel's histogram is updated by adding
+// in the column entering it and subtracting the one leaving it. The histograms
+// are two-tiered, 16 coarse bins over 256 fine ones, and the kernel's fine bins
+// are updated lazily, only for the coarse bin in which the median falls.
+//
+// 'histograms' must have room for the column histograms of (x1 - x0 + 2 *
+// radius) columns; see MEDIAN_COLUMN_HISTOGRAM_SIZE.
+//
+static const uint MEDIAN_COLUMN_HISTOGRAM_SIZE = (3 * (16 + 256));
+static void median_filter_columns(const u8 *const src,
+                                  u8 *const dst,
+                                  const resolution_s &r,
+                                  const int radius,
+                                  const int x0,
+                                  const int x1,
+                                  u16 *const histograms)
+{
+    const int w = r.w;
+    const int h = r.h;
+    const uint threshold = (((2 * radius + 1) * (2 * radius + 1)) / 2);
+
+    // The columns whose histograms the kernel spans. Columns beyond the image's
+    // edges are taken to be copies of the edge column, and rows likewise.
+    const int cx0 = std::max(0, (x0 - radius));
+    const int cx1 = std::min(w, (x1 + radius));
+    const auto column_of = [=](const int x){ return (std::min(std::max(x, 0), (w - 1)) - cx0); };
+    const auto row_of = [=](const int y){ return std::min(std::max(y, 0), (h - 1)); };
+
+    // Column histograms, for each channel of each column in turn.
+    u16 *const columnCoarse = histograms;
+    u16 *const columnFine = (histograms + ((cx1 - cx0) * 3 * 16));
+    memset(histograms, 0, ((cx1 - cx0) * MEDIAN_COLUMN_HISTOGRAM_SIZE * sizeof(u16)));
+
+    const auto update_columns = [=](const int y, const int delta)
+    {
+        const u8 *const row = &src[((row_of(y) * w) + cx0) * NUM_COLOR_CHANNELS];
+
+        for (int col = 0; col < (cx1 - cx0); col++)
+        {
+            for (uint c = 0; c < 3; c++)
+            {
+                const u8 value = row[(col * NUM_COLOR_CHANNELS) + c];
+
+                columnCoarse[(((col * 3) + c) * 16) + (value >> 4)] += delta;
+                columnFine[(((col * 3) + c) * 256) + value] += delta;
+            }
+        }
+    };
+
+    for (int y = -radius; y <= radius; y++)
+    {
+        update_columns(y, 1);
+    }
+
+    u16 kernelCoarse[3 * 16];
+    u16 kernelFine[3 * 256];
+
+    // For each coarse bin, the column up to which (exclusive) the kernel's fine
+    // bins under it have been updated.
+    int kernelFineEnd[3 * 16];
+
+    for (int y = 0; y < h; y++)
+    {
+        if (y > 0)
+        {
+            update_columns((y - radius - 1), -1);
+            update_columns((y + radius), 1);
+        }
+
+        memset(kernelCoarse, 0, sizeof(kernelCoarse));
+        for (int x = (x0 - radius); x <= (x0 + radius); x++)
+        {
+            add_histogram_bins(kernelCoarse, &columnCoarse[column_of(x) * 3 * 16], nullptr, (3 * 16));
+        }
+
+        std::fill(std::begin(kernelFineEnd), std::end(kernelFineEnd), (x0 - radius));
+
+        for (int x = x0; x < x1; x++)
+        {
+            if (x > x0)
+            {
+                add_histogram_bins(kernelCoarse,
+                                   &columnCoarse[column_of(x + radius) * 3 * 16],
+                                   &columnCoarse[column_of(x - radius - 1) * 3 * 16],
+                                   (3 * 16));
+            }
+
+            for (uint c = 0; c < 3; c++)
+            {
+                uint count = 0;
+                uint coarse = 0;
+
+                while ((count + kernelCoarse[(c * 16) + coarse]) <= threshold)
+                {
+                    count += kernelCoarse[(c * 16) + coarse++];
+                }
+
+                // Bring the kernel's fine bins under the median's coarse bin up to
+                // date; from scratch if none of their columns remain in the kernel.
+                u16 *const fine = &kernelFine[(c * 256) + (coarse * 16)];
+                int &fineEnd = kernelFineEnd[(c * 16) + coarse];
+                const auto column_fine = [=](const int x){ return &columnFine[(((column_of(x) * 3) + c) * 256) + (coarse * 16)]; };
+
+                if (fineEnd <= (x - radius))
+                {
+                    memset(fine, 0, (16 * sizeof(u16)));
+
+                    for (int cx = (x - radius); cx <= (x + radius); cx++)
+                    {
+                        add_histogram_bins(fine, column_fine(cx), nullptr, 16);
+                    }
+                }
+                else
+                {
+                    for (int cx = fineEnd; cx <= (x + radius); cx++)
+                    {
+                        add_histogram_bins(fine, column_fine(cx), column_fine(cx - (2 * radius + 1)), 16);
+                    }
+                }
+
+                fineEnd = (x + radius + 1);
+
+                uint value = 0;
+                while ((count + fine[value]) <= threshold)
+                {
+                    count += fine[value++];
+                }
+
+                dst[(((y * w) + x) * NUM_COLOR_CHANNELS) + c] = ((coarse * 16) + value);
+            }
+        }
+    }
+
+    return;
+}
+
+void filter_func_median(FILTER_FUNC_PARAMS)
+{
+    VALIDATE_FILTER_INPUT
+
+    const int radius = (params[filter_widget_median_s::OFFS_KERNEL_SIZE] / 2);
+
+    if (!radius)
+    {
+        return;
+    }
+
+    // Filter from a copy of the frame, in vertical strips.
+    const uint frameSize = (r->w * r->h * NUM_COLOR_CHANNELS);
+    u8 *const src = state->buffer(0, frameSize);
+    memcpy(src, pixels, frameSize);
+
+    const uint numStrips = num_parallel_bands(r->w, 64);
+    const uint stripHistogramsSize = ((((r->w / numStrips) + 1 + (2 * radius)) * MEDIAN_COLUMN_HISTOGRAM_SIZE));
+    u16 *const histograms = (u16*)state->buffer(1, (numStrips * stripHistogramsSize * sizeof(u16)));
+
+    process_in_parallel_bands(r->w, 64, [=](const uint x0, const uint x1, const uint stripIdx)
+    {
+        median_filter_columns(src, pixels, *r, radius, x0, x1, &histograms[stripIdx * stripHistogramsSize]);
+    });
+
+    return;
+}
+
+// Box-blurs horizontally the BGR channels of the rows [y0, y1) of the given
+// image, reading from 'src' and writing into 'dst', with a sliding window whose
+// cost doesn't depend on its radius. The alpha channel of 'dst' is left as is.
+//
+static void box_blur_rows(const u8 *const src, u8 *const dst, const resolution_s &r, const int radius, const uint y0, const uint y1)
+{
+    const int w = r.w;
+    const u32 windowSize = ((2 * radius) + 1);
+
+    // Dividing the sums by the window size by multiplying with a 16-bit reciprocal.
+    const u32 reciprocal = ((65536 + windowSize - 1) / windowSize);
+    const u32 half = (windowSize / 2);
+
+    for (uint y = y0; y < y1; y++)
+    {
+        const u8 *const srcRow = &src[y * w * NUM_COLOR_CHANNELS];
+        u8 *const dstRow = &dst[y * w * NUM_COLOR_CHANNELS];
+        const auto pixel_at = [=](const int x){ return &srcRow[std::min(std::max(x, 0), (w - 1)) * NUM_COLOR_CHANNELS]; };
+
+#if defined(__SSE2__)
+        const auto load = [](const u8 *const p){ return _mm_unpacklo_epi8(_mm_cvtsi32_si128(*(const int*)p), _mm_setzero_si128()); };
+        const __m128i reciprocalV = _mm_set1_epi16(short(reciprocal));
+        const __m128i halfV = _mm_set1_epi16(short(half));
+        const __m128i colorMask = _mm_set1_epi32(0x00ffffff);
+
+        __m128i sum = _mm_setzero_si128();
+        for (int x = -radius; x <= radius; x++)
+        {
+            sum = _mm_add_epi16(sum, load(pixel_at(x)));
+        }
+
+        for (int x = 0; x < w; x++)
+        {
+            const __m128i average = _mm_mulhi_epu16(_mm_add_epi16(sum, halfV), reciprocalV);
+            const __m128i color = _mm_and_si128(_mm_packus_epi16(average, average), colorMask);
+            const __m128i alpha = _mm_andnot_si128(colorMask, _mm_cvtsi32_si128(*(const int*)&dstRow[x * NUM_COLOR_CHANNELS]));
+
+            *(int*)&dstRow[x * NUM_COLOR_CHANNELS] = _mm_cvtsi128_si32(_mm_or_si128(color, alpha));
+
+            sum = _mm_sub_epi16(_mm_add_epi16(sum, load(pixel_at(x + radius + 1))), load(pixel_at(x - radius)));
+        }
+#else
+        u32 sum[3] = {0, 0, 0};
+        for (int x = -radius; x <= radius; x++)
+        {
+            for (uint c = 0; c < 3; c++)
+            {
+                sum[c] += pixel_at(x)[c];
+            }
+        }
+
+        for (int x = 0; x < w; x++)
+        {
+            for (uint c = 0; c < 3; c++)
+            {
+                dstRow[(x * NUM_COLOR_CHANNELS) + c] = (((sum[c] + half) * reciprocal) >> 16);
+                sum[c] += (pixel_at(x + radius + 1)[c] - pixel_at(x - radius)[c]);
+            }
+        }
 #endif
+    }
+
+    return;
+}
+
+// Box-blurs vertically the BGR channels of the columns [x0, x1) of the given
+// image, reading from 'src' and writing into 'dst'; otherwise as box_blur_rows().
+//
+static void box_blur_columns(const u8 *const src, u8 *const dst, const resolution_s &r, const int radius, const uint x0, const uint x1)
+{
+    const int w = r.w;
+    const int h = r.h;
+    const u32 windowSize = ((2 * radius) + 1);
+    const u32 reciprocal = ((65536 + windowSize - 1) / windowSize);
+    const u32 half = (windowSize / 2);
+
+    // The sums of each channel of each column over the window, processed as a row.
+    const uint numChannels = ((x1 - x0) * NUM_COLOR_CHANNELS);
+    std::vector<u16> sums(numChannels, 0);
+
+    const auto row_at = [=](const int y){ return &src[((std::min(std::max(y, 0), (h - 1)) * w) + x0) * NUM_COLOR_CHANNELS]; };
+
+    for (int y = -radius; y <= radius; y++)
+    {
+        const u8 *const row = row_at(y);
+
+        for (uint i = 0; i < numChannels; i++)
+        {
+            sums[i] += row[i];
+        }
+    }
+
+    for (int y = 0; y < h; y++)
+    {
+        const u8 *const entering = row_at(y + radius + 1);
+        const u8 *const leaving = row_at(y - radius);
+        u8 *const dstRow = &dst[((y * w) + x0) * NUM_COLOR_CHANNELS];
+        uint i = 0;
+
+#if defined(__SSE2__)
+        // Two pixels at a time.
+        const __m128i reciprocalV = _mm_set1_epi16(short(reciprocal));
+        const __m128i halfV = _mm_set1_epi16(short(half));
+        const __m128i colorMask = _mm_set1_epi32(0x00ffffff);
+        const __m128i zero = _mm_setzero_si128();
+
+        for (; (i + 8) <= numChannels; i += 8)
+        {
+            __m128i *const sum = (__m128i*)&sums[i];
+            const __m128i average = _mm_mulhi_epu16(_mm_add_epi16(_mm_loadu_si128(sum), halfV), reciprocalV);
+            const __m128i color = _mm_and_si128(_mm_packus_epi16(average, average), colorMask);
+            const __m128i alpha = _mm_andnot_si128(colorMask, _mm_loadl_epi64((const __m128i*)&dstRow[i]));
+
+            _mm_storel_epi64((__m128i*)&dstRow[i], _mm_or_si128(color, alpha));
+
+            _mm_storeu_si128(sum, _mm_sub_epi16(_mm_add_epi16(_mm_loadu_si128(sum),
+                                                              _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)&entering[i]), zero)),
+                                                _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)&leaving[i]), zero)));
+        }
+#endif
+
+        for (; i < numChannels; i++)
+        {
+            if ((i % NUM_COLOR_CHANNELS) != 3)
+            {
+                dstRow[i] = (((sums[i] + half) * reciprocal) >> 16);
+            }
+
+            sums[i] += (entering[i] - leaving[i]);
+        }
+    }
+
+    return;
+}
+
+// Box-blurs the BGR channels of the given image successively with each of the
+// given radii, in parallel bands of rows and then of columns.
+//
+static void box_blur(u8 *const pixels, const resolution_s &r, const std::vector<int> &radii, filter_state_s *const state)
+{
+    if (radii.empty())
+    {
+        return;
+    }
+
+    const uint frameSize = (r.w * r.h * NUM_COLOR_CHANNELS);
+    u8 *const buffers[2] = {state->buffer(0, frameSize), state->buffer(1, frameSize)};
+
+    // Horizontal passes, from the frame into the buffers.
+    const u8 *const rowsBlurred = buffers[(radii.size() - 1) % 2];
+    process_in_parallel_bands(r.h, 16, [&](const uint y0, const uint y1, const uint)
+    {
+        for (uint i = 0; i < radii.size(); i++)
+        {
+            box_blur_rows((i? buffers[(i - 1) % 2] : pixels), buffers[i % 2], r, radii[i], y0, y1);
+        }
+    });
+
+    // Vertical passes, from the buffers back into the frame.
+    process_in_parallel_bands(r.w, 64, [&](const uint x0, const uint x1, const uint)
+    {
+        const u8 *src = rowsBlurred;
+
+        for (uint i = 0; i < radii.size(); i++)
+        {
+            u8 *const dst = ((i == (radii.size() - 1))? pixels : buffers[(src == buffers[0])? 1 : 0]);
+            box_blur_columns(src, dst, r, radii[i], x0, x1);
+            src = dst;
+        }
+    });
 
     return;
 }
@@ -421,20 +1406,438 @@ void filter_func_blur(FILTER_FUNC_PARAMS)
 {
     VALIDATE_FILTER_INPUT
 
-#ifdef USE_OPENCV
     const real kernelS = (params[filter_widget_blur_s::OFFS_KERNEL_SIZE] / 10.0);
-
-    cv::Mat output = cv::Mat(r->h, r->w, CV_8UC4, pixels);
+    std::vector<int> radii;
 
     if (params[filter_widget_blur_s::OFFS_TYPE] == filter_widget_blur_s::FILTER_TYPE_GAUSSIAN)
     {
-        cv::GaussianBlur(output, output, cv::Size(0, 0), kernelS);
+        // Approximate the gaussian with three successive box blurs whose combined
+        // variance matches it (see Kovesi, "Fast Almost-Gaussian Filtering", 2010).
+        const uint numBoxes = 3;
+        const real variance12 = (12 * kernelS * kernelS);
+        int lowerWidth = int(std::sqrt((variance12 / numBoxes) + 1));
+        lowerWidth -= !(lowerWidth % 2);
+        const int numLower = int(std::round((variance12 - (numBoxes * lowerWidth * lowerWidth) - (4 * numBoxes * lowerWidth) - (3 * numBoxes)) /
+                                            ((-4 * lowerWidth) - 4)));
+
+        for (int i = 0; i < int(numBoxes); i++)
+        {
+            const int radius = (((i < numLower)? lowerWidth : (lowerWidth + 2)) / 2);
+
+            if (radius > 0)
+            {
+                radii.push_back(radius);
+            }
+        }
+    }
+    else if (int(kernelS) > 0)
+    {
+        radii.push_back(int(kernelS));
+    }
+
+    box_blur(pixels, *r, radii, state);
+
+    return;
+}
+
+// Four floats, operated on at once where SIMD is available. Holds the channels
+// of a pixel in the guided denoising filter.
+//
+struct float4_s
+{
+#if defined(__SSE2__)
+    __m128 v;
+
+    static float4_s load(const float *const p) { return {_mm_loadu_ps(p)}; }
+    static float4_s splat(const float x) { return {_mm_set1_ps(x)}; }
+    static float4_s from_pixel(const u8 *const p)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        return {_mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(*(const int*)p), zero), zero))};
+    }
+
+    void store(float *const p) const { _mm_storeu_ps(p, this->v); }
+
+    // Writes the first three values, rounded and saturated, into the BGR channels
+    // of the given pixel.
+    void store_bgr(u8 *const p) const
+    {
+        const __m128i i = _mm_cvtps_epi32(this->v);
+        const u32 bgr = u32(_mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(i, i), i)));
+        *(u32*)p = ((bgr & 0x00ffffff) | (*(const u32*)p & 0xff000000));
+    }
+
+    float4_s operator+(const float4_s &other) const { return {_mm_add_ps(this->v, other.v)}; }
+    float4_s operator-(const float4_s &other) const { return {_mm_sub_ps(this->v, other.v)}; }
+    float4_s operator*(const float4_s &other) const { return {_mm_mul_ps(this->v, other.v)}; }
+    float4_s operator/(const float4_s &other) const { return {_mm_div_ps(this->v, other.v)}; }
+    float4_s max(const float4_s &other) const { return {_mm_max_ps(this->v, other.v)}; }
+#else
+    float v[4];
+
+    static float4_s load(const float *const p) { return {{p[0], p[1], p[2], p[3]}}; }
+    static float4_s splat(const float x) { return {{x, x, x, x}}; }
+    static float4_s from_pixel(const u8 *const p) { return {{float(p[0]), float(p[1]), float(p[2]), float(p[3])}}; }
+
+    void store(float *const p) const { std::copy(this->v, (this->v + 4), p); }
+
+    void store_bgr(u8 *const p) const
+    {
+        for (uint c = 0; c < 3; c++)
+        {
+            p[c] = u8(std::min(255.0f, std::max(0.0f, std::round(this->v[c]))));
+        }
+    }
+
+    template <typename F>
+    float4_s combined(const float4_s &other, const F &op) const
+    {
+        return {{op(this->v[0], other.v[0]), op(this->v[1], other.v[1]), op(this->v[2], other.v[2]), op(this->v[3], other.v[3])}};
+    }
+
+    float4_s operator+(const float4_s &other) const { return this->combined(other, [](float a, float b){ return (a + b); }); }
+    float4_s operator-(const float4_s &other) const { return this->combined(other, [](float a, float b){ return (a - b); }); }
+    float4_s operator*(const float4_s &other) const { return this->combined(other, [](float a, float b){ return (a * b); }); }
+    float4_s operator/(const float4_s &other) const { return this->combined(other, [](float a, float b){ return (a / b); }); }
+    float4_s max(const float4_s &other) const { return this->combined(other, [](float a, float b){ return std::max(a, b); }); }
+#endif
+};
+
+// Box-filters the given image of float4_s pixels with the given radius, from
+// 'src' into 'dst', with sliding windows in parallel bands of rows and then of
+// columns. 'tmp' is scratch space the size of the image. Edges are replicated.
+//
+static void box_mean_float4(const float *const src, float *const dst, float *const tmp, const int w, const int h, const int radius)
+{
+    const float4_s norm = float4_s::splat(1.0f / ((2 * radius + 1) * (2 * radius + 1)));
+
+    process_in_parallel_bands(h, 8, [=](const uint y0, const uint y1, const uint)
+    {
+        for (uint y = y0; y < y1; y++)
+        {
+            const float *const row = &src[y * w * 4];
+            const auto pixel_at = [=](const int x){ return float4_s::load(&row[std::min(std::max(x, 0), (w - 1)) * 4]); };
+
+            float4_s sum = float4_s::splat(0);
+            for (int x = -radius; x <= radius; x++)
+            {
+                sum = (sum + pixel_at(x));
+            }
+
+            for (int x = 0; x < w; x++)
+            {
+                sum.store(&tmp[((y * w) + x) * 4]);
+                sum = ((sum + pixel_at(x + radius + 1)) - pixel_at(x - radius));
+            }
+        }
+    });
+
+    process_in_parallel_bands(w, 16, [=](const uint x0, const uint x1, const uint)
+    {
+        const auto row_at = [=](const int y){ return &tmp[std::min(std::max(y, 0), (h - 1)) * w * 4]; };
+        std::vector<float> sums(((x1 - x0) * 4), 0);
+
+        for (int y = -radius; y <= radius; y++)
+        {
+            for (uint x = x0; x < x1; x++)
+            {
+                (float4_s::load(&sums[(x - x0) * 4]) + float4_s::load(&row_at(y)[x * 4])).store(&sums[(x - x0) * 4]);
+            }
+        }
+
+        for (int y = 0; y < h; y++)
+        {
+            const float *const entering = row_at(y + radius + 1);
+            const float *const leaving = row_at(y - radius);
+
+            for (uint x = x0; x < x1; x++)
+            {
+                float *const sum = &sums[(x - x0) * 4];
+
+                (float4_s::load(sum) * norm).store(&dst[((y * w) + x) * 4]);
+                ((float4_s::load(sum) + float4_s::load(&entering[x * 4])) - float4_s::load(&leaving[x * 4])).store(sum);
+            }
+        }
+    });
+
+    return;
+}
+
+// Edge-preserving smoothing of the BGR channels of the given image with a
+// self-guided filter (He, Sun & Tang, 2010), each channel guiding itself. The
+// filter's linear coefficients are solved at a reduced resolution and
+// interpolated back up (He & Sun, "Fast Guided Filter", 2015), so that the cost
+// per pixel stays low and independent of the radius.
+//
+static void guided_filter(u8 *const pixels, const resolution_s &r, const int radius, const float epsilon, filter_state_s *const state)
+{
+    const int w = r.w;
+    const int h = r.h;
+    const int scale = std::max(1, std::min(4, (radius / 2)));
+    const int lowRadius = std::max(1, (radius / scale));
+    const int lw = ((w + scale - 1) / scale);
+    const int lh = ((h + scale - 1) / scale);
+    const uint planeSize = (lw * lh * 4);
+
+    float *const planes = (float*)state->buffer(1, (5 * planeSize * sizeof(float)));
+    float *const guide = (planes + (0 * planeSize));
+    float *const guideSq = (planes + (1 * planeSize));
+    float *const mean = (planes + (2 * planeSize));
+    float *const meanSq = (planes + (3 * planeSize));
+    float *const tmp = (planes + (4 * planeSize));
+
+    // Downscale the image into the guide by averaging blocks of pixels.
+    process_in_parallel_bands(lh, 8, [=](const uint ly0, const uint ly1, const uint)
+    {
+        for (uint ly = ly0; ly < ly1; ly++)
+        {
+            for (int lx = 0; lx < lw; lx++)
+            {
+                const int x0 = (lx * scale), x1 = std::min(w, (x0 + scale));
+                const int y0 = (ly * scale), y1 = std::min(h, (y0 + scale));
+                float4_s sum = float4_s::splat(0);
+
+                for (int y = y0; y < y1; y++)
+                {
+                    for (int x = x0; x < x1; x++)
+                    {
+                        sum = (sum + float4_s::from_pixel(&pixels[((y * w) + x) * NUM_COLOR_CHANNELS]));
+                    }
+                }
+
+                const float4_s average = (sum * float4_s::splat(1.0f / ((x1 - x0) * (y1 - y0))));
+                average.store(&guide[((ly * lw) + lx) * 4]);
+                (average * average).store(&guideSq[((ly * lw) + lx) * 4]);
+            }
+        }
+    });
+
+    box_mean_float4(guide, mean, tmp, lw, lh, lowRadius);
+    box_mean_float4(guideSq, meanSq, tmp, lw, lh, lowRadius);
+
+    // Solve the coefficients a and b of q = a*I + b for each window, replacing
+    // the guide and its square, which are no longer needed.
+    float *const coeffA = guideSq;
+    float *const coeffB = guide;
+    {
+        const float4_s epsilonV = float4_s::splat(epsilon);
+        const float4_s zero = float4_s::splat(0);
+
+        for (uint i = 0; i < planeSize; i += 4)
+        {
+            const float4_s m = float4_s::load(&mean[i]);
+            const float4_s variance = (float4_s::load(&meanSq[i]) - (m * m)).max(zero);
+            const float4_s a = (variance / (variance + epsilonV));
+
+            a.store(&coeffA[i]);
+            (m - (a * m)).store(&coeffB[i]);
+        }
     }
-    else
+
+    float *const meanA = mean;
+    float *const meanB = meanSq;
+    box_mean_float4(coeffA, meanA, tmp, lw, lh, lowRadius);
+    box_mean_float4(coeffB, meanB, tmp, lw, lh, lowRadius);
+
+    // Apply the coefficients, bilinearly interpolated, to the full-resolution image.
+    process_in_parallel_bands(h, 16, [=](const uint y0, const uint y1, const uint)
     {
-        const u8 kernelW = ((int(kernelS) * 2) + 1);
-        cv::blur(output, output, cv::Size(kernelW, kernelW));
+        struct sample_point_s
+        {
+            int p0, p1;
+            float4_s weight0, weight1;
+        };
+
+        const auto sample_point = [=](const int x, const int length)->sample_point_s
+        {
+            const float f = std::max(0.0f, (((x + 0.5f) / scale) - 0.5f));
+            const int p0 = std::min(int(f), (length - 1));
+            const float weight = (f - p0);
+
+            return {p0, std::min((p0 + 1), (length - 1)), float4_s::splat(1 - weight), float4_s::splat(weight)};
+        };
+
+        std::vector<sample_point_s> columns(w);
+        for (int x = 0; x < w; x++)
+        {
+            columns[x] = sample_point(x, lw);
+        }
+
+        for (uint y = y0; y < y1; y++)
+        {
+            const sample_point_s row = sample_point(y, lh);
+
+            for (int x = 0; x < w; x++)
+            {
+                const sample_point_s &column = columns[x];
+
+                const auto interpolated = [&](const float *const plane)
+                {
+                    const float *const top = &plane[row.p0 * lw * 4];
+                    const float *const bottom = &plane[row.p1 * lw * 4];
+
+                    return ((((float4_s::load(&top[column.p0 * 4]) * column.weight0) + (float4_s::load(&top[column.p1 * 4]) * column.weight1)) * row.weight0) +
+                            (((float4_s::load(&bottom[column.p0 * 4]) * column.weight0) + (float4_s::load(&bottom[column.p1 * 4]) * column.weight1)) * row.weight1));
+                };
+
+                u8 *const pixel = &pixels[((y * w) + x) * NUM_COLOR_CHANNELS];
+                ((interpolated(meanA) * float4_s::from_pixel(pixel)) + interpolated(meanB)).store_bgr(pixel);
+            }
+        }
+    });
+
+    return;
+}
+
+// Real-time edge-preserving denoising, with a guided filter; optionally followed
+// by a motion-adaptive temporal average with the previous frame. For a slower
+// but higher-quality alternative, see filter_func_denoise_nonlocal_means().
+//
+void filter_func_denoise_guided(FILTER_FUNC_PARAMS)
+{
+    VALIDATE_FILTER_INPUT
+
+    const int radius = std::max(1, int(params[filter_widget_denoise_guided_s::OFFS_RADIUS]));
+    const u8 strength = params[filter_widget_denoise_guided_s::OFFS_STRENGTH];
+
+    if (!strength)
+    {
+        return;
     }
+
+    guided_filter(pixels, *r, radius, (strength * strength), state);
+
+    // Average each pixel with its value in the previous output frame, unless it
+    // has changed by more than the strength, in which case it's taken to have
+    // moved. The previous frame gets weight 3/4, rounded.
+    if (params[filter_widget_denoise_guided_s::OFFS_TYPE] == filter_widget_denoise_guided_s::FILTER_TYPE_TEMPORAL)
+    {
+        const uint numPixels = (r->w * r->h);
+        u8 *const prevPixels = state->buffer(0, (numPixels * NUM_COLOR_CHANNELS));
+        uint i = 0;
+
+#if defined(__SSE2__)
+        const __m128i thresholdV = _mm_set1_epi8(char(strength));
+        const __m128i colorMask = _mm_set1_epi32(0x00ffffff);
+
+        for (; (i + 4) <= numPixels; i += 4)
+        {
+            __m128i *const cur = (__m128i*)&pixels[i * NUM_COLOR_CHANNELS];
+            __m128i *const prev = (__m128i*)&prevPixels[i * NUM_COLOR_CHANNELS];
+            const __m128i a = _mm_loadu_si128(cur);
+            const __m128i b = _mm_loadu_si128(prev);
+            const __m128i averaged = _mm_avg_epu8(b, _mm_avg_epu8(a, b));
+            const __m128i toAverage = _mm_andnot_si128(sse2_pixels_exceeding(a, b, thresholdV), colorMask);
+            const __m128i result = _mm_or_si128(_mm_and_si128(toAverage, averaged), _mm_andnot_si128(toAverage, a));
+
+            _mm_storeu_si128(cur, result);
+            _mm_storeu_si128(prev, result);
+        }
+#endif
+
+        for (; i < numPixels; i++)
+        {
+            u8 *const cur = &pixels[i * NUM_COLOR_CHANNELS];
+            u8 *const prev = &prevPixels[i * NUM_COLOR_CHANNELS];
+
+            if ((abs(cur[0] - prev[0]) <= strength) &&
+                (abs(cur[1] - prev[1]) <= strength) &&
+                (abs(cur[2] - prev[2]) <= strength))
+            {
+                for (uint c = 0; c < 3; c++)
+                {
+                    cur[c] = ((prev[c] + ((cur[c] + prev[c] + 1) / 2) + 1) / 2);
+                }
+            }
+
+            memcpy(prev, cur, NUM_COLOR_CHANNELS);
+        }
+    }
+
+    return;
+}
+
+void filter_func_fused_pointwise(u8 *const pixels, const resolution_s *const r, const std::vector<fused_filter_s> &filters)
+{
+    k_assert(r->bpp == 32, "This filter expects 32-bit source color.");
+
+    // The number of pixels each filter processes in turn before the next one takes
+    // over; few enough for them to stay in the CPU's cache in the meantime.
+    const uint spanLength = 4096;
+
+    const uint numPixels = (r->w * r->h);
+
+    for (uint firstPixel = 0; firstPixel < numPixels; firstPixel += spanLength)
+    {
+        const uint spanNumPixels = std::min(spanLength, (numPixels - firstPixel));
+
+        for (const fused_filter_s &filter: filters)
+        {
+            filter.applyToSpan(pixels, firstPixel, spanNumPixels, r, filter.params, filter.state);
+        }
+    }
+
+    return;
+}
+
+void filter_func_fused_remap(u8 *const pixels, const resolution_s *const r, const std::vector<fused_filter_s> &filters)
+{
+    k_assert(r->bpp == 32, "This filter expects 32-bit source color.");
+    k_assert(!filters.empty(), "Expected one or more filters to remap with.");
+
+#ifdef USE_OPENCV
+    cv::Mat output = cv::Mat(r->h, r->w, CV_8UC4, pixels);
+
+    cv::Matx33d matrix = cv::Matx33d::eye();
+    bool isInterpolated = false;
+
+    // The state of the filter whose transformation was accumulated first; whose
+    // buffers the remapping uses.
+    filter_state_s *remapState = nullptr;
+
+    // Samples the frame through the filters' transformations accumulated so far.
+    const auto remap = [&]
+    {
+        if (remapState)
+        {
+            apply_geometric_transform(pixels, *r, matrix, isInterpolated, remapState);
+        }
+
+        matrix = cv::Matx33d::eye();
+        isInterpolated = false;
+        remapState = nullptr;
+
+        return;
+    };
+
+    for (const fused_filter_s &filter: filters)
+    {
+        const geometric_transform_s transform = geometric_transform(filter, *r);
+
+        matrix = (transform.matrix * matrix);
+        isInterpolated = (isInterpolated || transform.isInterpolated);
+        remapState = (remapState? remapState : filter.state);
+
+        // The filters that follow see the frame as blacked out around the mask,
+        // so it needs to be applied before their transformations.
+        if (!transform.mask.empty())
+        {
+            remap();
+            black_out_around(output, transform.mask);
+        }
+        // Likewise, they see the frame as clipped to its bounds and resampled by
+        // any transformation other than a shuffling of its pixels; e.g. rotating
+        // by 45 degrees and then back leaves the corners black, rather than undoing
+        // the rotation.
+        else if (!is_pixel_permutation(transform.matrix, *r))
+        {
+            remap();
+        }
+    }
+
+    remap();
+#else
+    (void)pixels;
 #endif
 
     return;
@@ -8,10 +8,94 @@
 #ifndef FILTER_FUNCTIONS_H
 #define FILTER_FUNCTIONS_H
 
+#include <vector>
+#include <ctime>
 #include "filter/filter.h"
 
+// Data that a filter instance keeps from one frame to the next (e.g. the
+// previous frame, for temporal filters) or uses as scratch space. Each filter
+// instance has its own, so that instances of the same filter type don't share
+// their history, and can be applied concurrently.
+struct filter_state_s
+{
+    // Returns the state's buffer of the given index (0-3), sized to the given
+    // number of bytes. The buffer is allocated on first use, and is zeroed
+    // whenever its size changes - i.e. when the frame's resolution does.
+    u8* buffer(const unsigned idx, const unsigned numBytes)
+    {
+        std::vector<u8> &buffer = this->buffers[idx];
+
+        if (buffer.size() != numBytes)
+        {
+            std::vector<u8>(numBytes, 0).swap(buffer);
+        }
+
+        return buffer.data();
+    }
+
+    // Frees the buffers, and resets the state to what it was before the filter
+    // was first applied.
+    void release(void)
+    {
+        for (auto &buffer: this->buffers)
+        {
+            std::vector<u8>().swap(buffer);
+        }
+
+        this->numUniqueFrames = 0;
+        this->uniqueFramesPerSecond = 0;
+        this->timer = 0;
+        this->remapTablesKey.clear();
+
+        return;
+    }
+
+    // For the unique count filter.
+    unsigned numUniqueFrames = 0;
+    unsigned uniqueFramesPerSecond = 0;
+    time_t timer = 0;
+
+    // For the geometric filters: the transformation, frame resolution, and
+    // interpolation for which the remap tables in buffers 2 and 3 were computed.
+    std::vector<double> remapTablesKey;
+
+private:
+    std::vector<u8> buffers[4];
+};
+
 // The parameters that each filter function must accept.
-#define FILTER_FUNC_PARAMS u8 *const pixels /*32-bit BGRA*/, const resolution_s *const r, const u8 *const params/*filter parameters, like a blur's radius*/
+#define FILTER_FUNC_PARAMS u8 *const pixels /*32-bit BGRA*/, const resolution_s *const r, const u8 *const params/*filter parameters, like a blur's radius*/, filter_state_s *const state/*the filter instance's state*/
+
+typedef void (*filter_function_t)(FILTER_FUNC_PARAMS);
+
+// Point-wise filters - those whose result for a pixel depends only on that pixel
+// (and the filter's state for it) - also provide a function that applies the
+// filter to a span of the frame's pixels, so that a run of such filters can be
+// applied together, span by span, in a single pass over the frame.
+#define FILTER_SPAN_FUNC_PARAMS u8 *const pixels /*32-bit BGRA*/, const unsigned firstPixel, const unsigned numPixels, const resolution_s *const r, const u8 *const params, filter_state_s *const state
+
+typedef void (*filter_span_function_t)(FILTER_SPAN_FUNC_PARAMS);
+
+enum class filter_type_enum_e;
+
+// A filter in a run of filters that are applied together as one.
+struct fused_filter_s
+{
+    filter_type_enum_e type;
+    filter_span_function_t applyToSpan;
+    const u8 *params;
+    filter_state_s *state;
+};
+
+// Applies the given run of point-wise filters in a single pass over the frame.
+void filter_func_fused_pointwise(u8 *const pixels, const resolution_s *const r, const std::vector<fused_filter_s> &filters);
+
+// Applies the given run of geometric filters (flip, rotate, crop), combining
+// the transformations of those that only shuffle the frame's pixels (flips)
+// with the next one, so that the frame is sampled once for each of the others.
+void filter_func_fused_remap(u8 *const pixels, const resolution_s *const r, const std::vector<fused_filter_s> &filters);
+
+void filter_span_denoise_temporal(FILTER_SPAN_FUNC_PARAMS);
 
 void filter_func_blur(FILTER_FUNC_PARAMS);
 void filter_func_unique_count(FILTER_FUNC_PARAMS);
@@ -20,6 +104,7 @@ void filter_func_delta_histogram(FILTER_FUNC_PARAMS);
 void filter_func_decimate(FILTER_FUNC_PARAMS);
 void filter_func_denoise_temporal(FILTER_FUNC_PARAMS);
 void filter_func_denoise_nonlocal_means(FILTER_FUNC_PARAMS);
+void filter_func_denoise_guided(FILTER_FUNC_PARAMS);
 void filter_func_sharpen(FILTER_FUNC_PARAMS);
 void filter_func_median(FILTER_FUNC_PARAMS);
 void filter_func_crop(FILTER_FUNC_PARAMS);
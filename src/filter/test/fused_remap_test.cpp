@@ -0,0 +1,146 @@
+/*
+ * 2020 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ * Verifies that applying a run of geometric filters fused together (see
+ * filter_func_fused_remap()) gives the same frame as applying them one by one.
+ *
+ * Build and run with qmake: "qmake fused_remap_test.pro && make && ./fused_remap_test".
+ * Exits with 0 if all of the checks pass; 1 otherwise.
+ *
+ */
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <vector>
+#include "display/qt/widgets/filter_widgets.h"
+#include "filter/filter_funcs.h"
+
+// The frame's dimensions are deliberately unequal and even, so that rotating
+// it by any angle loses some of its pixels out of bounds.
+static const resolution_s RESOLUTION = {64, 48, 32};
+
+// How much a color channel may differ between the fused and unfused frames.
+static const int MAX_CHANNEL_DIFFERENCE = 2;
+
+// Stand-ins for the parts of VCS that the filter functions call into.
+void kd_show_headless_assert_error_message(const char *const msg, const char *const filename, const uint lineNum)
+{
+    fprintf(stderr, "Assertion failure in %s {%u}: \"%s\"\n", filename, lineNum, msg);
+
+    return;
+}
+
+void klog_log_error(const char *const msg, ...)
+{
+    va_list args;
+    va_start(args, msg);
+    vfprintf(stderr, msg, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+
+    return;
+}
+
+void klog_log_debug(const char *const, ...) { return; }
+void klog_log_info(const char *const, ...) { return; }
+
+struct test_filter_s
+{
+    filter_type_enum_e type;
+    filter_function_t apply;
+    u8 params[FILTER_PARAMETER_ARRAY_LENGTH];
+};
+
+static test_filter_s rotate(const double angle, const double scale)
+{
+    test_filter_s filter = {filter_type_enum_e::rotate, filter_func_rotate, {0}};
+
+    *(i16*)&(filter.params[filter_widget_rotate_s::OFFS_ROT]) = i16(angle * 10);
+    *(i16*)&(filter.params[filter_widget_rotate_s::OFFS_SCALE]) = i16(scale * 100);
+
+    return filter;
+}
+
+// A crop that stretches the given region over the frame.
+static test_filter_s crop(const uint x, const uint y, const uint w, const uint h)
+{
+    test_filter_s filter = {filter_type_enum_e::crop, filter_func_crop, {0}};
+
+    *(u16*)&(filter.params[filter_widget_crop_s::OFFS_X]) = x;
+    *(u16*)&(filter.params[filter_widget_crop_s::OFFS_Y]) = y;
+    *(u16*)&(filter.params[filter_widget_crop_s::OFFS_WIDTH]) = w;
+    *(u16*)&(filter.params[filter_widget_crop_s::OFFS_HEIGHT]) = h;
+    filter.params[filter_widget_crop_s::OFFS_SCALER] = 0; // Linear.
+
+    return filter;
+}
+
+// Returns a frame with no black pixels, so that any pixels blacked out by the
+// filters stand out.
+static std::vector<u8> test_frame(void)
+{
+    std::vector<u8> pixels(RESOLUTION.w * RESOLUTION.h * 4);
+
+    for (uint i = 0; i < (RESOLUTION.w * RESOLUTION.h); i++)
+    {
+        pixels[(i * 4) + 0] = u8(1 + ((i * 7) % 255));
+        pixels[(i * 4) + 1] = u8(1 + ((i * 13) % 255));
+        pixels[(i * 4) + 2] = u8(1 + ((i * 29) % 255));
+        pixels[(i * 4) + 3] = 255;
+    }
+
+    return pixels;
+}
+
+// Applies the given filters to the test frame both one by one and fused, and
+// returns true if the results match. Some filters resample the frame slightly
+// differently when fused (e.g. a crop via a remap rather than cv::resize()), so
+// the channels are allowed to differ by rounding; whereas pixels lost by one but
+// not the other differ by far more.
+static bool fused_equals_unfused(const char *const name, const std::vector<test_filter_s> &filters)
+{
+    std::vector<u8> unfused = test_frame();
+    std::vector<u8> fused = test_frame();
+    std::vector<filter_state_s> unfusedStates(filters.size());
+    std::vector<filter_state_s> fusedStates(filters.size());
+    std::vector<fused_filter_s> run;
+
+    for (uint i = 0; i < filters.size(); i++)
+    {
+        filters[i].apply(unfused.data(), &RESOLUTION, filters[i].params, &unfusedStates[i]);
+        run.push_back({filters[i].type, nullptr, filters[i].params, &fusedStates[i]});
+    }
+
+    filter_func_fused_remap(fused.data(), &RESOLUTION, run);
+
+    int maxDifference = 0;
+
+    for (uint i = 0; i < unfused.size(); i++)
+    {
+        maxDifference = std::max(maxDifference, std::abs(int(unfused[i]) - int(fused[i])));
+    }
+
+    const bool isEqual = (maxDifference <= MAX_CHANNEL_DIFFERENCE);
+
+    printf("%s: %s (channels differ by up to %d)\n", (isEqual? "PASS" : "FAIL"), name, maxDifference);
+
+    return isEqual;
+}
+
+int main(void)
+{
+    bool isOk = true;
+
+    isOk &= fused_equals_unfused("Rotate by +45, then by -45 degrees", {rotate(45, 1), rotate(-45, 1)});
+    isOk &= fused_equals_unfused("Rotate by +90, then by -90 degrees", {rotate(90, 1), rotate(-90, 1)});
+    isOk &= fused_equals_unfused("Rotate by 90 degrees four times", {rotate(90, 1), rotate(90, 1), rotate(90, 1), rotate(90, 1)});
+    isOk &= fused_equals_unfused("Rotate by 30 degrees at 2x, then by -30 at 0.5x", {rotate(30, 2), rotate(-30, 0.5)});
+    isOk &= fused_equals_unfused("Stretch-crop, then rotate at 0.5x", {crop(16, 12, 32, 24), rotate(10, 0.5)});
+
+    return (isOk? 0 : 1);
+}
@@ -0,0 +1,19 @@
+# Builds the test of fused geometric filters (fused_remap_test.cpp). Linux only;
+# needs OpenCV, as the filters do.
+
+DEFINES += USE_OPENCV
+
+QT += core gui
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+TARGET = fused_remap_test
+TEMPLATE = app
+CONFIG += console c++11
+
+INCLUDEPATH += $$PWD/../../
+
+LIBS += -lopencv_imgproc -lopencv_core -lopencv_photo
+
+SOURCES += \
+    fused_remap_test.cpp \
+    ../filter_funcs.cpp
@@ -16,6 +16,9 @@
 #include "display/display.h"
 #include "common/globals.h"
 #include "capture/alias.h"
+#include "record/loopback_output.h"
+#include "record/shared_output.h"
+#include "record/frame_export.h"
 #include "record/record.h"
 #include "scaler/scaler.h"
 #include "filter/filter.h"
@@ -39,6 +42,9 @@ static void cleanup_all(void)
     kvideopreset_release();
 
     if (krecord_is_recording()) krecord_stop_recording();
+    kexport_release();
+    kshm_release();
+    kloopback_release();
 
     // Call this last.
     kmem_deallocate_memory_cache();
@@ -78,6 +84,9 @@ static bool initialize_all(void)
 
     if (!PROGRAM_EXIT_REQUESTED) ka_initialize_aliases();
     if (!PROGRAM_EXIT_REQUESTED) krecord_initialize();
+    if (!PROGRAM_EXIT_REQUESTED) kexport_initialize();
+    if (!PROGRAM_EXIT_REQUESTED) kshm_initialize();
+    if (!PROGRAM_EXIT_REQUESTED) kloopback_initialize();
     if (!PROGRAM_EXIT_REQUESTED) klog_initialize();
     if (!PROGRAM_EXIT_REQUESTED) kvideopreset_initialize();
     if (!PROGRAM_EXIT_REQUESTED) ks_initialize_scaler();
@@ -0,0 +1,405 @@
+/*
+ * 2020 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ * Exports frames from the capture pipeline as lossless still images; either a
+ * single frame, or every frame for a given length of time.
+ *
+ * Each frame to be exported is copied into a reference-counted buffer from a
+ * small pool, and handed to a pool of worker threads for encoding and saving to
+ * disk. A buffer is back in the pool once the worker is done with it. If all
+ * of the buffers are in use when a new frame arrives - i.e. the disk or the
+ * encoding can't keep up - the frame is dropped and counted as such, rather
+ * than the capture pipeline being made to wait.
+ *
+ */
+
+#include <QtConcurrent/QtConcurrent>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QDateTime>
+#include <QImage>
+#include <QFile>
+#include <QDir>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include "common/propagate/app_events.h"
+#include "display/display.h"
+#include "common/globals.h"
+#include "capture/capture_api.h"
+#include "capture/capture.h"
+#include "scaler/scaler.h"
+#include "record/frame_export.h"
+
+// A frame waiting to be, or being, exported.
+struct export_frame_s
+{
+    std::vector<u8> pixels;
+    resolution_s resolution;
+    capture_pixel_format_e pixelFormat;
+
+    frame_export_format_e format;
+    QString filename;
+};
+
+// The buffers into which frames are copied for exporting. A buffer is free when
+// the pool holds the only reference to it.
+static std::vector<std::shared_ptr<export_frame_s>> FRAME_POOL;
+
+// The worker threads that encode and save the frames.
+static QThreadPool WORKER_POOL;
+
+static struct export_s
+{
+    bool isActive = false;
+
+    frame_export_settings_s settings;
+
+    // Time elapsed since the export was started.
+    QElapsedTimer timer;
+
+    // The path and base name of the exported frames' files, to which each frame
+    // appends its index and the file suffix.
+    QString filenameBase;
+
+    uint nextFrameIdx = 0;
+
+    // Frames saved to disk; and frames discarded because no buffer was free, or
+    // that couldn't be saved. The latter two are written only by the main
+    // thread and by the workers, respectively.
+    std::atomic<uint> numFramesExported{0};
+    uint numFramesDropped = 0;
+    std::atomic<uint> numFramesFailed{0};
+} EXPORT;
+
+// Encodes the given 32-bit BGRA image into the QOI format (https://qoiformat.org),
+// as RGB.
+//
+static std::vector<u8> qoi_encoded(const u8 *const bgra, const resolution_s &r)
+{
+    enum qoi_op_e : u8
+    {
+        QOI_OP_INDEX = 0x00,
+        QOI_OP_DIFF  = 0x40,
+        QOI_OP_LUMA  = 0x80,
+        QOI_OP_RUN   = 0xc0,
+        QOI_OP_RGB   = 0xfe,
+    };
+
+    struct pixel_s
+    {
+        u8 r, g, b, a;
+
+        bool operator==(const pixel_s &other) const
+        {
+            return ((this->r == other.r) && (this->g == other.g) && (this->b == other.b) && (this->a == other.a));
+        }
+    };
+
+    std::vector<u8> qoi;
+    qoi.reserve(14 + (r.w * r.h * 4) + 8);
+
+    const auto push_u32 = [&qoi](const u32 value)
+    {
+        qoi.push_back(u8(value >> 24));
+        qoi.push_back(u8(value >> 16));
+        qoi.push_back(u8(value >> 8));
+        qoi.push_back(u8(value));
+    };
+
+    // Header: magic, width, height, number of channels, colorspace (sRGB).
+    qoi.insert(qoi.end(), {'q', 'o', 'i', 'f'});
+    push_u32(r.w);
+    push_u32(r.h);
+    qoi.push_back(3);
+    qoi.push_back(0);
+
+    // The pixels are all opaque, so their alpha needn't be stored; but the
+    // decoder tracks it, and starts with an index of transparent black.
+    pixel_s index[64] = {};
+    pixel_s prev = {0, 0, 0, 255};
+    uint run = 0;
+
+    const uint numPixels = (r.w * r.h);
+    for (uint i = 0; i < numPixels; i++)
+    {
+        const pixel_s px = {bgra[(i * 4) + 2], bgra[(i * 4) + 1], bgra[(i * 4) + 0], 255};
+
+        if (px == prev)
+        {
+            run++;
+
+            if ((run == 62) || (i == (numPixels - 1)))
+            {
+                qoi.push_back(QOI_OP_RUN | (run - 1));
+                run = 0;
+            }
+
+            continue;
+        }
+
+        if (run)
+        {
+            qoi.push_back(QOI_OP_RUN | (run - 1));
+            run = 0;
+        }
+
+        const uint hash = (((px.r * 3) + (px.g * 5) + (px.b * 7) + (px.a * 11)) % 64);
+
+        if (index[hash] == px)
+        {
+            qoi.push_back(QOI_OP_INDEX | hash);
+        }
+        else
+        {
+            index[hash] = px;
+
+            const int vr = i8(px.r - prev.r);
+            const int vg = i8(px.g - prev.g);
+            const int vb = i8(px.b - prev.b);
+            const int vgr = (vr - vg);
+            const int vgb = (vb - vg);
+
+            if ((vr > -3) && (vr < 2) &&
+                (vg > -3) && (vg < 2) &&
+                (vb > -3) && (vb < 2))
+            {
+                qoi.push_back(QOI_OP_DIFF | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2));
+            }
+            else if ((vgr > -9) && (vgr < 8) &&
+                     (vg > -33) && (vg < 32) &&
+                     (vgb > -9) && (vgb < 8))
+            {
+                qoi.push_back(QOI_OP_LUMA | (vg + 32));
+                qoi.push_back(((vgr + 8) << 4) | (vgb + 8));
+            }
+            else
+            {
+                qoi.insert(qoi.end(), {QOI_OP_RGB, px.r, px.g, px.b});
+            }
+        }
+
+        prev = px;
+    }
+
+    // End marker.
+    qoi.insert(qoi.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+
+    return qoi;
+}
+
+// Encodes the given frame into its image format, and saves it into its file.
+// Called by the worker threads.
+//
+static void export_frame(const export_frame_s &frame)
+{
+    const QImage::Format imageFormat = [&frame]()->QImage::Format
+    {
+        switch (frame.pixelFormat)
+        {
+            case capture_pixel_format_e::rgb_555: return QImage::Format_RGB555;
+            case capture_pixel_format_e::rgb_565: return QImage::Format_RGB16;
+            case capture_pixel_format_e::rgb_888:
+            default: return QImage::Format_RGB32;
+        }
+    }();
+
+    const QImage image(frame.pixels.data(),
+                       frame.resolution.w, frame.resolution.h,
+                       (frame.resolution.w * (frame.resolution.bpp / 8)),
+                       imageFormat);
+
+    bool isSaved = false;
+
+    if (frame.format == frame_export_format_e::qoi)
+    {
+        // The QOI encoder takes 32-bit pixels.
+        const QImage bgraImage = ((imageFormat == QImage::Format_RGB32)? image : image.convertToFormat(QImage::Format_RGB32));
+        const std::vector<u8> qoi = qoi_encoded(bgraImage.constBits(), {frame.resolution.w, frame.resolution.h, 32});
+
+        QFile file(frame.filename);
+        isSaved = (file.open(QIODevice::WriteOnly) &&
+                   (file.write((const char*)qoi.data(), qoi.size()) == qint64(qoi.size())));
+    }
+    else
+    {
+        // A quality of 85 corresponds roughly to zlib's compression level 1,
+        // which trades file size for encoding speed.
+        isSaved = image.save(frame.filename, "PNG", 85);
+    }
+
+    if (isSaved)
+    {
+        EXPORT.numFramesExported++;
+    }
+    else
+    {
+        EXPORT.numFramesFailed++;
+        NBENE(("Failed to export a frame into '%s'.", frame.filename.toStdString().c_str()));
+    }
+
+    return;
+}
+
+// Hands VCS's most recent frame to the worker threads for exporting.
+//
+static void export_new_frame(void)
+{
+    if (EXPORT.settings.duration &&
+        (EXPORT.timer.elapsed() > EXPORT.settings.duration))
+    {
+        kexport_stop_export();
+        return;
+    }
+
+    const auto freeFrame = std::find_if(FRAME_POOL.begin(), FRAME_POOL.end(),
+                                        [](const std::shared_ptr<export_frame_s> &f){ return (f.use_count() == 1); });
+
+    if (freeFrame == FRAME_POOL.end())
+    {
+        EXPORT.numFramesDropped++;
+    }
+    else
+    {
+        const std::shared_ptr<export_frame_s> frame = *freeFrame;
+
+        const u8 *pixels = nullptr;
+
+        if (EXPORT.settings.source == frame_export_source_e::raw_capture)
+        {
+            const captured_frame_s &capturedFrame = kc_capture_api().get_frame_buffer();
+
+            pixels = capturedFrame.pixels.ptr();
+            frame->resolution = capturedFrame.r;
+            frame->pixelFormat = capturedFrame.pixelFormat;
+        }
+        else
+        {
+            pixels = ks_scaler_output_as_raw_ptr();
+            frame->resolution = ks_scaler_output_resolution();
+            frame->resolution.bpp = 32;
+            frame->pixelFormat = capture_pixel_format_e::rgb_888;
+        }
+
+        const uint numBytes = (frame->resolution.w * frame->resolution.h * (frame->resolution.bpp / 8));
+        frame->pixels.resize(numBytes);
+        memcpy(frame->pixels.data(), pixels, numBytes);
+
+        frame->format = EXPORT.settings.format;
+        frame->filename = QString("%1%2.%3").arg(EXPORT.filenameBase)
+                                            .arg(EXPORT.nextFrameIdx++, 6, 10, QChar('0'))
+                                            .arg((frame->format == frame_export_format_e::qoi)? "qoi" : "png");
+
+        QtConcurrent::run(&WORKER_POOL, [frame]{ export_frame(*frame); });
+    }
+
+    // A single-frame export is done once it has had its frame.
+    if (!EXPORT.settings.duration)
+    {
+        kexport_stop_export();
+    }
+
+    return;
+}
+
+void kexport_initialize(void)
+{
+    WORKER_POOL.setMaxThreadCount(std::max(1, (QThread::idealThreadCount() / 2)));
+
+    // Enough buffers to keep each worker busy while the next frames come in.
+    FRAME_POOL.resize(((WORKER_POOL.maxThreadCount() * 2) + 2));
+    for (auto &frame: FRAME_POOL)
+    {
+        frame = std::make_shared<export_frame_s>();
+    }
+
+    ke_events().scaler.newFrame->subscribe([]
+    {
+        if (kexport_is_exporting())
+        {
+            export_new_frame();
+        }
+    });
+
+    return;
+}
+
+void kexport_release(void)
+{
+    kexport_stop_export();
+
+    // Let the workers finish saving the frames they've been given.
+    WORKER_POOL.waitForDone();
+
+    FRAME_POOL.clear();
+
+    return;
+}
+
+// Starts exporting the frames that the capture pipeline produces from now on.
+// Returns true if successful; false otherwise, having notified the user of the
+// error.
+//
+bool kexport_start_export(const frame_export_settings_s &settings)
+{
+    if (kexport_is_exporting())
+    {
+        kexport_stop_export();
+    }
+
+    const QDir directory(QString::fromStdString(settings.directory));
+    if (settings.directory.empty() ||
+        !directory.exists())
+    {
+        kd_show_headless_error_message("VCS can't export frames",
+                                       ("The directory \"" + settings.directory + "\" doesn't exist.").c_str());
+        return false;
+    }
+
+    EXPORT.settings = settings;
+    EXPORT.filenameBase = directory.filePath(QString("vcs_%1_").arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss")));
+    EXPORT.nextFrameIdx = 0;
+    EXPORT.numFramesExported = 0;
+    EXPORT.numFramesDropped = 0;
+    EXPORT.numFramesFailed = 0;
+    EXPORT.timer.start();
+    EXPORT.isActive = true;
+
+    DEBUG(("Exporting frames into '%s'.", EXPORT.filenameBase.toStdString().c_str()));
+
+    return true;
+}
+
+void kexport_stop_export(void)
+{
+    if (!EXPORT.isActive)
+    {
+        return;
+    }
+
+    EXPORT.isActive = false;
+
+    INFO(("Frame export finished: %u frame(s) queued for saving, %u dropped.",
+          EXPORT.nextFrameIdx, EXPORT.numFramesDropped));
+
+    return;
+}
+
+bool kexport_is_exporting(void)
+{
+    return EXPORT.isActive;
+}
+
+uint kexport_num_frames_exported(void)
+{
+    return EXPORT.numFramesExported;
+}
+
+uint kexport_num_frames_dropped(void)
+{
+    return (EXPORT.numFramesDropped + EXPORT.numFramesFailed);
+}
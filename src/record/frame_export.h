@@ -0,0 +1,61 @@
+/*
+ * 2020 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+#ifndef FRAME_EXPORT_H
+#define FRAME_EXPORT_H
+
+#include <string>
+#include "common/types.h"
+
+enum class frame_export_format_e
+{
+    // PNG, with fast (low-level) compression.
+    png,
+
+    // The Quite OK Image format; lossless like PNG, but much faster to encode.
+    qoi
+};
+
+enum class frame_export_source_e
+{
+    // Frames as they're shown in the output window: filtered, anti-teared, and
+    // scaled.
+    scaler_output,
+
+    // Frames as they're received from the capture device.
+    raw_capture
+};
+
+struct frame_export_settings_s
+{
+    // The directory into which the frames' image files are saved.
+    std::string directory;
+
+    frame_export_format_e format = frame_export_format_e::png;
+
+    frame_export_source_e source = frame_export_source_e::scaler_output;
+
+    // For how many milliseconds to export every frame; or 0 to export just the
+    // next frame.
+    uint duration = 0;
+};
+
+bool kexport_start_export(const frame_export_settings_s &settings);
+
+void kexport_stop_export(void);
+
+bool kexport_is_exporting(void);
+
+uint kexport_num_frames_exported(void);
+
+uint kexport_num_frames_dropped(void);
+
+void kexport_initialize(void);
+
+void kexport_release(void);
+
+#endif
@@ -0,0 +1,934 @@
+/*
+ * 2020 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ * Encodes recorded frames into a video file via FFmpeg's libraries, giving the
+ * recorder control over the codec and its settings.
+ *
+ * MP4 files are written fragmented, so that a recording cut short - e.g. by VCS
+ * crashing - remains playable up to its last fragment.
+ *
+ */
+
+#ifdef USE_LIBAV
+
+extern "C"
+{
+    #include <libavformat/avformat.h>
+    #include <libavcodec/avcodec.h>
+    #include <libavutil/imgutils.h>
+    #include <libavutil/mathematics.h>
+    #include <libavutil/opt.h>
+}
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include "record/libav_encoder.h"
+#include "common/globals.h"
+#include "scaler/scaler.h"
+
+// The time base of variable frame rate videos, in ticks per second.
+static const int VFR_TIME_BASE = 90000;
+
+// The most memory the pre-record ring may take up, in bytes. If the encoded video
+// is large enough to exceed this, the ring will hold less than the requested
+// length of it.
+static const u64 PRERECORD_MAX_BYTES = (512 * 1024 * 1024);
+
+// Returns FFmpeg's description of the given error code.
+static std::string av_error_string(const int errorCode)
+{
+    char buffer[AV_ERROR_MAX_STRING_SIZE] = {0};
+    av_strerror(errorCode, buffer, sizeof(buffer));
+
+    return buffer;
+}
+
+libav_encoder_c::~libav_encoder_c(void)
+{
+    this->release();
+
+    return;
+}
+
+std::string libav_encoder_c::container_suffix(const recording_codec_e codec)
+{
+    switch (codec)
+    {
+        // FFV1 can't go into MP4.
+        case recording_codec_e::ffv1: return "mkv";
+
+        case recording_codec_e::h264:
+        case recording_codec_e::h264_lossless:
+        default: return "mp4";
+    }
+}
+
+bool libav_encoder_c::open(const std::string &filename,
+                           const resolution_s &resolution,
+                           const uint frameRate,
+                           const recording_encoder_settings_s &settings,
+                           const audio_format_s &audioFormat)
+{
+    k_assert(!this->is_open(), "Attempting to open a libav encoder that's already open.");
+
+    this->resolution = resolution;
+    this->frameRate = frameRate;
+    this->filename = filename;
+    this->nextPts = 0;
+    this->isVariableFrameRate = settings.isVariableFrameRate;
+
+    // Timestamps are in frames for constant frame rate videos.
+    const int timeBase = (this->isVariableFrameRate? VFR_TIME_BASE : int(frameRate));
+
+    this->segmentLength = (settings.segmentLength * timeBase);
+    this->segmentIdx = 0;
+    this->segmentStartPts = 0;
+    this->isSegmentKeyframeRequested = false;
+    this->prerecordLength = (settings.prerecordLength * timeBase);
+    this->prerecordBytes = 0;
+    this->numBytesWritten = 0;
+    this->errorString.clear();
+
+    const auto fail = [this](const std::string &reason)->bool
+    {
+        this->errorString = reason;
+        this->release();
+
+        return false;
+    };
+
+    // Pick the codec. The lossless codecs accept BGRA frames directly, so they
+    // need no pixel format conversion.
+    const char *codecName = nullptr;
+    AVPixelFormat pixelFormat = AV_PIX_FMT_NONE;
+    switch (settings.codec)
+    {
+        case recording_codec_e::h264:          codecName = "libx264";    pixelFormat = AV_PIX_FMT_YUV420P; break;
+        case recording_codec_e::h264_lossless: codecName = "libx264rgb"; pixelFormat = AV_PIX_FMT_BGR0;    break;
+        case recording_codec_e::ffv1:          codecName = "ffv1";       pixelFormat = AV_PIX_FMT_BGR0;    break;
+        default: k_assert(0, "Unknown recording codec.");
+    }
+
+    const AVCodec *const codec = avcodec_find_encoder_by_name(codecName);
+    if (!codec)
+    {
+        return fail(std::string("The ") + codecName + " encoder isn't available in this FFmpeg installation.");
+    }
+
+    // The container is needed up front, since it may affect how the codec is set
+    // up; but, when pre-recording, it won't be created until the video is saved.
+    const auto *const container = av_guess_format(nullptr, filename.c_str(), nullptr);
+    if (!container)
+    {
+        return fail("Couldn't determine the video container for \"" + filename + "\".");
+    }
+
+    this->codecContext = avcodec_alloc_context3(codec);
+    if (!this->codecContext)
+    {
+        return fail("Couldn't allocate the encoder.");
+    }
+
+    this->codecContext->width = resolution.w;
+    this->codecContext->height = resolution.h;
+    this->codecContext->pix_fmt = pixelFormat;
+    this->codecContext->time_base = AVRational{1, timeBase};
+    this->codecContext->framerate = AVRational{int(frameRate), 1};
+    this->codecContext->thread_count = settings.numThreads;
+
+    if (pixelFormat == AV_PIX_FMT_YUV420P)
+    {
+        // As produced by ks_convert_bgra_to_yuv420().
+        this->codecContext->colorspace = AVCOL_SPC_BT470BG;
+        this->codecContext->color_range = AVCOL_RANGE_MPEG;
+    }
+
+    if (settings.keyframeInterval)
+    {
+        this->codecContext->gop_size = settings.keyframeInterval;
+    }
+    else if (this->prerecordLength)
+    {
+        // The pre-record ring sheds its oldest video a keyframe interval at a
+        // time, so keep the interval short.
+        this->codecContext->gop_size = frameRate;
+    }
+
+    if (container->flags & AVFMT_GLOBALHEADER)
+    {
+        this->codecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    // Codec-specific options.
+    AVDictionary *options = nullptr;
+    {
+        if ((settings.codec == recording_codec_e::h264) ||
+            (settings.codec == recording_codec_e::h264_lossless))
+        {
+            av_dict_set(&options, "preset", settings.preset.c_str(), 0);
+
+            if (settings.codec == recording_codec_e::h264_lossless)
+            {
+                av_dict_set(&options, "qp", "0", 0);
+            }
+            else
+            {
+                av_dict_set_int(&options, "crf", settings.crf, 0);
+            }
+        }
+        else if (settings.codec == recording_codec_e::ffv1)
+        {
+            // Version 3 supports multithreaded slice encoding.
+            av_dict_set(&options, "level", "3", 0);
+            av_dict_set(&options, "slicecrc", "1", 0);
+        }
+
+        // Any options given by the user as "key=value:key=value" override ours.
+        if (!settings.extraOptions.empty() &&
+            (av_dict_parse_string(&options, settings.extraOptions.c_str(), "=", ":", 0) < 0))
+        {
+            av_dict_free(&options);
+            return fail("Couldn't parse the additional codec arguments \"" + settings.extraOptions + "\".");
+        }
+    }
+
+    int ret = avcodec_open2(this->codecContext, codec, &options);
+    av_dict_free(&options);
+    if (ret < 0)
+    {
+        return fail(std::string("Couldn't open the ") + codecName + " encoder: " + av_error_string(ret));
+    }
+
+    this->frame = av_frame_alloc();
+    this->packet = av_packet_alloc();
+    if (!this->frame || !this->packet)
+    {
+        return fail("Couldn't allocate the encoder's buffers.");
+    }
+
+    this->frame->format = pixelFormat;
+    this->frame->width = resolution.w;
+    this->frame->height = resolution.h;
+
+    if (audioFormat.numChannels &&
+        !this->prerecordLength &&
+        !this->open_audio_encoder(settings, audioFormat))
+    {
+        return fail(this->errorString);
+    }
+
+    // Frames that need converting are converted into a buffer of our own; the
+    // others will be passed to the encoder in place.
+    if (pixelFormat == AV_PIX_FMT_YUV420P)
+    {
+        this->yuvBuffer.resize(av_image_get_buffer_size(AV_PIX_FMT_YUV420P, resolution.w, resolution.h, 1));
+    }
+
+    if (!this->prerecordLength &&
+        !this->open_muxer(&this->formatContext, (this->segmentLength? this->segment_filename(0) : filename), true))
+    {
+        return fail(this->errorString);
+    }
+
+    return true;
+}
+
+// Creates the given video file, and prepares the given muxer for writing the
+// encoder's packets into it. Returns true on success; false otherwise, with an
+// explanation in error_string().
+//
+bool libav_encoder_c::open_muxer(AVFormatContext **muxer,
+                                 const std::string &filename,
+                                 const bool isFragmented)
+{
+    k_assert(!*muxer, "Attempting to open a libav muxer that's already open.");
+
+    const auto fail = [=](const std::string &reason)->bool
+    {
+        this->errorString = reason;
+
+        if (*muxer &&
+            (*muxer)->pb &&
+            !((*muxer)->oformat->flags & AVFMT_NOFILE))
+        {
+            avio_closep(&(*muxer)->pb);
+        }
+
+        avformat_free_context(*muxer);
+        *muxer = nullptr;
+
+        return false;
+    };
+
+    int ret = avformat_alloc_output_context2(muxer, nullptr, nullptr, filename.c_str());
+    if (ret < 0)
+    {
+        return fail("Couldn't create the video container: " + av_error_string(ret));
+    }
+
+    // The video goes into the first stream, and the audio (if any) into the second.
+    for (const AVCodecContext *const encoder: {this->codecContext, this->audioCodecContext})
+    {
+        if (!encoder)
+        {
+            continue;
+        }
+
+        AVStream *const stream = avformat_new_stream(*muxer, nullptr);
+        if (!stream)
+        {
+            return fail("Couldn't allocate the video's streams.");
+        }
+
+        ret = avcodec_parameters_from_context(stream->codecpar, encoder);
+        if (ret < 0)
+        {
+            return fail("Couldn't configure the video's streams: " + av_error_string(ret));
+        }
+
+        stream->time_base = encoder->time_base;
+    }
+
+    if (!((*muxer)->oformat->flags & AVFMT_NOFILE))
+    {
+        ret = avio_open(&(*muxer)->pb, filename.c_str(), AVIO_FLAG_WRITE);
+        if (ret < 0)
+        {
+            return fail("Couldn't open the output file: " + av_error_string(ret));
+        }
+    }
+
+    AVDictionary *options = nullptr;
+    if (isFragmented &&
+        (strcmp((*muxer)->oformat->name, "mp4") == 0))
+    {
+        av_dict_set(&options, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+    }
+
+    ret = avformat_write_header(*muxer, &options);
+    av_dict_free(&options);
+    if (ret < 0)
+    {
+        return fail("Couldn't write the video's header: " + av_error_string(ret));
+    }
+
+    return true;
+}
+
+// Finalizes the given muxer's video file, and closes it.
+//
+void libav_encoder_c::close_muxer(AVFormatContext **muxer)
+{
+    if (!*muxer)
+    {
+        return;
+    }
+
+    av_write_trailer(*muxer);
+
+    if ((*muxer)->pb &&
+        !((*muxer)->oformat->flags & AVFMT_NOFILE))
+    {
+        avio_closep(&(*muxer)->pb);
+    }
+
+    avformat_free_context(*muxer);
+    *muxer = nullptr;
+
+    return;
+}
+
+// Writes the given packet from the given encoder into the given muxer's video
+// file, with the packet's timestamps moved back by the given amount (in units of
+// the video codec's time base). Takes ownership of the packet's data.
+//
+bool libav_encoder_c::write_packet(AVFormatContext *const muxer,
+                                   AVPacket *const packet,
+                                   const AVCodecContext *const encoder,
+                                   const i64 ptsOffset)
+{
+    AVStream *const stream = muxer->streams[(encoder == this->codecContext)? 0 : 1];
+    const i64 offset = av_rescale_q(ptsOffset, this->codecContext->time_base, encoder->time_base);
+
+    if (packet->pts != AV_NOPTS_VALUE) packet->pts -= offset;
+    if (packet->dts != AV_NOPTS_VALUE) packet->dts -= offset;
+
+    av_packet_rescale_ts(packet, encoder->time_base, stream->time_base);
+    packet->stream_index = stream->index;
+
+    const int ret = av_interleaved_write_frame(muxer, packet);
+    if (ret < 0)
+    {
+        NBENE(("The libav encoder failed to write a packet: %s", av_error_string(ret).c_str()));
+        return false;
+    }
+
+    return true;
+}
+
+// Returns the name of the file of the given segment of the video; e.g. for the
+// first segment of "video.mp4", "video_001.mp4".
+//
+std::string libav_encoder_c::segment_filename(const uint segmentIdx) const
+{
+    const std::size_t suffixIdx = this->filename.rfind('.');
+    const std::string suffix = ((suffixIdx == std::string::npos)? "" : this->filename.substr(suffixIdx));
+
+    char number[16];
+    snprintf(number, sizeof(number), "_%03u", (segmentIdx + 1));
+
+    return (this->filename.substr(0, suffixIdx) + number + suffix);
+}
+
+bool libav_encoder_c::encode_frame(const u8 *const pixels, const i64 timestamp)
+{
+    k_assert(this->is_open(), "Attempting to encode a frame with an unopened libav encoder.");
+
+    // The encoder copies the pixels in as it needs, so we can point it at the
+    // caller's buffer, or at our conversion buffer.
+    if (!this->yuvBuffer.empty())
+    {
+        ks_convert_bgra_to_yuv420(pixels, this->resolution, this->yuvBuffer.data());
+
+        av_image_fill_arrays(this->frame->data, this->frame->linesize, this->yuvBuffer.data(),
+                             AV_PIX_FMT_YUV420P, this->resolution.w, this->resolution.h, 1);
+    }
+    else
+    {
+        av_image_fill_arrays(this->frame->data, this->frame->linesize, pixels,
+                             AV_PIX_FMT_BGR0, this->resolution.w, this->resolution.h, 1);
+    }
+
+    // Timestamps must increase from frame to frame, even if the capture's don't
+    // quite.
+    const i64 pts = (this->isVariableFrameRate? std::max<i64>(this->nextPts, av_rescale(timestamp, VFR_TIME_BASE, 1000000000))
+                                              : this->nextPts);
+
+    // Have the next segment begin on this frame, which needs it to be a keyframe.
+    if (this->segmentLength &&
+        !this->isSegmentKeyframeRequested &&
+        (pts >= (this->segmentStartPts + this->segmentLength)))
+    {
+        this->frame->pict_type = AV_PICTURE_TYPE_I;
+        this->isSegmentKeyframeRequested = true;
+    }
+    else
+    {
+        this->frame->pict_type = AV_PICTURE_TYPE_NONE;
+    }
+
+    this->frame->pts = pts;
+    this->nextPts = (pts + 1);
+
+    const int ret = avcodec_send_frame(this->codecContext, this->frame);
+    if (ret < 0)
+    {
+        NBENE(("The libav encoder failed to accept a frame: %s", av_error_string(ret).c_str()));
+        return false;
+    }
+
+    return this->write_encoded_packets(this->codecContext);
+}
+
+// Prepares the encoder for audio of the given format. Returns true on success;
+// false otherwise, with an explanation in error_string().
+//
+bool libav_encoder_c::open_audio_encoder(const recording_encoder_settings_s &settings,
+                                         const audio_format_s &audioFormat)
+{
+    // Lossless audio to go with lossless video, where the container allows.
+    const char *const codecName = ((settings.codec == recording_codec_e::ffv1)? "flac" : "aac");
+
+    const AVCodec *const codec = avcodec_find_encoder_by_name(codecName);
+    if (!codec)
+    {
+        this->errorString = (std::string("The ") + codecName + " audio encoder isn't available in this FFmpeg installation.");
+        return false;
+    }
+
+    this->audioCodecContext = avcodec_alloc_context3(codec);
+    this->audioFrame = av_frame_alloc();
+    if (!this->audioCodecContext || !this->audioFrame)
+    {
+        this->errorString = "Couldn't allocate the audio encoder.";
+        return false;
+    }
+
+    // AAC takes planar floats; FLAC, samples like ours.
+    const AVSampleFormat sampleFormat = ((settings.codec == recording_codec_e::ffv1)? AV_SAMPLE_FMT_S16 : AV_SAMPLE_FMT_FLTP);
+
+    this->audioCodecContext->sample_fmt = sampleFormat;
+    this->audioCodecContext->sample_rate = audioFormat.sampleRate;
+    this->audioCodecContext->time_base = AVRational{1, int(audioFormat.sampleRate)};
+    #if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 28, 100)
+        av_channel_layout_default(&this->audioCodecContext->ch_layout, audioFormat.numChannels);
+    #else
+        this->audioCodecContext->channels = audioFormat.numChannels;
+        this->audioCodecContext->channel_layout = av_get_default_channel_layout(audioFormat.numChannels);
+    #endif
+
+    if (this->codecContext->flags & AV_CODEC_FLAG_GLOBAL_HEADER)
+    {
+        this->audioCodecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    const int ret = avcodec_open2(this->audioCodecContext, codec, nullptr);
+    if (ret < 0)
+    {
+        this->errorString = (std::string("Couldn't open the ") + codecName + " audio encoder: " + av_error_string(ret));
+        return false;
+    }
+
+    // Codecs that take frames of any size get them in chunks of our choosing.
+    this->audioFrame->nb_samples = (this->audioCodecContext->frame_size? this->audioCodecContext->frame_size : 1024);
+    this->audioFrame->format = sampleFormat;
+    this->audioFrame->sample_rate = audioFormat.sampleRate;
+    #if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 28, 100)
+        av_channel_layout_copy(&this->audioFrame->ch_layout, &this->audioCodecContext->ch_layout);
+    #else
+        this->audioFrame->channels = audioFormat.numChannels;
+        this->audioFrame->channel_layout = this->audioCodecContext->channel_layout;
+    #endif
+
+    if (av_frame_get_buffer(this->audioFrame, 0) < 0)
+    {
+        this->errorString = "Couldn't allocate the audio encoder's buffers.";
+        return false;
+    }
+
+    this->audioFormat = audioFormat;
+    this->pendingAudio.clear();
+    this->pendingAudioPts = 0;
+    this->nextAudioPts = -1;
+
+    return true;
+}
+
+bool libav_encoder_c::has_audio(void) const
+{
+    return (this->audioCodecContext != nullptr);
+}
+
+bool libav_encoder_c::encode_audio(const i16 *samples, uint numFrames, i64 timestamp)
+{
+    k_assert(this->is_open(), "Attempting to encode audio with an unopened libav encoder.");
+
+    if (!this->has_audio())
+    {
+        return true;
+    }
+
+    const uint numChannels = this->audioFormat.numChannels;
+    i64 pts = av_rescale(timestamp, this->audioFormat.sampleRate, 1000000000);
+
+    // Skip audio from before the start of the video.
+    if (pts < 0)
+    {
+        const uint numToSkip = uint(std::min<i64>(numFrames, -pts));
+
+        samples += (numToSkip * numChannels);
+        numFrames -= numToSkip;
+        pts += numToSkip;
+    }
+
+    if (!numFrames)
+    {
+        return true;
+    }
+
+    if (this->nextAudioPts < 0)
+    {
+        this->pendingAudioPts = pts;
+        this->nextAudioPts = pts;
+    }
+
+    // Fill gaps in the audio - e.g. from audio having been dropped during capture -
+    // with silence, to keep the rest of the audio in sync with the video. Smaller
+    // discrepancies, as from the audio and video clocks drifting apart, are let be.
+    // A gap of over a second isn't filled but skipped, by restarting the pending
+    // audio at the new timestamp; it's more likely from a jump in the timestamps
+    // than from lost audio, and could otherwise call for any amount of silence.
+    const i64 gap = (pts - this->nextAudioPts);
+    if (gap > i64(this->audioFormat.sampleRate))
+    {
+        NBENE(("Skipping a gap of %lld samples in the audio.", (long long)gap));
+
+        this->pendingAudio.clear();
+        this->pendingAudioPts = pts;
+        this->nextAudioPts = pts;
+    }
+    else if (gap > (this->audioFormat.sampleRate / 50))
+    {
+        this->pendingAudio.insert(this->pendingAudio.end(), (gap * numChannels), 0);
+        this->nextAudioPts += gap;
+    }
+
+    this->pendingAudio.insert(this->pendingAudio.end(), samples, (samples + (numFrames * numChannels)));
+    this->nextAudioPts += numFrames;
+
+    // Encode the audio a codec frame's worth at a time.
+    const uint frameSize = this->audioFrame->nb_samples;
+    std::size_t numSamplesSent = 0;
+
+    while ((this->pendingAudio.size() - numSamplesSent) >= (frameSize * numChannels))
+    {
+        if (!this->send_audio_frame(&this->pendingAudio[numSamplesSent]))
+        {
+            break;
+        }
+
+        numSamplesSent += (frameSize * numChannels);
+        this->pendingAudioPts += frameSize;
+    }
+
+    this->pendingAudio.erase(this->pendingAudio.begin(), (this->pendingAudio.begin() + numSamplesSent));
+
+    return this->write_encoded_packets(this->audioCodecContext);
+}
+
+// Sends a frame's worth of the given audio into the audio encoder, timestamped
+// as the pending audio.
+//
+bool libav_encoder_c::send_audio_frame(const i16 *const samples)
+{
+    const uint numChannels = this->audioFormat.numChannels;
+    const int frameSize = this->audioFrame->nb_samples;
+
+    if (av_frame_make_writable(this->audioFrame) < 0)
+    {
+        return false;
+    }
+
+    if (this->audioFrame->format == AV_SAMPLE_FMT_FLTP)
+    {
+        for (uint c = 0; c < numChannels; c++)
+        {
+            float *const plane = (float*)this->audioFrame->data[c];
+
+            for (int i = 0; i < frameSize; i++)
+            {
+                plane[i] = (samples[(i * numChannels) + c] / 32768.0f);
+            }
+        }
+    }
+    else
+    {
+        memcpy(this->audioFrame->data[0], samples, (frameSize * numChannels * sizeof(i16)));
+    }
+
+    this->audioFrame->pts = this->pendingAudioPts;
+
+    const int ret = avcodec_send_frame(this->audioCodecContext, this->audioFrame);
+    if (ret < 0)
+    {
+        NBENE(("The libav encoder failed to accept audio: %s", av_error_string(ret).c_str()));
+        return false;
+    }
+
+    return true;
+}
+
+// Writes into the video file - or, if pre-recording, into the pre-record ring -
+// any packets the given encoder (video or audio) has finished encoding.
+//
+bool libav_encoder_c::write_encoded_packets(AVCodecContext *const encoder)
+{
+    const bool isVideo = (encoder == this->codecContext);
+
+    while (true)
+    {
+        const int ret = avcodec_receive_packet(encoder, this->packet);
+
+        if ((ret == AVERROR(EAGAIN)) ||
+            (ret == AVERROR_EOF))
+        {
+            return true;
+        }
+        else if (ret < 0)
+        {
+            NBENE(("The libav encoder failed to encode a frame: %s", av_error_string(ret).c_str()));
+            return false;
+        }
+
+        if (this->prerecordLength)
+        {
+            this->push_prerecord_packet(this->packet);
+            av_packet_unref(this->packet);
+
+            continue;
+        }
+
+        // Begin a new segment on the keyframe that was requested for it. Held-back
+        // audio from before the keyframe still belongs to the previous segment.
+        if (isVideo &&
+            this->segmentLength &&
+            (this->packet->flags & AV_PKT_FLAG_KEY) &&
+            (this->packet->pts >= (this->segmentStartPts + this->segmentLength)))
+        {
+            this->write_held_audio_packets(this->packet->pts);
+            this->close_muxer(&this->formatContext);
+
+            this->segmentIdx++;
+            this->segmentStartPts = this->packet->pts;
+            this->isSegmentKeyframeRequested = false;
+
+            if (!this->open_muxer(&this->formatContext, this->segment_filename(this->segmentIdx), true))
+            {
+                NBENE(("The libav encoder failed to begin a new video segment: %s", this->errorString.c_str()));
+            }
+
+            this->write_held_audio_packets(this->segmentStartPts + this->segmentLength);
+        }
+
+        // Hold back audio that belongs in the next segment until the video has
+        // begun it.
+        if (!isVideo &&
+            this->segmentLength &&
+            (av_rescale_q(this->packet->pts, encoder->time_base, this->codecContext->time_base) >= (this->segmentStartPts + this->segmentLength)))
+        {
+            AVPacket *const copy = av_packet_clone(this->packet);
+            av_packet_unref(this->packet);
+
+            if (copy)
+            {
+                this->heldAudioPackets.push_back(copy);
+            }
+            else
+            {
+                NBENE(("The libav encoder failed to allocate an audio packet."));
+            }
+
+            continue;
+        }
+
+        // If a segment's file couldn't be created, its video is lost. Audio that
+        // belongs before the start of the current segment is also discarded.
+        if (!this->formatContext ||
+            (!isVideo && (av_rescale_q(this->packet->pts, encoder->time_base, this->codecContext->time_base) < this->segmentStartPts)))
+        {
+            av_packet_unref(this->packet);
+
+            continue;
+        }
+
+        this->numBytesWritten += this->packet->size;
+        this->write_packet(this->formatContext, this->packet, encoder, this->segmentStartPts);
+    }
+}
+
+// Writes into the current segment the held-back audio packets whose timestamps
+// (in units of the video codec's time base) are before the given one.
+//
+void libav_encoder_c::write_held_audio_packets(const i64 endPts)
+{
+    while (!this->heldAudioPackets.empty())
+    {
+        AVPacket *packet = this->heldAudioPackets.front();
+        const i64 pts = av_rescale_q(packet->pts, this->audioCodecContext->time_base, this->codecContext->time_base);
+
+        if (pts >= endPts)
+        {
+            break;
+        }
+
+        this->heldAudioPackets.pop_front();
+
+        // As in write_encoded_packets(), audio from before the segment's start
+        // is discarded, as is all of it if the segment's file couldn't be created.
+        if (this->formatContext &&
+            (pts >= this->segmentStartPts))
+        {
+            this->numBytesWritten += packet->size;
+            this->write_packet(this->formatContext, packet, this->audioCodecContext, this->segmentStartPts);
+        }
+
+        av_packet_free(&packet);
+    }
+
+    return;
+}
+
+// Appends a copy of the given packet into the pre-record ring, and sheds from
+// the ring its oldest video, a keyframe interval at a time, for as long as
+// what's left is at least as long as the pre-recording's length and within the
+// ring's memory limit.
+//
+void libav_encoder_c::push_prerecord_packet(const AVPacket *const packet)
+{
+    // The ring must begin with a keyframe, so that it can be decoded from its start.
+    if (this->prerecordPackets.empty() &&
+        !(packet->flags & AV_PKT_FLAG_KEY))
+    {
+        return;
+    }
+
+    AVPacket *const copy = av_packet_clone(packet);
+    if (!copy)
+    {
+        NBENE(("The libav encoder failed to allocate a pre-record packet."));
+        return;
+    }
+
+    this->prerecordPackets.push_back(copy);
+    this->prerecordBytes += copy->size;
+
+    while (true)
+    {
+        const auto nextKeyframe = std::find_if((this->prerecordPackets.begin() + 1), this->prerecordPackets.end(),
+                                               [](const AVPacket *const p){ return bool(p->flags & AV_PKT_FLAG_KEY); });
+
+        if (nextKeyframe == this->prerecordPackets.end())
+        {
+            break;
+        }
+
+        const bool isLongEnoughWithout = ((this->prerecordPackets.back()->dts - (*nextKeyframe)->dts) >= this->prerecordLength);
+        if (!isLongEnoughWithout &&
+            (this->prerecordBytes <= PRERECORD_MAX_BYTES))
+        {
+            break;
+        }
+
+        for (auto numToShed = std::distance(this->prerecordPackets.begin(), nextKeyframe); numToShed > 0; numToShed--)
+        {
+            AVPacket *oldest = this->prerecordPackets.front();
+            this->prerecordPackets.pop_front();
+            this->prerecordBytes -= oldest->size;
+            av_packet_free(&oldest);
+        }
+    }
+
+    return;
+}
+
+bool libav_encoder_c::save_prerecording(const std::string &filename)
+{
+    k_assert(this->is_open(), "Attempting to save a pre-recording with an unopened libav encoder.");
+
+    if (this->prerecordPackets.empty())
+    {
+        this->errorString = "No video has been pre-recorded yet.";
+        return false;
+    }
+
+    AVFormatContext *muxer = nullptr;
+    if (!this->open_muxer(&muxer, filename, false))
+    {
+        return false;
+    }
+
+    // Have the saved video begin at time 0.
+    const i64 startPts = this->prerecordPackets.front()->pts;
+
+    for (const AVPacket *const packet: this->prerecordPackets)
+    {
+        AVPacket *copy = av_packet_clone(packet);
+
+        if (!copy ||
+            !this->write_packet(muxer, copy, this->codecContext, startPts))
+        {
+            av_packet_free(&copy);
+            this->close_muxer(&muxer);
+            this->errorString = "Couldn't write the pre-recorded video into the file.";
+
+            return false;
+        }
+
+        av_packet_free(&copy);
+    }
+
+    this->close_muxer(&muxer);
+
+    return true;
+}
+
+void libav_encoder_c::close(void)
+{
+    if (!this->is_open())
+    {
+        return;
+    }
+
+    // Drain the encoders, padding the last of the audio into a full frame.
+    avcodec_send_frame(this->codecContext, nullptr);
+    this->write_encoded_packets(this->codecContext);
+
+    if (this->has_audio())
+    {
+        if (!this->pendingAudio.empty())
+        {
+            this->pendingAudio.resize((this->audioFrame->nb_samples * this->audioFormat.numChannels), 0);
+            this->send_audio_frame(this->pendingAudio.data());
+        }
+
+        avcodec_send_frame(this->audioCodecContext, nullptr);
+        this->write_encoded_packets(this->audioCodecContext);
+
+        // No more segments will begin, so whatever audio is held goes in the last.
+        this->write_held_audio_packets(INT64_MAX);
+    }
+
+    this->close_muxer(&this->formatContext);
+
+    this->release();
+
+    return;
+}
+
+bool libav_encoder_c::is_open(void) const
+{
+    return (this->codecContext != nullptr);
+}
+
+u64 libav_encoder_c::num_bytes_encoded(void) const
+{
+    return (this->prerecordLength? this->prerecordBytes.load() : this->numBytesWritten.load());
+}
+
+std::string libav_encoder_c::error_string(void) const
+{
+    return this->errorString;
+}
+
+void libav_encoder_c::release(void)
+{
+    if (this->formatContext &&
+        this->formatContext->pb &&
+        !(this->formatContext->oformat->flags & AVFMT_NOFILE))
+    {
+        avio_closep(&this->formatContext->pb);
+    }
+
+    this->yuvBuffer.clear();
+
+    for (AVPacket *packet: this->prerecordPackets)
+    {
+        av_packet_free(&packet);
+    }
+    this->prerecordPackets.clear();
+    this->prerecordBytes = 0;
+
+    for (AVPacket *packet: this->heldAudioPackets)
+    {
+        av_packet_free(&packet);
+    }
+    this->heldAudioPackets.clear();
+
+    this->pendingAudio.clear();
+    this->nextAudioPts = -1;
+
+    av_packet_free(&this->packet);
+    av_frame_free(&this->frame);
+    av_frame_free(&this->audioFrame);
+    avcodec_free_context(&this->audioCodecContext);
+    avcodec_free_context(&this->codecContext);
+    avformat_free_context(this->formatContext);
+    this->formatContext = nullptr;
+
+    return;
+}
+
+#endif
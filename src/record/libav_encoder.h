@@ -0,0 +1,179 @@
+/*
+ * 2020 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+#ifndef LIBAV_ENCODER_H
+#define LIBAV_ENCODER_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <deque>
+#include "capture/audio_capture.h"
+#include "record/record.h"
+#include "common/types.h"
+
+struct AVFormatContext;
+struct AVCodecContext;
+struct AVPacket;
+struct AVFrame;
+
+// Encodes frames into a video file via FFmpeg's libavcodec and libavformat.
+//
+// Frames are given to the encoder as 32-bit BGRA. The lossless codecs take them
+// as they are; for the others, the frames are converted to YUV 4:2:0 by the
+// scaler's converter, on the thread that calls encode_frame().
+//
+// The encoded video can be written into a single file, into consecutive segment
+// files of a given length, or - for pre-recording - into a memory-bounded ring
+// of the most recently encoded packets, which save_prerecording() writes into
+// a file on request.
+//
+// Audio, if any, is given to the encoder as 16-bit interleaved PCM, and goes
+// into the file alongside the video as AAC (in MP4) or FLAC (in MKV). Pre-
+// recordings are of video only.
+class libav_encoder_c
+{
+public:
+    ~libav_encoder_c(void);
+
+    // Creates the given video file, and prepares the encoder to write frames of
+    // the given resolution into it at the given frame rate. If the settings ask
+    // for segments, the filename is used as the base for the segments' names;
+    // and if they ask for pre-recording, no file is created until a call to
+    // save_prerecording(). If an audio format is given, the video will also have
+    // an audio stream of that format. Returns true on success; false otherwise,
+    // with an explanation in error_string().
+    bool open(const std::string &filename,
+              const resolution_s &resolution,
+              const uint frameRate,
+              const recording_encoder_settings_s &settings,
+              const audio_format_s &audioFormat = audio_format_s());
+
+    // Encodes the given 32-bit BGRA frame as the video's next frame. For a
+    // variable frame rate video, the frame is shown at the given time, in
+    // nanoseconds from the start of the video; otherwise, the time is ignored,
+    // and the frame shown one frame's duration after the previous one.
+    bool encode_frame(const u8 *const pixels, const i64 timestamp = 0);
+
+    // Encodes the given audio frames (one 16-bit sample per channel, interleaved)
+    // into the video's audio stream, the first of them to be heard at the given
+    // time, in nanoseconds from the start of the video. Any gap between these and
+    // the previous frames is filled with silence; audio from before the start of
+    // the video is ignored.
+    bool encode_audio(const i16 *const samples, const uint numFrames, const i64 timestamp);
+
+    bool has_audio(void) const;
+
+    // Flushes any frames still held by the encoder into the video file, and
+    // closes the file.
+    void close(void);
+
+    // Writes the video held in the pre-record ring into the given file. The ring
+    // remains as it was, so the same video can be saved more than once.
+    bool save_prerecording(const std::string &filename);
+
+    bool is_open(void) const;
+
+    // Returns the number of bytes of encoded video that have been written into
+    // files, or that are being held in the pre-record ring. Can be called from
+    // any thread.
+    u64 num_bytes_encoded(void) const;
+
+    std::string error_string(void) const;
+
+    // Returns the file suffix (e.g. "mp4") of the container that the given
+    // codec's videos are saved in.
+    static std::string container_suffix(const recording_codec_e codec);
+
+private:
+    bool open_audio_encoder(const recording_encoder_settings_s &settings, const audio_format_s &audioFormat);
+
+    bool send_audio_frame(const i16 *const samples);
+
+    bool write_encoded_packets(AVCodecContext *const encoder);
+
+    bool open_muxer(AVFormatContext **muxer, const std::string &filename, const bool isFragmented);
+
+    void close_muxer(AVFormatContext **muxer);
+
+    bool write_packet(AVFormatContext *const muxer,
+                      AVPacket *const packet,
+                      const AVCodecContext *const encoder,
+                      const i64 ptsOffset);
+
+    std::string segment_filename(const uint segmentIdx) const;
+
+    void push_prerecord_packet(const AVPacket *const packet);
+
+    void write_held_audio_packets(const i64 endPts);
+
+    void release(void);
+
+    // The muxer of the file being written into; or null if pre-recording.
+    AVFormatContext *formatContext = nullptr;
+    AVCodecContext *codecContext = nullptr;
+    AVFrame *frame = nullptr;
+    AVPacket *packet = nullptr;
+
+    AVCodecContext *audioCodecContext = nullptr;
+    AVFrame *audioFrame = nullptr;
+
+    // Audio waiting to fill a frame of the audio codec, and the presentation
+    // timestamp of its first sample; and the timestamp that the audio after it
+    // is expected to have. In units of samples.
+    std::vector<i16> pendingAudio;
+    i64 pendingAudioPts = 0;
+    i64 nextAudioPts = -1;
+
+    audio_format_s audioFormat;
+
+    // For codecs that take YUV 4:2:0, holds the current frame converted into it.
+    std::vector<u8> yuvBuffer;
+
+    // The presentation timestamp of the next frame, in units of the codec's
+    // time base - for constant frame rate videos, in frames.
+    i64 nextPts = 0;
+
+    bool isVariableFrameRate = false;
+
+    std::string filename;
+    uint frameRate = 0;
+
+    // For segmented output, the length of each segment, in units of the codec's
+    // time base; or 0 if the video goes into a single file.
+    i64 segmentLength = 0;
+    uint segmentIdx = 0;
+
+    // The presentation timestamp of the current segment's first frame.
+    i64 segmentStartPts = 0;
+
+    // Whether the next frame has been asked to be encoded as a keyframe, so that
+    // the next segment can begin on it.
+    bool isSegmentKeyframeRequested = false;
+
+    // Encoded audio from at or past the next segment's start, held back until
+    // the video - which comes out of its encoder later than the audio does -
+    // begins the segment; so that the audio goes into the segment it belongs to.
+    std::deque<AVPacket*> heldAudioPackets;
+
+    // For pre-recording, the most recently encoded packets (in decoding order,
+    // beginning with a keyframe), and the maximum length of video they may span,
+    // in units of the codec's time base; or 0 if not pre-recording.
+    std::deque<AVPacket*> prerecordPackets;
+    i64 prerecordLength = 0;
+    std::atomic<u64> prerecordBytes{0};
+
+    // The number of bytes of encoded video written into files, including those
+    // of any previous segments.
+    std::atomic<u64> numBytesWritten{0};
+
+    resolution_s resolution = {0, 0, 0};
+
+    std::string errorString;
+};
+
+#endif
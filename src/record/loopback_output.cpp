@@ -0,0 +1,601 @@
+/*
+ * 2020 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ * Writes VCS's output frames into a v4l2loopback device, exposing them to other
+ * programs (OBS, FFmpeg, browsers, ...) as a virtual camera. Linux only.
+ *
+ * Each new frame is handed to an output thread of its own, which converts it
+ * into the device's pixel format directly into one of the device's MMAP
+ * buffers, and queues the buffer for the consumers. The format is negotiated
+ * with the device for the first frame, and kept for as long as the output runs:
+ * the device can't change its format while a consumer has it open, so frames
+ * of other resolutions are letterboxed into it instead. Neither the capture
+ * pipeline nor the output thread waits on the other or on the consumers: a
+ * frame that arrives while the thread is still busy with the previous one
+ * replaces it, and a frame for which the device has no free buffer is dropped.
+ *
+ * Should the device fail, the output thread exits, and on its next frame the
+ * main thread stops the output, tells the user why, and fires the
+ * loopback.outputFailed event.
+ *
+ */
+
+#include <condition_variable>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include "common/propagate/app_events.h"
+#include "display/display.h"
+#include "common/globals.h"
+#include "capture/capture_api.h"
+#include "capture/capture.h"
+#include "scaler/scaler.h"
+#include "record/loopback_output.h"
+
+#ifdef __linux__
+    #include <linux/videodev2.h>
+    #include <sys/ioctl.h>
+    #include <sys/mman.h>
+    #include <unistd.h>
+    #include <fcntl.h>
+#endif
+
+// How many MMAP buffers to ask the device for.
+static const uint NUM_DEVICE_BUFFERS = 4;
+
+// A frame waiting for the output thread.
+struct loopback_frame_s
+{
+    std::vector<u8> pixels;
+    resolution_s resolution = {0, 0, 0};
+    i64 timestamp = 0;
+};
+
+static struct loopback_s
+{
+    std::atomic<bool> isActive{false};
+
+    // Set to tell the output thread to exit.
+    std::atomic<bool> stop{false};
+
+    std::thread thread;
+
+    // The frame waiting for the output thread, if 'hasPendingFrame'.
+    std::mutex mutex;
+    std::condition_variable frameAvailable;
+    loopback_frame_s pendingFrame;
+    bool hasPendingFrame = false;
+
+    std::atomic<u64> numFramesWritten{0};
+    std::atomic<u64> numFramesDropped{0};
+
+    // Set by the output thread if it exited due to an error, described by
+    // 'errorString'.
+    std::atomic<bool> hasFailed{false};
+    std::string errorString;
+
+    std::string deviceName;
+    int fd = -1;
+} LOOPBACK;
+
+#ifdef __linux__
+// The device's buffers and format, as negotiated by the output thread.
+static struct device_stream_s
+{
+    struct buffer_s
+    {
+        void *data;
+        size_t length;
+    };
+
+    std::vector<buffer_s> buffers;
+
+    // Indices of the buffers not queued in the device.
+    std::vector<uint> freeBuffers;
+
+    resolution_s resolution = {0, 0, 0};
+    u32 pixelFormat = 0;
+    u32 sizeImage = 0;
+
+    // Frames of a resolution other than the device's, letterboxed into it.
+    std::vector<u8> letterboxed;
+
+    bool isStreaming = false;
+} STREAM;
+
+// Logs the given error as the reason for the output thread's failure. Returns
+// false, for the convenience of the caller.
+//
+static bool device_error(const std::string &reason)
+{
+    NBENE(("%s", reason.c_str()));
+
+    LOOPBACK.errorString = reason;
+
+    return false;
+}
+
+// Returns the buffers to the device and stops streaming.
+//
+static void release_device_buffers(void)
+{
+    if (STREAM.isStreaming)
+    {
+        int type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        ioctl(LOOPBACK.fd, VIDIOC_STREAMOFF, &type);
+        STREAM.isStreaming = false;
+    }
+
+    for (const auto &buffer: STREAM.buffers)
+    {
+        munmap(buffer.data, buffer.length);
+    }
+
+    if (!STREAM.buffers.empty())
+    {
+        v4l2_requestbuffers request;
+        memset(&request, 0, sizeof(request));
+        request.count = 0;
+        request.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        request.memory = V4L2_MEMORY_MMAP;
+        ioctl(LOOPBACK.fd, VIDIOC_REQBUFS, &request);
+    }
+
+    STREAM.buffers.clear();
+    STREAM.freeBuffers.clear();
+    STREAM.resolution = {0, 0, 0};
+
+    return;
+}
+
+// Sets the device's format for frames of the given resolution, and maps its
+// buffers. YUV 4:2:0 is what consumers most widely accept, so it's used when
+// the resolution allows; otherwise, the frames go out in 32-bit BGRA as they are.
+// Returns true on success; false otherwise.
+//
+static bool negotiate_device_format(const resolution_s &resolution)
+{
+    release_device_buffers();
+
+    const bool isYuv = (((resolution.w % 2) == 0) && ((resolution.h % 2) == 0));
+
+    v4l2_format format;
+    memset(&format, 0, sizeof(format));
+    format.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    format.fmt.pix.width = resolution.w;
+    format.fmt.pix.height = resolution.h;
+    format.fmt.pix.field = V4L2_FIELD_NONE;
+    format.fmt.pix.pixelformat = (isYuv? V4L2_PIX_FMT_YUV420 : V4L2_PIX_FMT_BGR32);
+    format.fmt.pix.bytesperline = (isYuv? resolution.w : (resolution.w * 4));
+    format.fmt.pix.sizeimage = (isYuv? ((resolution.w * resolution.h * 3) / 2) : (resolution.w * resolution.h * 4));
+    format.fmt.pix.colorspace = V4L2_COLORSPACE_SRGB;
+
+    if (ioctl(LOOPBACK.fd, VIDIOC_S_FMT, &format) < 0)
+    {
+        return device_error("The device refused the format " + std::to_string(resolution.w) + "x" + std::to_string(resolution.h) +
+                            ": " + strerror(errno));
+    }
+
+    if ((format.fmt.pix.width != resolution.w) ||
+        (format.fmt.pix.height != resolution.h))
+    {
+        return device_error("The device wouldn't take frames of " + std::to_string(resolution.w) + "x" + std::to_string(resolution.h) + ".");
+    }
+
+    v4l2_requestbuffers request;
+    memset(&request, 0, sizeof(request));
+    request.count = NUM_DEVICE_BUFFERS;
+    request.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    request.memory = V4L2_MEMORY_MMAP;
+
+    if ((ioctl(LOOPBACK.fd, VIDIOC_REQBUFS, &request) < 0) ||
+        !request.count)
+    {
+        return device_error(std::string("The device couldn't provide MMAP buffers: ") + strerror(errno));
+    }
+
+    for (uint i = 0; i < request.count; i++)
+    {
+        v4l2_buffer buffer;
+        memset(&buffer, 0, sizeof(buffer));
+        buffer.index = i;
+        buffer.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        buffer.memory = V4L2_MEMORY_MMAP;
+
+        if (ioctl(LOOPBACK.fd, VIDIOC_QUERYBUF, &buffer) < 0)
+        {
+            return device_error(std::string("Failed to query a buffer of the device: ") + strerror(errno));
+        }
+
+        void *const data = mmap(nullptr, buffer.length, (PROT_READ | PROT_WRITE), MAP_SHARED, LOOPBACK.fd, buffer.m.offset);
+
+        if (data == MAP_FAILED)
+        {
+            return device_error(std::string("Failed to map a buffer of the device: ") + strerror(errno));
+        }
+
+        STREAM.buffers.push_back({data, buffer.length});
+        STREAM.freeBuffers.push_back(i);
+    }
+
+    STREAM.resolution = resolution;
+    STREAM.pixelFormat = format.fmt.pix.pixelformat;
+    STREAM.sizeImage = format.fmt.pix.sizeimage;
+
+    INFO(("Writing %ux%u frames into the loopback device %s as %s.",
+          resolution.w, resolution.h, LOOPBACK.deviceName.c_str(), (isYuv? "YUV 4:2:0" : "BGRA")));
+
+    return true;
+}
+
+// Scales the given frame's pixels (nearest-neighbor), preserving their aspect
+// ratio, into the middle of a black frame of the device's resolution. Returns
+// a pointer to the resulting pixels.
+//
+static const u8* letterbox_frame(const loopback_frame_s &frame)
+{
+    const uint dstW = STREAM.resolution.w;
+    const uint dstH = STREAM.resolution.h;
+
+    uint w = dstW;
+    uint h = dstH;
+
+    if ((u64(frame.resolution.w) * dstH) > (u64(dstW) * frame.resolution.h))
+    {
+        h = std::max(1u, uint((u64(frame.resolution.h) * dstW) / frame.resolution.w));
+    }
+    else
+    {
+        w = std::max(1u, uint((u64(frame.resolution.w) * dstH) / frame.resolution.h));
+    }
+
+    const uint offsetX = ((dstW - w) / 2);
+    const uint offsetY = ((dstH - h) / 2);
+
+    STREAM.letterboxed.assign((dstW * dstH * 4), 0);
+
+    for (uint y = 0; y < h; y++)
+    {
+        const u32 *const srcRow = ((const u32*)frame.pixels.data() + (((y * frame.resolution.h) / h) * frame.resolution.w));
+        u32 *const dstRow = ((u32*)STREAM.letterboxed.data() + ((offsetY + y) * dstW) + offsetX);
+
+        for (uint x = 0; x < w; x++)
+        {
+            dstRow[x] = srcRow[(x * frame.resolution.w) / w];
+        }
+    }
+
+    return STREAM.letterboxed.data();
+}
+
+// Writes the given frame into the device, if it has a free buffer for it.
+// Returns false if the device failed; true otherwise.
+//
+static bool write_frame_into_device(const loopback_frame_s &frame)
+{
+    // The format is set only once per run of the output, since the device
+    // refuses (EBUSY) to change it while any consumer has the device open.
+    if (STREAM.buffers.empty() &&
+        !negotiate_device_format(frame.resolution))
+    {
+        return false;
+    }
+
+    const u8 *const pixels = (((frame.resolution.w == STREAM.resolution.w) &&
+                               (frame.resolution.h == STREAM.resolution.h))? frame.pixels.data()
+                                                                            : letterbox_frame(frame));
+
+    // Reclaim any buffers that the device has finished with. The device was
+    // opened as non-blocking, so this doesn't wait for ones that it hasn't.
+    while (STREAM.isStreaming &&
+           (STREAM.freeBuffers.size() < STREAM.buffers.size()))
+    {
+        v4l2_buffer buffer;
+        memset(&buffer, 0, sizeof(buffer));
+        buffer.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        buffer.memory = V4L2_MEMORY_MMAP;
+
+        if (ioctl(LOOPBACK.fd, VIDIOC_DQBUF, &buffer) < 0)
+        {
+            if ((errno == EAGAIN) || (errno == EINTR))
+            {
+                break;
+            }
+
+            return device_error(std::string("Failed to dequeue a buffer from the device: ") + strerror(errno));
+        }
+
+        STREAM.freeBuffers.push_back(buffer.index);
+    }
+
+    if (STREAM.freeBuffers.empty())
+    {
+        LOOPBACK.numFramesDropped++;
+        return true;
+    }
+
+    const uint bufferIdx = STREAM.freeBuffers.back();
+    u8 *const dst = (u8*)STREAM.buffers[bufferIdx].data;
+
+    if (STREAM.buffers[bufferIdx].length < STREAM.sizeImage)
+    {
+        return device_error("The device's buffers are too small for its format.");
+    }
+
+    if (STREAM.pixelFormat == V4L2_PIX_FMT_YUV420)
+    {
+        ks_convert_bgra_to_yuv420(pixels, STREAM.resolution, dst);
+    }
+    else
+    {
+        memcpy(dst, pixels, (STREAM.resolution.w * STREAM.resolution.h * 4));
+    }
+
+    v4l2_buffer buffer;
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.index = bufferIdx;
+    buffer.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.bytesused = STREAM.sizeImage;
+    buffer.field = V4L2_FIELD_NONE;
+    buffer.flags = V4L2_BUF_FLAG_TIMESTAMP_COPY;
+    buffer.timestamp.tv_sec = (frame.timestamp / 1000000000);
+    buffer.timestamp.tv_usec = ((frame.timestamp % 1000000000) / 1000);
+
+    if (ioctl(LOOPBACK.fd, VIDIOC_QBUF, &buffer) < 0)
+    {
+        return device_error(std::string("Failed to queue a buffer into the device: ") + strerror(errno));
+    }
+
+    STREAM.freeBuffers.pop_back();
+
+    if (!STREAM.isStreaming)
+    {
+        int type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+
+        if (ioctl(LOOPBACK.fd, VIDIOC_STREAMON, &type) < 0)
+        {
+            return device_error(std::string("Failed to start streaming into the device: ") + strerror(errno));
+        }
+
+        STREAM.isStreaming = true;
+    }
+
+    LOOPBACK.numFramesWritten++;
+
+    return true;
+}
+
+// Runs on the output thread, writing the frames it's given into the device
+// until told to stop.
+//
+static void output_function(void)
+{
+    loopback_frame_s frame;
+
+    while (!LOOPBACK.stop)
+    {
+        {
+            std::unique_lock<std::mutex> lock(LOOPBACK.mutex);
+
+            LOOPBACK.frameAvailable.wait(lock, []{ return (LOOPBACK.hasPendingFrame || LOOPBACK.stop); });
+
+            if (LOOPBACK.stop)
+            {
+                break;
+            }
+
+            // Take the frame, leaving our previous buffer for the next one.
+            std::swap(frame, LOOPBACK.pendingFrame);
+            LOOPBACK.hasPendingFrame = false;
+        }
+
+        if (!write_frame_into_device(frame))
+        {
+            NBENE(("Stopping the loopback output due to an error."));
+            LOOPBACK.hasFailed = true;
+            break;
+        }
+    }
+
+    release_device_buffers();
+
+    LOOPBACK.isActive = false;
+
+    return;
+}
+
+// Called on the main thread once the output thread has exited due to an error.
+// Stops the output and lets the user and the rest of VCS know.
+//
+static void end_failed_output(void)
+{
+    kloopback_stop_output();
+
+    kd_show_headless_error_message("VCS can't output into the loopback device",
+                                   ("The output into \"" + LOOPBACK.deviceName + "\" was stopped due to an error: " +
+                                    LOOPBACK.errorString).c_str());
+
+    ke_events().loopback.outputFailed->fire();
+
+    return;
+}
+
+// Hands VCS's most recent frame to the output thread.
+//
+static void submit_new_frame(void)
+{
+    // Don't wait for the output thread; it only holds the lock for long enough to
+    // take the pending frame.
+    std::unique_lock<std::mutex> lock(LOOPBACK.mutex, std::try_to_lock);
+
+    if (!lock.owns_lock())
+    {
+        LOOPBACK.numFramesDropped++;
+        return;
+    }
+
+    // The output thread hasn't got round to the previous frame; this one will
+    // replace it.
+    if (LOOPBACK.hasPendingFrame)
+    {
+        LOOPBACK.numFramesDropped++;
+    }
+
+    loopback_frame_s &frame = LOOPBACK.pendingFrame;
+
+    frame.resolution = ks_scaler_output_resolution();
+    frame.resolution.bpp = 32;
+    frame.timestamp = kc_capture_api().get_frame_buffer().timestamp;
+    frame.pixels.resize(frame.resolution.w * frame.resolution.h * 4);
+    memcpy(frame.pixels.data(), ks_scaler_output_as_raw_ptr(), frame.pixels.size());
+
+    LOOPBACK.hasPendingFrame = true;
+
+    lock.unlock();
+    LOOPBACK.frameAvailable.notify_one();
+
+    return;
+}
+#endif
+
+void kloopback_initialize(void)
+{
+    ke_events().scaler.newFrame->subscribe([]
+    {
+#ifdef __linux__
+        if (LOOPBACK.hasFailed)
+        {
+            end_failed_output();
+        }
+        else if (kloopback_is_output_active())
+        {
+            submit_new_frame();
+        }
+#endif
+    });
+
+    return;
+}
+
+void kloopback_release(void)
+{
+    kloopback_stop_output();
+
+    return;
+}
+
+bool kloopback_start_output(const std::string &deviceName)
+{
+    kloopback_stop_output();
+
+#ifdef __linux__
+    const auto fail = [&deviceName](const std::string &reason)->bool
+    {
+        if (LOOPBACK.fd >= 0)
+        {
+            close(LOOPBACK.fd);
+            LOOPBACK.fd = -1;
+        }
+
+        kd_show_headless_error_message("VCS can't output into the loopback device",
+                                       ("An error was encountered while opening \"" + deviceName + "\": " + reason).c_str());
+        return false;
+    };
+
+    LOOPBACK.fd = open(deviceName.c_str(), (O_RDWR | O_NONBLOCK));
+    if (LOOPBACK.fd < 0)
+    {
+        return fail(strerror(errno));
+    }
+
+    v4l2_capability capability;
+    memset(&capability, 0, sizeof(capability));
+
+    if (ioctl(LOOPBACK.fd, VIDIOC_QUERYCAP, &capability) < 0)
+    {
+        return fail(strerror(errno));
+    }
+
+    const u32 caps = ((capability.capabilities & V4L2_CAP_DEVICE_CAPS)? capability.device_caps : capability.capabilities);
+    if (!(caps & V4L2_CAP_VIDEO_OUTPUT) ||
+        !(caps & V4L2_CAP_STREAMING))
+    {
+        return fail("The device doesn't take video output via streaming. Is it a v4l2loopback device?");
+    }
+
+    LOOPBACK.deviceName = deviceName;
+    LOOPBACK.hasPendingFrame = false;
+    LOOPBACK.numFramesWritten = 0;
+    LOOPBACK.numFramesDropped = 0;
+    LOOPBACK.hasFailed = false;
+    LOOPBACK.errorString.clear();
+    LOOPBACK.stop = false;
+    LOOPBACK.isActive = true;
+    LOOPBACK.thread = std::thread(output_function);
+
+    INFO(("Outputting frames into the loopback device %s.", deviceName.c_str()));
+
+    return true;
+#else
+    (void)deviceName;
+
+    kd_show_headless_error_message("VCS can't output into the loopback device",
+                                   "Loopback output is only available on Linux, via v4l2loopback.");
+
+    return false;
+#endif
+}
+
+void kloopback_stop_output(void)
+{
+    if (LOOPBACK.thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(LOOPBACK.mutex);
+            LOOPBACK.stop = true;
+        }
+
+        LOOPBACK.frameAvailable.notify_one();
+        LOOPBACK.thread.join();
+
+        INFO(("Stopped outputting into the loopback device, having written %llu frames and dropped %llu.",
+              (unsigned long long)LOOPBACK.numFramesWritten.load(),
+              (unsigned long long)LOOPBACK.numFramesDropped.load()));
+    }
+
+#ifdef __linux__
+    if (LOOPBACK.fd >= 0)
+    {
+        close(LOOPBACK.fd);
+        LOOPBACK.fd = -1;
+    }
+#endif
+
+    LOOPBACK.isActive = false;
+    LOOPBACK.hasFailed = false;
+
+    return;
+}
+
+bool kloopback_is_output_active(void)
+{
+    return LOOPBACK.isActive;
+}
+
+u64 kloopback_num_frames_written(void)
+{
+    return LOOPBACK.numFramesWritten;
+}
+
+u64 kloopback_num_frames_dropped(void)
+{
+    return LOOPBACK.numFramesDropped;
+}
@@ -0,0 +1,37 @@
+/*
+ * 2020 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+#ifndef LOOPBACK_OUTPUT_H
+#define LOOPBACK_OUTPUT_H
+
+#include <string>
+#include "common/types.h"
+
+// Starts writing VCS's output frames - as shown in the output window - into the
+// given v4l2loopback device (e.g. "/dev/video10"), so that other programs can
+// open the device as if it were a camera. The device is given the resolution
+// of the first frame, and later frames of other resolutions are letterboxed into
+// it. Only available on Linux. Returns true on success; false otherwise, having
+// notified the user of the error. If the device fails afterwards, the output is
+// stopped, the user notified, and the loopback.outputFailed event fired.
+bool kloopback_start_output(const std::string &deviceName);
+
+void kloopback_stop_output(void);
+
+bool kloopback_is_output_active(void);
+
+u64 kloopback_num_frames_written(void);
+
+// Returns the number of frames that weren't written into the device because
+// its consumers, or the output thread, hadn't kept up.
+u64 kloopback_num_frames_dropped(void);
+
+void kloopback_initialize(void);
+
+void kloopback_release(void);
+
+#endif
@@ -4,33 +4,69 @@
  * 
  * For recording capture output into a video file.
  *
- * Uses OpenCV's wrapper for x264 to produce a H.264 video. Expects the user to
- * have an x264 encoder available on their system.
+ * If VCS has been built with FFmpeg's libraries (USE_LIBAV), encodes via them,
+ * with a choice of codec and codec settings. Otherwise, uses OpenCV's wrapper for
+ * x264 to produce a H.264 video, and expects the user to have an x264 encoder
+ * available on their system.
+ *
+ * Frames are passed from the capture pipeline to the encoder through a small,
+ * fixed-size queue; and a dedicated encoder thread encodes them into the video
+ * one at a time, for the duration of the recording. If the encoder falls behind
+ * such that the queue fills up, new frames are either dropped or made to wait,
+ * depending on the recording's overflow policy.
+ *
+ * If an audio device has been given, its audio is captured alongside and muxed
+ * into the video, aligned with the video by the two's capture timestamps.
+ *
+ * Frames are timed by when they were captured, as reported by the capture API,
+ * so that the main thread's scheduling doesn't affect the video's frame pacing.
+ *
+ * With FFmpeg's libraries, the video can also be split into segment files as
+ * it's recorded; or, instead of being written to disk, be pre-recorded into a
+ * memory-bounded ring of its most recent seconds, which the user can then save
+ * into a file on demand.
  *
  */
 
 #include <QtConcurrent/QtConcurrent>
 #include <QFutureWatcher>
 #include <QElapsedTimer>
+#include <QWaitCondition>
+#include <QMutexLocker>
+#include <QMutex>
 #include <QFileInfo>
 #include <QFuture>
+#include <algorithm>
+#include <cstring>
+#include <atomic>
 #include "common/propagate/app_events.h"
 #include "display/display.h"
 #include "common/globals.h"
 #include "scaler/scaler.h"
 #include "common/memory/memory.h"
+#include "capture/capture_api.h"
+#include "capture/capture.h"
+#include "capture/audio_capture.h"
 #include "record/record.h"
 
-#ifdef USE_OPENCV
+#ifdef USE_LIBAV
+    #include "record/libav_encoder.h"
+
+    static libav_encoder_c LIBAV_ENCODER;
+#elif defined(USE_OPENCV)
     #include <opencv2/core/core.hpp>
     #include <opencv2/imgproc/imgproc.hpp>
     #include <opencv2/videoio/videoio.hpp>
 
     static cv::VideoWriter VIDEO_WRITER;
+
+    // The OpenCV video writer takes frames in BGR, so we convert them into this.
+    static cv::Mat BGR_FRAME;
 #endif
 
-// The maximum number of frames that can fit into a frame buffer.
-static const uint FRAME_BUFFER_CAPACITY = 60;
+// The number of frames that the recording's frame queue can hold; i.e. how far
+// the encoder can fall behind the capture before backpressure kicks in.
+static const uint FRAME_QUEUE_CAPACITY = 8;
 
 // Used to keep track of the recording's frame rate. Counts the number
 // of frames captured between two points in time, and derives from that
@@ -68,116 +104,184 @@ static struct framerate_estimator_s
 
 } FRAMERATE_ESTIMATE;
 
-// Incoming frames will first be accumulated into a frame buffer; and when the buffer
-// is full, encoded into the video file.
-// NOTE: The frame buffer expcts frames to be of 24-bit color depth (e.g. BGR).
-struct frame_buffer_s
+// A bounded, single-producer single-consumer queue of frames, through which
+// the capture pipeline (the producer) hands frames to the encoder thread (the
+// consumer). The producer and consumer each advance their own counter, so
+// neither needs to lock the queue; the wait condition is only used to let
+// either side sleep while waiting for the other.
+// NOTE: The frame queue expects frames to be of 32-bit color depth (e.g. BGRA).
+struct frame_queue_s
 {
     u8* memoryPool = nullptr;
 
     resolution_s frameResolution;
 
-    // How many frames the frame buffer is currently storing.
-    uint numFrames = 0;
-
-    // A timestamp of roughly when the corresponding frame was captured.
+    // When the corresponding frame was captured, in nanoseconds since the
+    // recording's first frame was captured.
     std::vector<i64> frameTimestamps;
 
-    // How many frames in total the buffer has memory capacity for.
+    // How many frames in total the queue has memory capacity for.
     uint maxNumFrames = 0;
 
-    ~frame_buffer_s(void)
+    // How many frames have in total been pushed into and popped from the queue.
+    // The difference is the number of frames currently in the queue.
+    std::atomic<uint> numPushed{0};
+    std::atomic<uint> numPopped{0};
+
+    // Woken when a frame is pushed or popped. Checked against is_empty() and
+    // is_full() under the mutex, so that a wakeup can't be missed, nor a stale
+    // one cut a wait short.
+    QMutex waitMutex;
+    QWaitCondition queueChanged;
+
+    ~frame_queue_s(void)
     {
         delete[] memoryPool;
 
         return;
     }
 
-    // Allocates the frame buffer for the given number of frames of the given
-    // resolution. The frames' pixels are expected to have three 8-bit color
-    // channels, each - e.g. RGB.
+    // Allocates the frame queue for the given number of frames of the given
+    // resolution. The frames' pixels are expected to have four 8-bit color
+    // channels, each - e.g. BGRA.
     void initialize(const uint width, const uint height, const uint frameCapacity)
     {
         delete[] memoryPool;
-        memoryPool = new u8[width * height * 3 * frameCapacity];
+        memoryPool = nullptr;
+        memoryPool = new u8[width * height * 4 * frameCapacity];
 
         this->maxNumFrames = frameCapacity;
-        this->numFrames = 0;
-        this->frameResolution = {width, height, 0};
+        this->numPushed = 0;
+        this->numPopped = 0;
+        this->frameResolution = {width, height, 32};
         this->frameTimestamps.resize(frameCapacity);
 
         return;
     }
 
-    void reset(void)
+    resolution_s resolution(void) const
+    {
+        return this->frameResolution;
+    }
+
+    bool is_full(void) const
+    {
+        return ((this->numPushed.load(std::memory_order_acquire) - this->numPopped.load(std::memory_order_acquire)) >= this->maxNumFrames);
+    }
+
+    bool is_empty(void) const
     {
-        this->numFrames = 0;
+        return (this->numPushed.load(std::memory_order_acquire) == this->numPopped.load(std::memory_order_acquire));
+    }
+
+    // Returns a pointer to the queue's next free frame slot, into which the
+    // producer can write a frame's pixels before calling push(). Should only
+    // be called by the producer, and only when the queue isn't full.
+    u8* back(void)
+    {
+        k_assert(!this->is_full(), "Overflowing the video recording frame queue.");
+
+        return this->frame(this->numPushed.load(std::memory_order_relaxed));
+    }
+
+    // Appends the frame in the slot given by back() into the queue.
+    void push(const i64 timestamp)
+    {
+        const uint idx = this->numPushed.load(std::memory_order_relaxed);
+
+        this->frameTimestamps.at(idx % this->maxNumFrames) = timestamp;
+        this->numPushed.store((idx + 1), std::memory_order_release);
+        this->notify_waiter();
 
         return;
     }
 
-    resolution_s resolution(void) const
+    // Returns a pointer to the oldest frame in the queue. Should only be called
+    // by the consumer, and only when the queue isn't empty.
+    const u8* front(void) const
     {
-        return this->frameResolution;
+        k_assert(!this->is_empty(), "Accessing an empty video recording frame queue.");
+
+        return this->frame(this->numPopped.load(std::memory_order_relaxed));
     }
 
-    bool is_full(void) const
+    i64 front_timestamp(void) const
     {
-        return (this->numFrames >= this->maxNumFrames);
+        return this->frameTimestamps.at(this->numPopped.load(std::memory_order_relaxed) % this->maxNumFrames);
     }
 
-    uint frame_count(void) const
+    // Removes the oldest frame from the queue.
+    void pop(void)
     {
-        return this->numFrames;
+        this->numPopped.fetch_add(1, std::memory_order_release);
+        this->notify_waiter();
+
+        return;
     }
 
-    const std::vector<i64>& frame_timestamps(void) const
+    // Sleeps until the queue has a frame in it, or the given number of
+    // milliseconds has passed. Should only be called by the consumer.
+    void wait_while_empty(const unsigned long timeoutMs)
     {
-        return frameTimestamps;
+        QMutexLocker lock(&this->waitMutex);
+
+        if (this->is_empty())
+        {
+            this->queueChanged.wait(&this->waitMutex, timeoutMs);
+        }
+
+        return;
     }
 
-    // Returns a pointer to an unused area of the frame buffer that has the
-    // capacity to hold the pixels of a single frame.
-    u8* next_slot(const i64 timestamp)
+    // Sleeps until the queue has room for a frame, or the given number of
+    // milliseconds has passed. Should only be called by the producer.
+    void wait_while_full(const unsigned long timeoutMs)
     {
-        k_assert((this->numFrames < this->maxNumFrames), "Overflowing the video recording frame buffer.");
+        QMutexLocker lock(&this->waitMutex);
 
-        const uint offset = ((this->frameResolution.w * this->frameResolution.h * 3) * this->numFrames);
+        if (this->is_full())
+        {
+            this->queueChanged.wait(&this->waitMutex, timeoutMs);
+        }
 
-        this->frameTimestamps.at(this->numFrames) = timestamp;
-        this->numFrames++;
+        return;
+    }
 
-        return (memoryPool + offset);
+private:
+    // Wakes the other side of the queue, if it's waiting in wait_while_empty()
+    // or wait_while_full().
+    void notify_waiter(void)
+    {
+        QMutexLocker lock(&this->waitMutex);
+        this->queueChanged.wakeAll();
+
+        return;
     }
 
-    // Index into the frame buffer on a per-frame basis. Note that this index
-    // should be to an already-stored frame. If you want to access uninitialized
-    // memory in the frame buffer, use the next_slot() function.
     u8* frame(const uint frameIdx) const
     {
-        k_assert((frameIdx < this->maxNumFrames), "Attempting to access a frame buffer out of bounds.");
-        k_assert((frameIdx < this->numFrames), "Attempting to access an uninitialized frame.");
+        const uint offset = ((this->frameResolution.w * this->frameResolution.h * 4) * (frameIdx % this->maxNumFrames));
 
-        const uint offset = ((this->frameResolution.w * this->frameResolution.h * 3) * frameIdx);
         return (memoryPool + offset);
     }
 };
 
 static struct recording_s
 {
-    // Accumulate the captured frames in two back buffers. When one buffer
-    // fills up, we'll flip the buffers and encode the filled-up one's frames
-    // into the video file.
-    frame_buffer_s *activeFrameBuffer;
-    frame_buffer_s backBuffers[2];
-    void flip_frame_buffer(void)
-    {
-        activeFrameBuffer = (activeFrameBuffer == &backBuffers[0])? &backBuffers[1] : &backBuffers[0];
-    }
+    // Frames waiting to be encoded.
+    frame_queue_s frameQueue;
 
-    // We'll run the recording's video encoding in a separate thread.
+    // The encoder thread, which runs for the duration of the recording, and
+    // encodes frames from the frame queue into the video.
     QFuture<void> encoderThread;
 
+    // Set to tell the encoder thread to finish encoding the frames remaining in
+    // the frame queue, and then exit.
+    std::atomic<bool> stopEncoder{false};
+
+    // What to do with new frames when the frame queue is full.
+    recording_overflow_e overflowPolicy = recording_overflow_e::drop_frames;
+
     // If true, frames will be inserted into the video in linear time, not as
     // they come in. For instance, if the input FPS is 55 and the video's playback
     // rate is set to 60, linear insertion tries to ensure that frames are duplicated
@@ -186,10 +290,32 @@ static struct recording_s
     // rate of 60 FPS would result in temporal skew.
     bool linearFrameInsertion = true;
 
+    // If true, frames are given to the encoder with their capture timestamps,
+    // and the video's frame rate follows the capture's.
+    bool isVariableFrameRate = false;
+
+    // The capture timestamp of the recording's first frame, relative to which
+    // the frames - and audio - are timed in the video; or -1 if no frames have
+    // been recorded yet.
+    std::atomic<i64> firstFrameTimestamp{-1};
+
+    // Captured audio on its way from the audio capture to the encoder.
+    std::vector<i16> audioBuffer;
+
+    // Whether the video is being pre-recorded into memory rather than recorded
+    // into a file.
+    bool isPrerecording = false;
+
+    // The file into which the encoder thread should next save the pre-recorded
+    // video; or empty if no save has been requested.
+    std::string prerecordSaveFilename;
+    QMutex prerecordSaveMutex;
+
     // Metainfo.
     struct info_s
     {
-        // The file into which the video is saved.
+        // The file into which the video is saved. For segmented videos, the base
+        // of the segment files' names; and for pre-recording, of the saved files'.
         std::string filename;
 
         // The video's resolution.
@@ -197,11 +323,20 @@ static struct recording_s
 
         uint playbackFrameRate;
 
-        // Number of frames recorded in this video.
-        uint numFrames;
+        // Number of frames recorded in this video. Written by the encoder thread.
+        std::atomic<uint> numFrames{0};
+
+        // Number of frames that were discarded because the frame queue was full.
+        uint numDroppedFrames;
+
+        // Number of frames that had to wait for room in the frame queue.
+        uint numBlockedFrames;
 
         // Milliseconds passed since the recording was started.
         QElapsedTimer recordingTimer;
+
+        // Milliseconds passed since the metainfo was last reported to the GUI.
+        QElapsedTimer metainfoTimer;
     } meta;
 } RECORDING;
 
@@ -218,27 +353,166 @@ void krecord_initialize(void)
     return;
 }
 
-// Prepare the OpenCV video writer for recording frames into a video.
+void encoder_thread_loop(void);
+
+// Opens the video encoder for recording into the file named in the recording's
+// metainfo, appending to the filename the container's suffix if need be.
+// Returns true on success; false otherwise, having notified the user of the
+// error.
+//
+static bool open_video_encoder(const recording_encoder_settings_s &encoderSettings)
+{
+#ifdef USE_LIBAV
+    const std::string suffix = libav_encoder_c::container_suffix(encoderSettings.codec);
+    if (QFileInfo(RECORDING.meta.filename.c_str()).suffix().toStdString() != suffix) RECORDING.meta.filename += ("." + suffix);
+
+    DEBUG(("Starting recording into file '%s'.", RECORDING.meta.filename.c_str()));
+
+    const bool isAudioRecorded = (!encoderSettings.audioDevice.empty() && !encoderSettings.prerecordLength);
+    const audio_format_s audioFormat = (isAudioRecorded? audio_format_s{48000, 2} : audio_format_s());
+
+    if (!LIBAV_ENCODER.open(RECORDING.meta.filename,
+                            RECORDING.meta.resolution,
+                            RECORDING.meta.playbackFrameRate,
+                            encoderSettings,
+                            audioFormat))
+    {
+        kd_show_headless_error_message("VCS can't start recording",
+                                       ("An error was encountered while attempting to start recording: " +
+                                        LIBAV_ENCODER.error_string()).c_str());
+        return false;
+    }
+
+    if (isAudioRecorded)
+    {
+        if (!kc_start_audio_capture(encoderSettings.audioDevice, audioFormat))
+        {
+            LIBAV_ENCODER.close();
+            return false;
+        }
+
+        RECORDING.audioBuffer.resize((audioFormat.sampleRate / 10) * audioFormat.numChannels);
+    }
+
+    return true;
+#elif defined(USE_OPENCV)
+    // The OpenCV video writer doesn't let us choose the codec's settings, nor
+    // gives us access to the encoded video for segmenting or pre-recording it.
+    if (encoderSettings.segmentLength ||
+        encoderSettings.prerecordLength ||
+        encoderSettings.isVariableFrameRate ||
+        !encoderSettings.audioDevice.empty())
+    {
+        kd_show_headless_error_message("VCS can't start recording",
+                                       "Segmented recording, pre-recording, variable frame rate video, and audio "
+                                       "are only available when VCS has been built with FFmpeg's libraries.");
+        return false;
+    }
+
+    #if _WIN32
+        // Encoder: x264vfw. Container: AVI.
+        if (QFileInfo(RECORDING.meta.filename.c_str()).suffix() != "avi") RECORDING.meta.filename += ".avi";
+        const auto encoder = cv::VideoWriter::fourcc('X','2','6','4');
+    #elif __linux__
+        // Encoder: x264. Container: MP4.
+        if (QFileInfo(RECORDING.meta.filename.c_str()).suffix() != "mp4") RECORDING.meta.filename += ".mp4";
+        const auto encoder = cv::VideoWriter::fourcc('a','v','c','1');
+    #else
+        #error "Unknown platform."
+    #endif
+
+    DEBUG(("Starting recording into file '%s'.", RECORDING.meta.filename.c_str()));
+
+    VIDEO_WRITER.open(RECORDING.meta.filename,
+                      encoder,
+                      RECORDING.meta.playbackFrameRate,
+                      cv::Size(RECORDING.meta.resolution.w, RECORDING.meta.resolution.h));
+
+    if (!VIDEO_WRITER.isOpened())
+    {
+        kd_show_headless_error_message("VCS can't start recording",
+                                       "An error was encountred while attempting to start recording. "
+                                       "More information may be found in the console window.");
+        return false;
+    }
+
+    BGR_FRAME = cv::Mat(RECORDING.meta.resolution.h, RECORDING.meta.resolution.w, CV_8UC3);
+
+    return true;
+#else
+    (void)encoderSettings;
+
+    return false;
+#endif
+}
+
+static bool is_video_encoder_open(void)
+{
+#ifdef USE_LIBAV
+    return LIBAV_ENCODER.is_open();
+#elif defined(USE_OPENCV)
+    return VIDEO_WRITER.isOpened();
+#else
+    return false;
+#endif
+}
+
+// Encodes the given 32-bit BGRA frame into the video; for variable frame rate
+// videos, at the given time. Called by the encoder thread.
+//
+static void encode_video_frame(const u8 *const pixels, const i64 timestamp)
+{
+#ifdef USE_LIBAV
+    LIBAV_ENCODER.encode_frame(pixels, timestamp);
+#elif defined(USE_OPENCV)
+    (void)timestamp;
+
+    const cv::Mat frame = cv::Mat(RECORDING.meta.resolution.h, RECORDING.meta.resolution.w, CV_8UC4, (u8*)pixels);
+    cv::cvtColor(frame, BGR_FRAME, CV_BGRA2BGR);
+
+    VIDEO_WRITER << BGR_FRAME;
+#else
+    (void)pixels;
+    (void)timestamp;
+#endif
+
+    return;
+}
+
+static void close_video_encoder(void)
+{
+#ifdef USE_LIBAV
+    LIBAV_ENCODER.close();
+#elif defined(USE_OPENCV)
+    VIDEO_WRITER.release();
+#endif
+
+    return;
+}
+
+// Prepare the video encoder for recording frames into a video.
 // Returns true if successful, false otherwise.
 //
 bool krecord_start_recording(const char *const filename,
                              const uint width, const uint height,
                              const uint frameRate,
-                             const bool linearFrameInsertion)
+                             const bool linearFrameInsertion,
+                             const recording_encoder_settings_s &encoderSettings)
 {
-#ifndef USE_OPENCV
+#if !defined(USE_LIBAV) && !defined(USE_OPENCV)
     kd_show_headless_info_message("VCS can't start recording",
-                                  "OpenCV is needed for recording, but has been disabled on this build of VCS.");
+                                  "OpenCV or FFmpeg is needed for recording, but both have been disabled on this build of VCS.");
 
     (void)filename;
     (void)width;
     (void)height;
     (void)frameRate;
     (void)linearFrameInsertion;
+    (void)encoderSettings;
 
     return false;
 #else
-    k_assert(!VIDEO_WRITER.isOpened(),
+    k_assert(!is_video_encoder_open(),
              "Attempting to intialize a recording that has already been initialized.");
 
     if ((width % 2 != 0) || (height % 2 != 0))
@@ -257,55 +531,46 @@ bool krecord_start_recording(const char *const filename,
     }
 
     RECORDING.meta.filename = filename;
-    RECORDING.meta.resolution = {width, height, 24};
+    RECORDING.meta.resolution = {width, height, 32};
     RECORDING.meta.playbackFrameRate = frameRate;
     RECORDING.linearFrameInsertion = linearFrameInsertion;
+    RECORDING.isVariableFrameRate = encoderSettings.isVariableFrameRate;
+    RECORDING.firstFrameTimestamp = -1;
+    RECORDING.isPrerecording = bool(encoderSettings.prerecordLength);
+    RECORDING.prerecordSaveFilename.clear();
     RECORDING.meta.numFrames = 0;
+    RECORDING.meta.numDroppedFrames = 0;
+    RECORDING.meta.numBlockedFrames = 0;
     RECORDING.meta.recordingTimer.start();
+    RECORDING.meta.metainfoTimer.start();
     FRAMERATE_ESTIMATE.initialize(0);
 
     // Allocate memory.
     try
     {
-        RECORDING.backBuffers[0].initialize(width, height, FRAME_BUFFER_CAPACITY);
-        RECORDING.backBuffers[1].initialize(width, height, FRAME_BUFFER_CAPACITY);
+        RECORDING.frameQueue.initialize(width, height, FRAME_QUEUE_CAPACITY);
     }
     catch(...)
     {
         kd_show_headless_error_message("VCS can't start recording",
-                                       "Failed to allocate memory for video frame buffers. "
+                                       "Failed to allocate memory for the video frame queue. "
                                        "The video's resolution may be too high.");
         return false;
     }
-    RECORDING.activeFrameBuffer = &RECORDING.backBuffers[0];
-
-    #if _WIN32
-        // Encoder: x264vfw. Container: AVI.
-        if (QFileInfo(filename).suffix() != "avi") RECORDING.meta.filename += ".avi";
-        const auto encoder = cv::VideoWriter::fourcc('X','2','6','4');
-    #elif __linux__
-        // Encoder: x264. Container: MP4.
-        if (QFileInfo(filename).suffix() != "mp4") RECORDING.meta.filename += ".mp4";
-        const auto encoder = cv::VideoWriter::fourcc('a','v','c','1');
-    #else
-        #error "Unknown platform."
-    #endif
-
-    DEBUG(("Starting recording into file '%s'.", RECORDING.meta.filename.c_str()));
-
-    VIDEO_WRITER.open(RECORDING.meta.filename,
-                      encoder,
-                      RECORDING.meta.playbackFrameRate,
-                      cv::Size(RECORDING.meta.resolution.w, RECORDING.meta.resolution.h));
 
-    if (!VIDEO_WRITER.isOpened())
+    if (!open_video_encoder(encoderSettings))
     {
-        kd_show_headless_error_message("VCS can't start recording",
-                                       "An error was encountred while attempting to start recording. "
-                                       "More information may be found in the console window.");
         return false;
     }
 
+    // Have the scaler produce frames for the video at the video's resolution,
+    // independently of the resolution of the display.
+    ks_set_recorder_output_resolution(RECORDING.meta.resolution);
+    ks_set_recorder_output_enabled(true);
+
+    RECORDING.stopEncoder = false;
+    RECORDING.encoderThread = QtConcurrent::run(encoder_thread_loop);
+
     ke_events().recorder.recordingStarted->fire();
 
     return true;
@@ -314,11 +579,7 @@ bool krecord_start_recording(const char *const filename,
 
 bool krecord_is_recording(void)
 {
-#ifdef USE_OPENCV
-    return VIDEO_WRITER.isOpened();
-#else
-    return false;
-#endif
+    return is_video_encoder_open();
 }
 
 uint krecord_playback_framerate(void)
@@ -336,11 +597,68 @@ std::string krecord_video_filename(void)
     return RECORDING.meta.filename;
 }
 
+// Returns the number of bytes of video written so far into the recording's
+// file(s); or, if pre-recording, being held in memory.
+//
+u64 krecord_video_bytesize(void)
+{
+#ifdef USE_LIBAV
+    return LIBAV_ENCODER.num_bytes_encoded();
+#else
+    return QFileInfo(RECORDING.meta.filename.c_str()).size();
+#endif
+}
+
+bool krecord_is_prerecording(void)
+{
+    return (krecord_is_recording() && RECORDING.isPrerecording);
+}
+
+// Asks the encoder thread to save the video pre-recorded so far into the given
+// file, giving the file the recording's container suffix if need be. The save
+// happens in the background, its outcome being logged.
+//
+void krecord_save_prerecording(const char *const filename)
+{
+    k_assert(krecord_is_prerecording(), "Attempting to save a pre-recording while not pre-recording.");
+
+    std::string saveFilename = filename;
+    const QString suffix = QFileInfo(RECORDING.meta.filename.c_str()).suffix();
+    if (QFileInfo(filename).suffix() != suffix) saveFilename += ("." + suffix.toStdString());
+
+    QMutexLocker lock(&RECORDING.prerecordSaveMutex);
+    RECORDING.prerecordSaveFilename = saveFilename;
+
+    return;
+}
+
 uint krecord_num_frames_recorded(void)
 {
     return RECORDING.meta.numFrames;
 }
 
+uint krecord_num_frames_dropped(void)
+{
+    return RECORDING.meta.numDroppedFrames;
+}
+
+uint krecord_num_frames_blocked(void)
+{
+    return RECORDING.meta.numBlockedFrames;
+}
+
+uint krecord_frame_queue_capacity(void)
+{
+    return FRAME_QUEUE_CAPACITY;
+}
+
+void krecord_set_overflow_policy(const recording_overflow_e policy)
+{
+    RECORDING.overflowPolicy = policy;
+
+    return;
+}
+
 i64 krecord_recording_time(void)
 {
     return RECORDING.meta.recordingTimer.elapsed();
@@ -353,100 +671,233 @@ resolution_s krecord_video_resolution(void)
     return RECORDING.meta.resolution;
 }
 
-void encode_frame_buffer(frame_buffer_s *const frameBuffer)
+// Encodes the oldest frame in the frame queue into the video. Called by the
+// encoder thread.
+//
+void encode_next_frame(void)
 {
-#ifdef USE_OPENCV
-    if (RECORDING.linearFrameInsertion)
+    frame_queue_s &queue = RECORDING.frameQueue;
+    const i64 timestamp = queue.front_timestamp();
+
+    if (RECORDING.linearFrameInsertion &&
+        !RECORDING.isVariableFrameRate)
+    {
+        // Returns the capture time, in nanoseconds since the first frame, at which
+        // the video's given frame slot begins. The slots are spaced as per the
+        // recording's playback rate, and centered on the times at which frames
+        // would be captured at that rate, so that a capture running at the same
+        // rate - give or take some jitter - fills each slot exactly once.
+        const auto slot_start = [](const i64 slotIdx)->i64
+        {
+            return ((((2 * slotIdx) - 1) * 1000000000) / (2 * i64(RECORDING.meta.playbackFrameRate)));
+        };
+
+        // Each slot that has begun by the time this frame was captured, and that
+        // hasn't yet been filled, gets this frame; so the frame is duplicated if
+        // the capture has fallen behind the playback rate, or skipped if it has
+        // run ahead of it. Each frame thus costs a constant amount of work, plus
+        // that of encoding its duplicates.
+        while (slot_start(RECORDING.meta.numFrames) <= timestamp)
+        {
+            encode_video_frame(queue.front(), timestamp);
+            RECORDING.meta.numFrames++;
+        }
+    }
+    else
     {
-        const auto &frameTimestamps = frameBuffer->frame_timestamps();
+        encode_video_frame(queue.front(), timestamp);
+        RECORDING.meta.numFrames++;
+    }
 
-        // Nanoseconds between each frame at the recording's playback rate.
-        const i64 stampDelta = ((1000.0 / RECORDING.meta.playbackFrameRate) * 1000000);
+    queue.pop();
 
-        // Add frames at even intervals as per the recording's playback rate.
-        i64 stamp = (RECORDING.meta.numFrames * stampDelta);
-        uint i = 0;
-        while (stamp <= frameTimestamps[frameBuffer->frame_count()-1])
-        {
-            for (; i < frameBuffer->frame_count(); i++)
-            {
-                if (frameTimestamps[i] >= stamp)
-                {
-                    VIDEO_WRITER << cv::Mat(frameBuffer->resolution().h, frameBuffer->resolution().w, CV_8UC3, frameBuffer->frame(i));
-                    RECORDING.meta.numFrames++;
-                    break;
-                }
-            }
+    return;
+}
 
-            stamp += stampDelta;
-        }
+// Saves the pre-recorded video into the file requested via
+// krecord_save_prerecording(), if any. Called by the encoder thread.
+//
+static void save_requested_prerecording(void)
+{
+    std::string filename;
+    {
+        QMutexLocker lock(&RECORDING.prerecordSaveMutex);
+        filename.swap(RECORDING.prerecordSaveFilename);
+    }
+
+    if (filename.empty())
+    {
+        return;
+    }
+
+#ifdef USE_LIBAV
+    if (LIBAV_ENCODER.save_prerecording(filename))
+    {
+        INFO(("Saved the pre-recorded video into '%s'.", filename.c_str()));
     }
     else
     {
-        for (uint i = 0; i < frameBuffer->frame_count(); i++)
+        NBENE(("Failed to save the pre-recorded video into '%s': %s",
+               filename.c_str(), LIBAV_ENCODER.error_string().c_str()));
+    }
+#endif
+
+    return;
+}
+
+// Encodes into the video's audio stream the audio captured since the last call.
+// Called by the encoder thread.
+//
+static void encode_captured_audio(void)
+{
+#ifdef USE_LIBAV
+    if (!LIBAV_ENCODER.has_audio())
+    {
+        return;
+    }
+
+    const uint numChannels = kc_audio_capture_format().numChannels;
+    const uint maxNumFrames = (RECORDING.audioBuffer.size() / numChannels);
+    const i64 firstFrameTimestamp = RECORDING.firstFrameTimestamp;
+    i64 timestamp = 0;
+
+    while (const uint numFrames = kc_read_captured_audio(RECORDING.audioBuffer.data(), maxNumFrames, &timestamp))
+    {
+        // Until the first video frame arrives, there's nothing to align the audio
+        // with, and it's discarded.
+        if (firstFrameTimestamp < 0)
         {
-            VIDEO_WRITER << cv::Mat(frameBuffer->resolution().h, frameBuffer->resolution().w, CV_8UC3, frameBuffer->frame(i));
-            RECORDING.meta.numFrames++;
+            continue;
         }
+
+        LIBAV_ENCODER.encode_audio(RECORDING.audioBuffer.data(), numFrames, (timestamp - firstFrameTimestamp));
     }
+#endif
+
+    return;
+}
 
-    frameBuffer->reset();
+// Runs on the encoder thread for the duration of the recording, encoding frames
+// from the frame queue as they arrive.
+//
+void encoder_thread_loop(void)
+{
+    frame_queue_s &queue = RECORDING.frameQueue;
+
+    while (true)
+    {
+        save_requested_prerecording();
+
+        encode_captured_audio();
+
+        if (!queue.is_empty())
+        {
+            encode_next_frame();
+        }
+        else if (RECORDING.stopEncoder)
+        {
+            break;
+        }
+        else
+        {
+            // Sleep until a new frame arrives, checking now and then whether we've
+            // been told to stop.
+            queue.wait_while_empty(100);
+        }
+    }
 
     return;
-#else
-    (void)frameBuffer;
-#endif
 }
 
-// Encode VCS's most recent output frame into the video.
+// Hands VCS's most recent output frame to the encoder thread, to be encoded into
+// the video.
 //
 void krecord_record_new_frame(void)
 {
-#ifdef USE_OPENCV
-    k_assert(VIDEO_WRITER.isOpened(),
+    k_assert(is_video_encoder_open(),
              "Attempted to record a video frame before video recording had been initialized.");
 
-    // Get the current output frame.
-    const resolution_s resolution = ks_output_resolution();
-    const u8 *const frameData = ks_scaler_output_as_raw_ptr();
+    // Get the scaler's output frame for the recorder.
+    const resolution_s resolution = ks_recorder_output_resolution();
+    const u8 *const frameData = ks_recorder_output_as_raw_ptr();
     if (frameData == nullptr) return;
 
     k_assert((resolution.w == RECORDING.meta.resolution.w &&
               resolution.h == RECORDING.meta.resolution.h), "Incompatible frame for recording: mismatched resolution.");
 
-    // Convert the frame to BRG, and save it into the frame buffer.
-    cv::Mat originalFrame(resolution.h, resolution.w, CV_8UC4, (u8*)frameData);
-    cv::Mat frame = cv::Mat(resolution.h, resolution.w, CV_8UC3, RECORDING.activeFrameBuffer->next_slot(RECORDING.meta.recordingTimer.nsecsElapsed()));
-    cv::cvtColor(originalFrame, frame, CV_BGRA2BGR);
+    // Time the frame by when it was captured, relative to the recording's first
+    // frame.
+    i64 timestamp = 0;
+    {
+        const i64 captureTimestamp = kc_capture_api().get_frame_buffer().timestamp;
+
+        if (RECORDING.firstFrameTimestamp < 0)
+        {
+            RECORDING.firstFrameTimestamp = captureTimestamp;
+        }
+
+        timestamp = std::max<i64>(0, (captureTimestamp - RECORDING.firstFrameTimestamp));
+    }
 
-    // Once we've accumulated enough frames to fill the frame buffer, encode
-    // its contents into the video file.
-    if (RECORDING.activeFrameBuffer->is_full())
+    frame_queue_s &queue = RECORDING.frameQueue;
+
+    // If the encoder has fallen behind, apply the overflow policy.
+    if (queue.is_full())
     {
-        RECORDING.encoderThread.waitForFinished();
+        if (RECORDING.overflowPolicy == recording_overflow_e::drop_frames)
+        {
+            RECORDING.meta.numDroppedFrames++;
+            goto done;
+        }
+        else
+        {
+            RECORDING.meta.numBlockedFrames++;
 
+            while (queue.is_full())
+            {
+                queue.wait_while_full(100);
+            }
+        }
+    }
+
+    // Queue the frame for the encoder. Any conversion of its pixels into the
+    // encoder's format will be done on the encoder thread.
+    {
+        memcpy(queue.back(), frameData, (resolution.w * resolution.h * 4));
+
+        queue.push(timestamp);
+    }
+
+    done:
+
+    // Periodically update the GUI on the recording's progress.
+    if (RECORDING.meta.metainfoTimer.elapsed() >= 1000)
+    {
         FRAMERATE_ESTIMATE.update(RECORDING.meta.numFrames);
         kd_update_video_recording_metainfo();
 
-        // Run the encoding in a separate thread.
-        const auto frameBuffer = RECORDING.activeFrameBuffer;
-        RECORDING.encoderThread = QtConcurrent::run([=]{encode_frame_buffer(frameBuffer);});
-
-        // Meanwhile, switch to the other frame buffer, and keep accumulating new frames.
-        RECORDING.flip_frame_buffer();
+        RECORDING.meta.metainfoTimer.restart();
     }
 
     return;
-#endif
 }
 
 void krecord_stop_recording(void)
 {
-#ifdef USE_OPENCV
+#if defined(USE_LIBAV) || defined(USE_OPENCV)
     DEBUG(("Stopping recording into file '%s'.", RECORDING.meta.filename.c_str()));
 
+    ks_set_recorder_output_enabled(false);
+
+    // Stop capturing audio first, so the encoder thread can encode what's left
+    // of it before exiting.
+    kc_stop_audio_capture();
+
+    // Let the encoder thread finish encoding the frames still in the queue.
+    RECORDING.stopEncoder = true;
     RECORDING.encoderThread.waitForFinished();
-    VIDEO_WRITER.release();
+
+    close_video_encoder();
 
     ke_events().recorder.recordingEnded->fire();
 
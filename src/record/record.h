@@ -11,12 +11,89 @@
 #include "common/globals.h"
 #include "common/types.h"
 
-bool krecord_start_recording(const char *const filename, const uint width, const uint height, const uint frameRate, const bool linearFrameInsertion = true);
+// What the recorder does with new frames when the encoder has fallen behind such
+// that its queue of frames waiting to be encoded is full.
+enum class recording_overflow_e
+{
+    // The new frame is discarded.
+    drop_frames,
+
+    // The capture pipeline waits until the encoder has made room for the frame.
+    block
+};
+
+// The video codecs the recorder can encode with. Only available when VCS has
+// been built with FFmpeg's libraries (USE_LIBAV); otherwise, videos are always
+// encoded as H.264 via OpenCV.
+enum class recording_codec_e
+{
+    // H.264 (x264) in YUV 4:2:0.
+    h264,
+
+    // Lossless H.264 (x264 in RGB, with a quantizer of 0).
+    h264_lossless,
+
+    // FFV1, a lossless intra-frame codec. Fast to encode, but produces large files.
+    ffv1
+};
+
+struct recording_encoder_settings_s
+{
+    recording_codec_e codec = recording_codec_e::h264;
+
+    // The x264 preset, e.g. "ultrafast" or "veryslow".
+    std::string preset = "superfast";
+
+    // The x264 constant rate factor, for lossy H.264.
+    uint crf = 1;
+
+    // How many threads the encoder may use; or 0 to let the encoder decide.
+    uint numThreads = 0;
+
+    // The maximum number of frames between keyframes; or 0 to let the encoder
+    // decide.
+    uint keyframeInterval = 0;
+
+    // Any further codec options, as "key=value:key=value".
+    std::string extraOptions;
+
+    // If true, each frame is given in the video the time at which it was
+    // captured, rather than frames being inserted at the video's constant
+    // playback rate. Overrides linear frame insertion.
+    bool isVariableFrameRate = false;
+
+    // The ALSA device from which to record audio into the video; or empty for a
+    // video without audio. Audio isn't recorded when pre-recording.
+    std::string audioDevice;
+
+    // If nonzero, the video is split into consecutive files of roughly this many
+    // seconds each, named after the video's file with a running number appended.
+    uint segmentLength = 0;
+
+    // If nonzero, the video isn't written to disk as it's recorded; instead, up
+    // to roughly this many of its most recent seconds are held in memory, from
+    // where krecord_save_prerecording() can save them into a file.
+    uint prerecordLength = 0;
+};
+
+bool krecord_start_recording(const char *const filename,
+                             const uint width, const uint height,
+                             const uint frameRate,
+                             const bool linearFrameInsertion = true,
+                             const recording_encoder_settings_s &encoderSettings = recording_encoder_settings_s());
 
 resolution_s krecord_video_resolution(void);
 
 uint krecord_num_frames_recorded(void);
 
+uint krecord_num_frames_dropped(void);
+
+uint krecord_num_frames_blocked(void);
+
+uint krecord_frame_queue_capacity(void);
+
+void krecord_set_overflow_policy(const recording_overflow_e policy);
+
 uint krecord_playback_framerate(void);
 
 i64 krecord_recording_time(void);
@@ -25,6 +102,12 @@ double krecord_recording_framerate(void);
 
 std::string krecord_video_filename(void);
 
+u64 krecord_video_bytesize(void);
+
+bool krecord_is_prerecording(void);
+
+void krecord_save_prerecording(const char *const filename);
+
 bool krecord_is_recording(void);
 
 void krecord_record_new_frame(void);
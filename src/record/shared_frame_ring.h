@@ -0,0 +1,266 @@
+/*
+ * 2020 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ * The layout of the shared-memory ring into which VCS publishes its frames
+ * (see shared_output.h), and a minimal client for reading them from another
+ * process. Linux only. Self-contained and compilable as C or C++, so that it
+ * can be copied into other programs as is.
+ *
+ * The ring lives in the POSIX shared-memory object VCS_SFR_DEFAULT_NAME: a
+ * header, followed by VCS_SFR_NUM_SLOTS slots of pixel data. VCS writes each
+ * frame into the slot after the previous one, without ever waiting for
+ * readers. Each slot is guarded by a sequence lock: its sequence number is odd
+ * while the slot is being written into, and a reader that finds the number
+ * changed after reading the pixels knows that they were overwritten meanwhile.
+ * The header's 'latestFrame' counter is also a futex, woken when a frame is
+ * published.
+ *
+ * Usage:
+ *
+ *     vcs_sfr_reader_s reader;
+ *     if (vcs_sfr_open(&reader, VCS_SFR_DEFAULT_NAME) == 0)
+ *     {
+ *         uint64_t frameNum = 0;
+ *         vcs_sfr_frame_s frame;
+ *
+ *         while (vcs_sfr_wait(&reader, frameNum, 1000) == 0)
+ *         {
+ *             if (vcs_sfr_acquire(&reader, &frame) != 0) continue;
+ *
+ *             // Use frame.pixels (frame.width * frame.height * frame.bpp/8 bytes)
+ *             // in place...
+ *
+ *             if (vcs_sfr_release(&reader, &frame) != 0)
+ *             {
+ *                 // The frame was overwritten while in use; discard any results.
+ *             }
+ *
+ *             frameNum = frame.frameNum;
+ *         }
+ *
+ *         vcs_sfr_close(&reader);
+ *     }
+ *
+ */
+
+#ifndef SHARED_FRAME_RING_H
+#define SHARED_FRAME_RING_H
+
+/* syscall() and struct timespec aren't declared under a strict standard (e.g.
+ * -std=c99) unless the GNU extensions are asked for. This only takes effect if
+ * the header is included before any system header; otherwise, compile with
+ * -D_GNU_SOURCE or a -std=gnu* standard. */
+#ifndef _GNU_SOURCE
+    #define _GNU_SOURCE
+#endif
+
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/futex.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#define VCS_SFR_DEFAULT_NAME "/vcs-frames"
+#define VCS_SFR_MAGIC        0x31524653u /* "SFR1". */
+#define VCS_SFR_VERSION      1u
+#define VCS_SFR_NUM_SLOTS    3u
+
+/* The frames' pixel formats. */
+#define VCS_SFR_FORMAT_BGRA_8888 0u /* 32 bits per pixel; the alpha channel is unused. */
+#define VCS_SFR_FORMAT_RGB_565   1u /* 16 bits per pixel. */
+#define VCS_SFR_FORMAT_RGB_555   2u /* 16 bits per pixel. */
+
+typedef struct
+{
+    /* Odd while the slot is being written into; incremented before and after. */
+    uint64_t sequence;
+
+    /* The number (1, 2, ...) of the frame held in the slot. */
+    uint64_t frameNum;
+
+    uint32_t width;
+    uint32_t height;
+    uint32_t bpp;
+    uint32_t format;
+
+    /* When the frame was captured, and when it was published, in nanoseconds
+     * of CLOCK_MONOTONIC. */
+    int64_t captureTimestamp;
+    int64_t publishTimestamp;
+
+    /* The pixels' position, in bytes from the start of the shared memory. */
+    uint64_t dataOffset;
+} vcs_sfr_slot_s;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numSlots;
+    uint32_t headerSize;
+
+    /* The maximum number of bytes of pixel data in a slot. */
+    uint64_t slotCapacity;
+
+    /* The lower 32 bits of the number of the most recently published frame; or
+     * 0 if none has been. Also serves as the futex that readers wait on. */
+    uint32_t latestFrame;
+    uint32_t padding;
+
+    vcs_sfr_slot_s slots[VCS_SFR_NUM_SLOTS];
+} vcs_sfr_header_s;
+
+/* A frame acquired from the ring. 'pixels' points into the shared memory. */
+typedef struct
+{
+    const uint8_t *pixels;
+    uint64_t frameNum;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bpp;
+    uint32_t format;
+    int64_t captureTimestamp;
+    int64_t publishTimestamp;
+
+    /* For vcs_sfr_release(). */
+    uint32_t slotIdx;
+    uint64_t sequence;
+} vcs_sfr_frame_s;
+
+typedef struct
+{
+    const vcs_sfr_header_s *header;
+    uint64_t size;
+} vcs_sfr_reader_s;
+
+/* Maps the given shared-memory ring into the calling process, read-only.
+ * Returns 0 on success; or -1 on failure, with errno set. */
+static inline int vcs_sfr_open(vcs_sfr_reader_s *reader, const char *name)
+{
+    struct stat st;
+    void *mapping;
+    const int fd = shm_open(name, O_RDONLY, 0);
+
+    if (fd < 0) return -1;
+
+    if ((fstat(fd, &st) != 0) ||
+        ((uint64_t)st.st_size < sizeof(vcs_sfr_header_s)))
+    {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) return -1;
+
+    reader->header = (const vcs_sfr_header_s*)mapping;
+    reader->size = (uint64_t)st.st_size;
+
+    if ((reader->header->magic != VCS_SFR_MAGIC) ||
+        (reader->header->version != VCS_SFR_VERSION))
+    {
+        munmap(mapping, (size_t)reader->size);
+        reader->header = NULL;
+        errno = EPROTO;
+        return -1;
+    }
+
+    return 0;
+}
+
+static inline void vcs_sfr_close(vcs_sfr_reader_s *reader)
+{
+    if (reader->header)
+    {
+        munmap((void*)reader->header, (size_t)reader->size);
+        reader->header = NULL;
+    }
+
+    return;
+}
+
+/* Waits for up to the given number of milliseconds for a frame newer than the
+ * given one to be published. Returns 0 if there is one; or -1 on timeout or
+ * error, with errno set. */
+static inline int vcs_sfr_wait(const vcs_sfr_reader_s *reader, const uint64_t frameNum, const unsigned timeoutMs)
+{
+    const uint32_t *const futex = &reader->header->latestFrame;
+    struct timespec timeout;
+
+    timeout.tv_sec = (timeoutMs / 1000);
+    timeout.tv_nsec = ((long)(timeoutMs % 1000) * 1000000);
+
+    for (;;)
+    {
+        const uint32_t latest = __atomic_load_n(futex, __ATOMIC_ACQUIRE);
+
+        if (latest != (uint32_t)frameNum) return 0;
+
+        /* The wait returns at once if VCS has published a frame since the load. */
+        if ((syscall(SYS_futex, futex, FUTEX_WAIT, latest, &timeout, NULL, 0) != 0) &&
+            (errno != EAGAIN) &&
+            (errno != EINTR))
+        {
+            return -1;
+        }
+
+        if (__atomic_load_n(futex, __ATOMIC_ACQUIRE) == latest)
+        {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+    }
+}
+
+/* Gets the most recently published frame, without copying its pixels. The
+ * pixels stay valid until VCS has published VCS_SFR_NUM_SLOTS - 1 more frames;
+ * vcs_sfr_release() tells whether that happened. Returns 0 on success; or -1 if
+ * no frame is available, e.g. because VCS is writing into the slot. */
+static inline int vcs_sfr_acquire(const vcs_sfr_reader_s *reader, vcs_sfr_frame_s *frame)
+{
+    const vcs_sfr_header_s *const header = reader->header;
+    const uint32_t latest = __atomic_load_n(&header->latestFrame, __ATOMIC_ACQUIRE);
+    const uint32_t slotIdx = ((latest - 1) % VCS_SFR_NUM_SLOTS);
+    const vcs_sfr_slot_s *const slot = &header->slots[slotIdx];
+
+    if (!latest) return -1;
+
+    frame->sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    if (frame->sequence & 1) return -1;
+
+    frame->slotIdx = slotIdx;
+    frame->frameNum = slot->frameNum;
+    frame->width = slot->width;
+    frame->height = slot->height;
+    frame->bpp = slot->bpp;
+    frame->format = slot->format;
+    frame->captureTimestamp = slot->captureTimestamp;
+    frame->publishTimestamp = slot->publishTimestamp;
+    frame->pixels = ((const uint8_t*)header + slot->dataOffset);
+
+    /* Make sure the metadata we read belongs to the sequence we read. */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != frame->sequence) return -1;
+
+    return 0;
+}
+
+/* Returns 0 if the given acquired frame's pixels were not overwritten while
+ * the caller was using them; or -1 if they may have been. */
+static inline int vcs_sfr_release(const vcs_sfr_reader_s *reader, const vcs_sfr_frame_s *frame)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return ((__atomic_load_n(&reader->header->slots[frame->slotIdx].sequence, __ATOMIC_RELAXED) == frame->sequence)? 0 : -1);
+}
+
+#endif
@@ -0,0 +1,294 @@
+/*
+ * 2020 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ * Publishes VCS's frames into a POSIX shared-memory ring, for other processes
+ * (e.g. analysis tools) to read without having to scrape the output window.
+ *
+ * Each new frame is copied once, into the next of the ring's slots; readers map
+ * the ring and use the pixels in place. VCS never waits on the readers: a
+ * reader that's too slow to finish with a slot before it comes round again is
+ * told so by the slot's sequence lock, and simply misses frames.
+ *
+ * The ring's slots are sized for the largest frame VCS can produce, but the
+ * shared memory is only reserved for as much of each slot as its frames have
+ * needed, so a ring of small frames takes little memory. The memory is
+ * reserved up front (with posix_fallocate()) rather than on being written
+ * into, so that running out of it - e.g. in a container with a small
+ * /dev/shm - stops the output with an error rather than crashing VCS.
+ *
+ */
+
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+#include <climits>
+#include <string>
+#include <chrono>
+#include "common/propagate/app_events.h"
+#include "display/display.h"
+#include "common/globals.h"
+#include "capture/capture_api.h"
+#include "capture/capture.h"
+#include "scaler/scaler.h"
+#include "record/shared_output.h"
+
+#ifdef __linux__
+    #include "record/shared_frame_ring.h"
+#endif
+
+static struct shared_output_s
+{
+    bool isActive = false;
+
+    shared_output_source_e source = shared_output_source_e::scaler_output;
+
+    u64 numFramesPublished = 0;
+
+#ifdef __linux__
+    vcs_sfr_header_s *header = nullptr;
+    u64 size = 0;
+    int fd = -1;
+
+    // How many bytes of each slot have been reserved in the shared memory.
+    u64 slotReservedSize[VCS_SFR_NUM_SLOTS] = {0};
+#endif
+} SHARED_OUTPUT;
+
+#ifdef __linux__
+// Copies VCS's most recent frame into the next slot of the ring, and wakes any
+// readers waiting for it.
+//
+static void publish_new_frame(void)
+{
+    vcs_sfr_header_s *const header = SHARED_OUTPUT.header;
+    const captured_frame_s &capturedFrame = kc_capture_api().get_frame_buffer();
+
+    const u8 *pixels = nullptr;
+    resolution_s resolution = {0, 0, 0};
+    u32 format = VCS_SFR_FORMAT_BGRA_8888;
+
+    if (SHARED_OUTPUT.source == shared_output_source_e::raw_capture)
+    {
+        pixels = capturedFrame.pixels.ptr();
+        resolution = capturedFrame.r;
+
+        switch (capturedFrame.pixelFormat)
+        {
+            case capture_pixel_format_e::rgb_555: format = VCS_SFR_FORMAT_RGB_555; break;
+            case capture_pixel_format_e::rgb_565: format = VCS_SFR_FORMAT_RGB_565; break;
+            default: break;
+        }
+    }
+    else
+    {
+        pixels = ks_scaler_output_as_raw_ptr();
+        resolution = ks_scaler_output_resolution();
+        resolution.bpp = 32;
+    }
+
+    const u64 numBytes = (u64(resolution.w) * resolution.h * (resolution.bpp / 8));
+    if (!pixels ||
+        !numBytes ||
+        (numBytes > header->slotCapacity))
+    {
+        return;
+    }
+
+    const u64 frameNum = (SHARED_OUTPUT.numFramesPublished + 1);
+    const u32 slotIdx = ((u32(frameNum) - 1) % VCS_SFR_NUM_SLOTS);
+    vcs_sfr_slot_s &slot = header->slots[slotIdx];
+
+    // Make sure the shared memory has room for the frame; writing past what's
+    // available would raise SIGBUS.
+    if (numBytes > SHARED_OUTPUT.slotReservedSize[slotIdx])
+    {
+        const int ret = posix_fallocate(SHARED_OUTPUT.fd, off_t(slot.dataOffset), off_t(numBytes));
+
+        if (ret != 0)
+        {
+            kd_show_headless_error_message("VCS can't publish frames into shared memory",
+                                           ("Ran out of room in the shared memory \"" VCS_SFR_DEFAULT_NAME "\": " + std::string(strerror(ret)) +
+                                            ". Stopping the output.").c_str());
+
+            kshm_stop_output();
+
+            return;
+        }
+
+        SHARED_OUTPUT.slotReservedSize[slotIdx] = numBytes;
+    }
+
+    SHARED_OUTPUT.numFramesPublished = frameNum;
+
+    // Mark the slot as being written into, so that readers of the frame it
+    // previously held know to discard it.
+    const u64 sequence = __atomic_load_n(&slot.sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot.sequence, (sequence + 1), __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memcpy(((u8*)header + slot.dataOffset), pixels, numBytes);
+    slot.frameNum = frameNum;
+    slot.width = resolution.w;
+    slot.height = resolution.h;
+    slot.bpp = resolution.bpp;
+    slot.format = format;
+    slot.captureTimestamp = capturedFrame.timestamp;
+    slot.publishTimestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    __atomic_store_n(&slot.sequence, (sequence + 2), __ATOMIC_RELEASE);
+    __atomic_store_n(&header->latestFrame, u32(frameNum), __ATOMIC_RELEASE);
+
+    syscall(SYS_futex, &header->latestFrame, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+
+    return;
+}
+#endif
+
+void kshm_initialize(void)
+{
+    ke_events().scaler.newFrame->subscribe([]
+    {
+#ifdef __linux__
+        if (kshm_is_output_active())
+        {
+            publish_new_frame();
+        }
+#endif
+    });
+
+    return;
+}
+
+void kshm_release(void)
+{
+    kshm_stop_output();
+
+    return;
+}
+
+bool kshm_start_output(const shared_output_source_e source)
+{
+    if (kshm_is_output_active())
+    {
+        kshm_stop_output();
+    }
+
+#ifdef __linux__
+    const auto fail = [](const std::string &reason)->bool
+    {
+        kd_show_headless_error_message("VCS can't publish frames into shared memory",
+                                       ("An error was encountered while setting up the shared memory \"" VCS_SFR_DEFAULT_NAME "\": " + reason).c_str());
+        return false;
+    };
+
+    const u64 headerSize = (((sizeof(vcs_sfr_header_s) + 4095) / 4096) * 4096);
+    const u64 slotCapacity = MAX_FRAME_SIZE;
+    const u64 size = (headerSize + (slotCapacity * VCS_SFR_NUM_SLOTS));
+
+    const int fd = shm_open(VCS_SFR_DEFAULT_NAME, (O_CREAT | O_RDWR), 0644);
+    if (fd < 0)
+    {
+        return fail(strerror(errno));
+    }
+
+    // Truncating first clears any data left over from a previous run. Only the
+    // header's memory is reserved for now; the slots' as frames need it.
+    int fallocateError = 0;
+    if ((ftruncate(fd, 0) != 0) ||
+        (ftruncate(fd, off_t(size)) != 0) ||
+        ((fallocateError = posix_fallocate(fd, 0, off_t(headerSize))) != 0))
+    {
+        const std::string error = strerror(fallocateError? fallocateError : errno);
+        close(fd);
+        shm_unlink(VCS_SFR_DEFAULT_NAME);
+        return fail(error);
+    }
+
+    void *const mapping = mmap(nullptr, size, (PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0);
+
+    if (mapping == MAP_FAILED)
+    {
+        const std::string error = strerror(errno);
+        close(fd);
+        shm_unlink(VCS_SFR_DEFAULT_NAME);
+        return fail(error);
+    }
+
+    vcs_sfr_header_s *const header = (vcs_sfr_header_s*)mapping;
+    header->version = VCS_SFR_VERSION;
+    header->numSlots = VCS_SFR_NUM_SLOTS;
+    header->headerSize = u32(headerSize);
+    header->slotCapacity = slotCapacity;
+    for (uint i = 0; i < VCS_SFR_NUM_SLOTS; i++)
+    {
+        header->slots[i].dataOffset = (headerSize + (i * slotCapacity));
+    }
+
+    // Readers take the magic number to mean that the header is ready.
+    __atomic_store_n(&header->magic, VCS_SFR_MAGIC, __ATOMIC_RELEASE);
+
+    SHARED_OUTPUT.header = header;
+    SHARED_OUTPUT.size = size;
+    SHARED_OUTPUT.fd = fd;
+    std::fill(std::begin(SHARED_OUTPUT.slotReservedSize), std::end(SHARED_OUTPUT.slotReservedSize), 0);
+    SHARED_OUTPUT.source = source;
+    SHARED_OUTPUT.numFramesPublished = 0;
+    SHARED_OUTPUT.isActive = true;
+
+    INFO(("Publishing frames into the shared memory \"%s\".", VCS_SFR_DEFAULT_NAME));
+
+    return true;
+#else
+    (void)source;
+
+    kd_show_headless_error_message("VCS can't publish frames into shared memory",
+                                   "Shared-memory output is only available on Linux.");
+
+    return false;
+#endif
+}
+
+void kshm_stop_output(void)
+{
+    if (!SHARED_OUTPUT.isActive)
+    {
+        return;
+    }
+
+#ifdef __linux__
+    // Readers that still have the memory mapped can keep it until they unmap it.
+    munmap(SHARED_OUTPUT.header, SHARED_OUTPUT.size);
+    close(SHARED_OUTPUT.fd);
+    shm_unlink(VCS_SFR_DEFAULT_NAME);
+
+    SHARED_OUTPUT.header = nullptr;
+    SHARED_OUTPUT.size = 0;
+    SHARED_OUTPUT.fd = -1;
+#endif
+
+    SHARED_OUTPUT.isActive = false;
+
+    INFO(("Stopped publishing frames into shared memory, having published %llu.",
+          (unsigned long long)SHARED_OUTPUT.numFramesPublished));
+
+    return;
+}
+
+bool kshm_is_output_active(void)
+{
+    return SHARED_OUTPUT.isActive;
+}
+
+void kshm_set_output_source(const shared_output_source_e source)
+{
+    SHARED_OUTPUT.source = source;
+
+    return;
+}
+
+u64 kshm_num_frames_published(void)
+{
+    return SHARED_OUTPUT.numFramesPublished;
+}
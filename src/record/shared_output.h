@@ -0,0 +1,41 @@
+/*
+ * 2020 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+#ifndef SHARED_OUTPUT_H
+#define SHARED_OUTPUT_H
+
+#include "common/types.h"
+
+enum class shared_output_source_e
+{
+    // Frames as they're shown in the output window: filtered, anti-teared, and
+    // scaled.
+    scaler_output,
+
+    // Frames as they're received from the capture device.
+    raw_capture
+};
+
+// Starts publishing VCS's frames into a POSIX shared-memory ring, from where
+// other processes can read them; see shared_frame_ring.h for the ring's layout
+// and a client. Only available on Linux. Returns true on success; false
+// otherwise, having notified the user of the error.
+bool kshm_start_output(const shared_output_source_e source);
+
+void kshm_stop_output(void);
+
+bool kshm_is_output_active(void);
+
+void kshm_set_output_source(const shared_output_source_e source);
+
+u64 kshm_num_frames_published(void);
+
+void kshm_initialize(void);
+
+void kshm_release(void);
+
+#endif
@@ -52,10 +52,70 @@ static heap_bytes_s<u8> OUTPUT_BUFFER;
 static heap_bytes_s<u8> COLORCONV_BUFFER;
 static heap_bytes_s<u8> TMP_BUFFER;
 
+// Frames are cropped down to the filter chain's region of interest, if it has
+// one, before they're filtered and scaled (see kf_filter_chain_roi()); here
+// unless the capture device already did the cropping.
+static heap_bytes_s<u8> ROI_BUFFER;
+
+// The region of interest most recently asked of the capture device.
+static frame_region_s HARDWARE_ROI_REQUEST = {0, 0, 0, 0};
+
+// If true, the capture device is asked to scale frames down to the output
+// resolution when nothing in the pipeline needs them at their full resolution,
+// leaving the scaler only the residual; e.g. padding for the aspect ratio.
+static bool HARDWARE_SCALING = false;
+
+// The size to which the capture device was most recently asked to scale frames.
+static resolution_s HARDWARE_SCALING_REQUEST = {0, 0, 0};
+
+// When the frame being scaled is smaller than the captured source frame - having
+// been cropped to a region of interest, or scaled down by the capture device -
+// the frame's resolution and that of the source frame. The frame is scaled to
+// the aspect ratio of the latter; as it would have been had e.g. the crop filter
+// stretched the region back to the frame's full size.
+static resolution_s REDUCED_FRAME_RES = {0, 0, 0};
+static resolution_s REDUCED_FRAME_SOURCE_RES = {0, 0, 0};
+
+// Besides the display, the scaler can output frames for the recorder, which may
+// want them at a different resolution, and scaled with a different filter. The
+// recorder's frames get their own output and scratch buffers; except that when
+// they'd come out the same as the display's frames, the recorder is pointed at
+// the display's output instead of the frame being scaled twice.
+static struct
+{
+    bool isEnabled = false;
+
+    // The resolution at which the recorder wants its frames.
+    resolution_s resolution = {0, 0, 32};
+
+    // The filter with which frames are scaled for the recorder. If null, the
+    // display's up/downscaling filters are used.
+    const scaling_filter_s *filter = nullptr;
+
+    heap_bytes_s<u8> outputBuffer;
+    heap_bytes_s<u8> scratchBuffer;
+
+    // The recorder's most recent frame; either in the above output buffer, or
+    // shared with the display.
+    const u8 *output = nullptr;
+    resolution_s outputRes = {0, 0, 0};
+} RECORDER_OUTPUT;
+
 static aspect_mode_e ASPECT_MODE = aspect_mode_e::native;
 static bool FORCE_ASPECT = true;
 
-static resolution_s LATEST_OUTPUT_SIZE = {0, 0, 0}; // The size of the image currently in the scaler's output buffer.
+static resolution_s LATEST_OUTPUT_SIZE = {0, 0, 0}; // The resolution at which the most recent frame was output.
+static resolution_s OUTPUT_BUFFER_RES = {0, 0, 0};  // The size of the image currently in the scaler's output buffer.
+static const scaling_filter_s *OUTPUT_BUFFER_FILTER = nullptr; // The filter that scaled the image in the output buffer; or null if it wasn't scaled.
+
+// If true, the scaler won't scale frames to the output resolution, but will leave
+// them in its output buffer at their native (filtered) resolution for the renderer
+// to scale; e.g. the OpenGL renderer can do so in its shaders.
+static bool DEFER_SCALING = false;
+
+// Whether a renderer that scales deferred frames should do so only by integer
+// multiples of the frame's size.
+static bool INTEGER_SCALING = false;
 
 static const u32 OUTPUT_BIT_DEPTH = 32;             // The bit depth we're currently scaling to.
 
@@ -99,14 +159,6 @@ resolution_s ks_output_base_resolution(void)
 //
 resolution_s ks_output_resolution(void)
 {
-    // While recording video, the output resolution is required to stay locked
-    // to the video resolution.
-    if (krecord_is_recording())
-    {
-        const auto r = krecord_video_resolution();
-        return {r.w, r.h, OUTPUT_BIT_DEPTH};
-    }
-
     resolution_s inRes = kc_capture_api().get_resolution();
     resolution_s outRes = inRes;
 
@@ -154,13 +206,33 @@ bool ks_is_forced_aspect_enabled(void)
     return FORCE_ASPECT;
 }
 
-#if USE_OPENCV
+// Returns true if the scaler is leaving the scaling of frames to the renderer.
+// The recorder gets its frames scaled separately, so is unaffected by this.
+//
+bool ks_is_deferred_scaling_enabled(void)
+{
+    return DEFER_SCALING;
+}
+
+bool ks_is_hardware_scaling_enabled(void)
+{
+    return HARDWARE_SCALING;
+}
+
+bool ks_is_integer_scaling_enabled(void)
+{
+    return INTEGER_SCALING;
+}
+
 // Returns a resolution corresponding to sourceRes scaled up to targetRes but
 // maintaining sourceRes's aspect ratio according to the scaler's current aspect
 // mode.
 //
-static resolution_s padded_resolution(const resolution_s &sourceRes, const resolution_s &targetRes)
+static resolution_s padded_resolution(const resolution_s &frameRes, const resolution_s &targetRes)
 {
+    const bool isReduced = ((frameRes.w == REDUCED_FRAME_RES.w) && (frameRes.h == REDUCED_FRAME_RES.h));
+    const resolution_s sourceRes = (isReduced? REDUCED_FRAME_SOURCE_RES : frameRes);
+
     const resolution_s aspect = [sourceRes]()->resolution_s
     {
         switch (ASPECT_MODE)
@@ -196,6 +268,21 @@ static resolution_s padded_resolution(const resolution_s &sourceRes, const resol
     return {w, h, OUTPUT_BIT_DEPTH};
 }
 
+// Returns the resolution within targetRes that a frame of sourceRes should occupy
+// given the current aspect ratio settings; for renderers that scale the scaler's
+// deferred output themselves.
+//
+resolution_s ks_padded_output_resolution(const resolution_s &sourceRes, const resolution_s &targetRes)
+{
+    if (!FORCE_ASPECT)
+    {
+        return {targetRes.w, targetRes.h, OUTPUT_BIT_DEPTH};
+    }
+
+    return padded_resolution(sourceRes, targetRes);
+}
+
+#if USE_OPENCV
 // Returns border padding sizes for cv::copyMakeBorder()
 //
 static cv::Vec4i border_padding(const resolution_s &paddedRes, const resolution_s &targetRes)
@@ -223,6 +310,7 @@ void copy_with_border(const cv::Mat &src, cv::Mat &dst, const cv::Vec4i &borderS
 //
 void opencv_scale(u8 *const pixelData,
                   u8 *const outputBuffer,
+                  u8 *const scratchBuffer,
                   const resolution_s &sourceRes,
                   const resolution_s &targetRes,
                   const cv::InterpolationFlags interpolator)
@@ -233,7 +321,7 @@ void opencv_scale(u8 *const pixelData,
     if (ks_is_forced_aspect_enabled())
     {
         const resolution_s paddedRes = padded_resolution(sourceRes, targetRes);
-        cv::Mat tmp = cv::Mat(paddedRes.h, paddedRes.w, CV_8UC4, TMP_BUFFER.ptr());
+        cv::Mat tmp = cv::Mat(paddedRes.h, paddedRes.w, CV_8UC4, scratchBuffer);
 
         if ((paddedRes.h == targetRes.h) &&
             (paddedRes.w == targetRes.w))
@@ -267,7 +355,7 @@ void s_scaler_nearest(SCALER_FUNC_PARAMS)
     }
 
     #if USE_OPENCV
-        opencv_scale(pixelData, OUTPUT_BUFFER.ptr(), sourceRes, targetRes, cv::INTER_NEAREST);
+        opencv_scale(pixelData, outputBuffer, scratchBuffer, sourceRes, targetRes, cv::INTER_NEAREST);
     #else
         /// TODO. Implement a non-OpenCV nearest scaler so there's a basic fallback.
         k_assert(0, "Attempted to use a scaling filter that hasn't been implemented for non-OpenCV builds.");
@@ -286,7 +374,7 @@ void s_scaler_linear(SCALER_FUNC_PARAMS)
     }
 
     #if USE_OPENCV
-        opencv_scale(pixelData, OUTPUT_BUFFER.ptr(), sourceRes, targetRes, cv::INTER_LINEAR);
+        opencv_scale(pixelData, outputBuffer, scratchBuffer, sourceRes, targetRes, cv::INTER_LINEAR);
     #else
         k_assert(0, "Attempted to use a scaling filter that hasn't been implemented for non-OpenCV builds.");
     #endif
@@ -304,7 +392,7 @@ void s_scaler_area(SCALER_FUNC_PARAMS)
     }
 
     #if USE_OPENCV
-        opencv_scale(pixelData, OUTPUT_BUFFER.ptr(), sourceRes, targetRes, cv::INTER_AREA);
+        opencv_scale(pixelData, outputBuffer, scratchBuffer, sourceRes, targetRes, cv::INTER_AREA);
     #else
         k_assert(0, "Attempted to use a scaling filter that hasn't been implemented for non-OpenCV builds.");
     #endif
@@ -322,7 +410,7 @@ void s_scaler_cubic(SCALER_FUNC_PARAMS)
     }
 
     #if USE_OPENCV
-        opencv_scale(pixelData, OUTPUT_BUFFER.ptr(), sourceRes, targetRes, cv::INTER_CUBIC);
+        opencv_scale(pixelData, outputBuffer, scratchBuffer, sourceRes, targetRes, cv::INTER_CUBIC);
     #else
         k_assert(0, "Attempted to use a scaling filter that hasn't been implemented for non-OpenCV builds.");
     #endif
@@ -340,7 +428,7 @@ void s_scaler_lanczos(SCALER_FUNC_PARAMS)
     }
 
     #if USE_OPENCV
-        opencv_scale(pixelData, OUTPUT_BUFFER.ptr(), sourceRes, targetRes, cv::INTER_LANCZOS4);
+        opencv_scale(pixelData, outputBuffer, scratchBuffer, sourceRes, targetRes, cv::INTER_LANCZOS4);
     #else
         k_assert(0, "Attempted to use a scaling filter that hasn't been implemented for non-OpenCV builds.");
     #endif
@@ -382,6 +470,7 @@ void ks_initialize_scaler(void)
     OUTPUT_BUFFER.alloc(MAX_FRAME_SIZE, "Scaler output buffer");
     COLORCONV_BUFFER.alloc(MAX_FRAME_SIZE, "Scaler color convertion buffer");
     TMP_BUFFER.alloc(MAX_FRAME_SIZE, "Scaler scratch buffer");
+    ROI_BUFFER.alloc(MAX_FRAME_SIZE, "Scaler region of interest buffer");
 
     ks_set_upscaling_filter(SCALING_FILTERS.at(0).name);
     ks_set_downscaling_filter(SCALING_FILTERS.at(0).name);
@@ -399,6 +488,10 @@ void ks_initialize_scaler(void)
     {
         const auto currentInputRes = kc_capture_api().get_resolution();
         ks_set_output_base_resolution(currentInputRes, false);
+
+        // The capture device stops cropping and scaling on a new video mode.
+        HARDWARE_ROI_REQUEST = {0, 0, 0, 0};
+        HARDWARE_SCALING_REQUEST = {0, 0, 0};
     });
 
     ke_events().capture.invalidSignal->subscribe([]
@@ -423,6 +516,13 @@ void ks_release_scaler(void)
     COLORCONV_BUFFER.release_memory();
     OUTPUT_BUFFER.release_memory();
     TMP_BUFFER.release_memory();
+    ROI_BUFFER.release_memory();
+
+    if (!RECORDER_OUTPUT.outputBuffer.is_null())
+    {
+        RECORDER_OUTPUT.outputBuffer.release_memory();
+        RECORDER_OUTPUT.scratchBuffer.release_memory();
+    }
 
     return;
 }
@@ -483,16 +583,74 @@ void s_convert_frame_to_bgra(const captured_frame_s &frame)
     return;
 }
 
+// Produces the recorder's version of the given (color-converted, filtered) frame.
+// Expects the display's version of the frame to already be in the output buffer.
+//
+static void scale_for_recorder(u8 *const pixelData, const resolution_s &frameRes)
+{
+    const resolution_s targetRes = RECORDER_OUTPUT.resolution;
+
+    RECORDER_OUTPUT.output = nullptr;
+    RECORDER_OUTPUT.outputRes = targetRes;
+
+    const scaling_filter_s *scaler = RECORDER_OUTPUT.filter;
+    if (!scaler)
+    {
+        scaler = (((frameRes.w < targetRes.w) || (frameRes.h < targetRes.h))? UPSCALE_FILTER : DOWNSCALE_FILTER);
+    }
+
+    // If the display's frame already came out as the recorder wants it, share it.
+    if ((OUTPUT_BUFFER_RES.w == targetRes.w) &&
+        (OUTPUT_BUFFER_RES.h == targetRes.h) &&
+        (!OUTPUT_BUFFER_FILTER || (OUTPUT_BUFFER_FILTER == scaler)))
+    {
+        RECORDER_OUTPUT.output = OUTPUT_BUFFER.ptr();
+    }
+    // If the recorder wants the frame at its native resolution, it can have it
+    // as it is. The frame stays valid until the scaler's new frame event has
+    // been handled.
+    else if ((!FORCE_ASPECT || ASPECT_MODE == aspect_mode_e::native) &&
+             (frameRes.w == targetRes.w) &&
+             (frameRes.h == targetRes.h))
+    {
+        RECORDER_OUTPUT.output = pixelData;
+    }
+    else if (scaler)
+    {
+        scaler->scale(pixelData, frameRes, targetRes, RECORDER_OUTPUT.outputBuffer.ptr(), RECORDER_OUTPUT.scratchBuffer.ptr());
+        RECORDER_OUTPUT.output = RECORDER_OUTPUT.outputBuffer.ptr();
+    }
+    else
+    {
+        NBENE(("The recorder's scaling filter is null. Refusing to scale."));
+    }
+
+    return;
+}
+
 // Takes the given image and scales it according to the scaler's current internal
 // resolution settings. The scaled image is placed in the scaler's internal buffer,
 // not in the source buffer.
 //
 void ks_scale_frame(const captured_frame_s &frame)
 {
+    // Until the frame has been scaled for the recorder, there's nothing for it.
+    RECORDER_OUTPUT.output = nullptr;
+
     u8 *pixelData = frame.pixels.ptr();
     resolution_s frameRes = frame.r; /// Temp hack. May want to modify the .bpp value.
     resolution_s outputRes = ks_output_resolution();
 
+    // The frame's resolution before any cropping or scaling by the capture device.
+    const resolution_s sourceRes = (frame.roi.w? resolution_s{kc_capture_api().get_resolution().w,
+                                                                 kc_capture_api().get_resolution().h,
+                                                                 frame.r.bpp}
+                                                  : frame.r);
+
+    // Whether the frame has been cropped to exactly the filter chain's region
+    // of interest, by us or by the capture device.
+    bool isCroppedToRoi = false;
+
     const resolution_s minres = kc_capture_api().get_minimum_resolution();
     const resolution_s maxres = kc_capture_api().get_maximum_resolution();
 
@@ -527,18 +685,18 @@ void ks_scale_frame(const captured_frame_s &frame)
                    frame.r.bpp, MAX_OUTPUT_BPP));
             goto done;
         }
-        else if (frame.r.w < minres.w ||
-                 frame.r.h < minres.h)
+        else if (sourceRes.w < minres.w ||
+                 sourceRes.h < minres.h)
         {
             NBENE(("Was asked to scale a frame with an input size (%u x %u) smaller than the minimum allowed (%u x %u). Ignoring it.",
-                   frame.r.w, frame.r.h, minres.w, minres.h));
+                   sourceRes.w, sourceRes.h, minres.w, minres.h));
             goto done;
         }
-        else if (frame.r.w > maxres.w ||
-                 frame.r.h > maxres.h)
+        else if (sourceRes.w > maxres.w ||
+                 sourceRes.h > maxres.h)
         {
             NBENE(("Was asked to scale a frame with an input size (%u x %u) larger than the maximum allowed (%u x %u). Ignoring it.",
-                   frame.r.w, frame.r.h, maxres.w, maxres.h));
+                   sourceRes.w, sourceRes.h, maxres.w, maxres.h));
             goto done;
         }
         else if (OUTPUT_BUFFER.is_null())
@@ -560,6 +718,102 @@ void ks_scale_frame(const captured_frame_s &frame)
         pixelData = COLORCONV_BUFFER.ptr();
     }
 
+    // Crop the frame down to the filter chain's region of interest, if any, so
+    // that the rest of the pipeline needn't process the pixels outside of it; or,
+    // if nothing needs the frame at its full resolution, have it scaled down to
+    // the output resolution. The capture device is asked to do these for us, if
+    // it can. Anti-tearing's scan range is in scanlines of the source frame, so
+    // the frame is left whole for it.
+    {
+        const frame_region_s roi = (kat_is_anti_tear_enabled()? frame_region_s{0, 0, 0, 0} : kf_filter_chain_roi(sourceRes));
+
+        if (roi != HARDWARE_ROI_REQUEST)
+        {
+            kc_capture_api().set_hardware_roi(roi);
+            HARDWARE_ROI_REQUEST = roi;
+        }
+
+        const resolution_s hardwareScaling = [&]()->resolution_s
+        {
+            if (!HARDWARE_SCALING ||
+                roi.w ||
+                DEFER_SCALING ||
+                kat_is_anti_tear_enabled() ||
+                kf_filter_chain_needs_full_resolution(sourceRes))
+            {
+                return {0, 0, 0};
+            }
+
+            const resolution_s targetRes = (FORCE_ASPECT? padded_resolution(sourceRes, outputRes) : outputRes);
+
+            if ((targetRes.w > sourceRes.w) ||
+                (targetRes.h > sourceRes.h) ||
+                ((targetRes.w == sourceRes.w) && (targetRes.h == sourceRes.h)) ||
+                (RECORDER_OUTPUT.isEnabled && ((RECORDER_OUTPUT.resolution.w > targetRes.w) ||
+                                               (RECORDER_OUTPUT.resolution.h > targetRes.h))))
+            {
+                return {0, 0, 0};
+            }
+
+            return {targetRes.w, targetRes.h, 0};
+        }();
+
+        if ((hardwareScaling.w != HARDWARE_SCALING_REQUEST.w) ||
+            (hardwareScaling.h != HARDWARE_SCALING_REQUEST.h))
+        {
+            kc_capture_api().set_hardware_scaling(hardwareScaling);
+            HARDWARE_SCALING_REQUEST = hardwareScaling;
+        }
+
+        // The region of the source frame that the frame holds.
+        const frame_region_s heldRegion = (frame.roi.w? frame.roi : frame_region_s{0, 0, sourceRes.w, sourceRes.h});
+        const bool isHardwareScaled = ((frame.r.w != heldRegion.w) || (frame.r.h != heldRegion.h));
+
+        if (roi.w &&
+            !isHardwareScaled &&
+            (roi != heldRegion) &&
+            (roi.x >= heldRegion.x) &&
+            (roi.y >= heldRegion.y) &&
+            ((roi.x + roi.w) <= (heldRegion.x + heldRegion.w)) &&
+            ((roi.y + roi.h) <= (heldRegion.y + heldRegion.h)))
+        {
+            const uint bytesPerPixel = (frameRes.bpp / 8);
+            const uint srcRowSize = (heldRegion.w * bytesPerPixel);
+            const uint dstRowSize = (roi.w * bytesPerPixel);
+            const u8 *const src = (pixelData + ((roi.y - heldRegion.y) * srcRowSize) + ((roi.x - heldRegion.x) * bytesPerPixel));
+
+            for (uint y = 0; y < roi.h; y++)
+            {
+                memcpy((ROI_BUFFER.ptr() + (y * dstRowSize)), (src + (y * srcRowSize)), dstRowSize);
+            }
+
+            pixelData = ROI_BUFFER.ptr();
+            frameRes.w = roi.w;
+            frameRes.h = roi.h;
+            isCroppedToRoi = true;
+        }
+        else if (roi.w &&
+                 !isHardwareScaled &&
+                 (roi == heldRegion))
+        {
+            isCroppedToRoi = true;
+        }
+
+        // Otherwise, the frame is passed on as it is; also if the capture device
+        // has cropped or scaled it in a way that no longer matches what we've
+        // asked, as can happen for a frame or two after asking.
+        if ((frameRes.w != sourceRes.w) ||
+            (frameRes.h != sourceRes.h))
+        {
+            REDUCED_FRAME_RES = frameRes;
+            REDUCED_FRAME_SOURCE_RES = sourceRes;
+        }
+        else
+        {
+            REDUCED_FRAME_RES = REDUCED_FRAME_SOURCE_RES = {0, 0, 0};
+        }
+    }
+
     // Perform anti-tearing on the (color-converted) frame. If the user has turned
     // anti-tearing off, this will just return without doing anything.
     pixelData = kat_anti_tear(pixelData, frameRes);
@@ -570,12 +824,21 @@ void ks_scale_frame(const captured_frame_s &frame)
 
     // Apply filtering, and scale the frame.
     {
-        kf_apply_filter_chain(pixelData, frameRes);
+        kf_apply_filter_chain(pixelData, frameRes, (REDUCED_FRAME_RES.w? &sourceRes : nullptr), isCroppedToRoi);
+
+        OUTPUT_BUFFER_RES = outputRes;
+        OUTPUT_BUFFER_FILTER = nullptr;
 
-        // If no need to scale, just copy the data over.
-        if ((!FORCE_ASPECT || ASPECT_MODE == aspect_mode_e::native) &&
-            frameRes.w == outputRes.w &&
-            frameRes.h == outputRes.h)
+        // If no need to scale, just copy the data over. If the renderer will
+        // be doing the scaling, it'll want the frame at its native resolution.
+        if (ks_is_deferred_scaling_enabled())
+        {
+            memcpy(OUTPUT_BUFFER.ptr(), pixelData, OUTPUT_BUFFER.up_to(frameRes.w * frameRes.h * (frameRes.bpp / 8)));
+            OUTPUT_BUFFER_RES = frameRes;
+        }
+        else if ((!FORCE_ASPECT || ASPECT_MODE == aspect_mode_e::native) &&
+                 frameRes.w == outputRes.w &&
+                 frameRes.h == outputRes.h)
         {
             memcpy(OUTPUT_BUFFER.ptr(), pixelData, OUTPUT_BUFFER.up_to(frameRes.w * frameRes.h * (frameRes.bpp / 8)));
         }
@@ -598,15 +861,22 @@ void ks_scale_frame(const captured_frame_s &frame)
                 NBENE(("Upscale or downscale filter is null. Refusing to scale."));
 
                 outputRes = frameRes;
+                OUTPUT_BUFFER_RES = frameRes;
                 memcpy(OUTPUT_BUFFER.ptr(), pixelData, OUTPUT_BUFFER.up_to(frameRes.w * frameRes.h * (frameRes.bpp / 8)));
             }
             else
             {
-                scaler->scale(pixelData, frameRes, outputRes);
+                scaler->scale(pixelData, frameRes, outputRes, OUTPUT_BUFFER.ptr(), TMP_BUFFER.ptr());
+                OUTPUT_BUFFER_FILTER = scaler;
             }
         }
     }
 
+    if (RECORDER_OUTPUT.isEnabled)
+    {
+        scale_for_recorder(pixelData, frameRes);
+    }
+
     if ((LATEST_OUTPUT_SIZE.w != outputRes.w) ||
         (LATEST_OUTPUT_SIZE.h != outputRes.h))
     {
@@ -635,6 +905,31 @@ void ks_set_forced_aspect_enabled(const bool state)
     return;
 }
 
+void ks_set_deferred_scaling_enabled(const bool state)
+{
+    DEFER_SCALING = state;
+
+    INFO(("Scaling of output frames %s deferred to the renderer.", (state? "is" : "is no longer")));
+
+    return;
+}
+
+void ks_set_hardware_scaling_enabled(const bool state)
+{
+    HARDWARE_SCALING = state;
+
+    INFO(("Scaling of output frames %s done by the capture device when possible.", (state? "is" : "is no longer")));
+
+    return;
+}
+
+void ks_set_integer_scaling_enabled(const bool state)
+{
+    INTEGER_SCALING = state;
+
+    return;
+}
+
 void ks_set_output_base_resolution(const resolution_s &r,
                                    const bool originatesFromUser)
 {
@@ -701,6 +996,137 @@ const u8* ks_scaler_output_as_raw_ptr(void)
     return OUTPUT_BUFFER.ptr();
 }
 
+// Converts the given BGRA image, e.g. a copy of the scaler's output, into planar
+// YUV 4:2:0 (I420; BT.601, limited range), which is what most video encoders take
+// as input. The destination must have room for (r.w * r.h * 1.5) bytes, and the
+// image's width and height must be even. Safe to call from threads other than the
+// main one, so that e.g. the recorder can do the conversion off the main thread.
+//
+void ks_convert_bgra_to_yuv420(const u8 *const src, const resolution_s &r, u8 *const dst)
+{
+    k_assert(((r.w % 2 == 0) && (r.h % 2 == 0)), "Expected an even resolution for conversion into YUV 4:2:0.");
+
+    #ifdef USE_OPENCV
+        // OpenCV's conversion is vectorized.
+        const cv::Mat input = cv::Mat(r.h, r.w, CV_8UC4, (u8*)src);
+        cv::Mat output = cv::Mat((r.h + (r.h / 2)), r.w, CV_8UC1, dst);
+
+        cv::cvtColor(input, output, cv::COLOR_BGRA2YUV_I420);
+    #else
+        u8 *const yPlane = dst;
+        u8 *const uPlane = (yPlane + (r.w * r.h));
+        u8 *const vPlane = (uPlane + ((r.w / 2) * (r.h / 2)));
+
+        for (uint y = 0; y < r.h; y++)
+        {
+            for (uint x = 0; x < r.w; x++)
+            {
+                const u8 *const px = &src[(x + y * r.w) * 4];
+
+                yPlane[x + y * r.w] = u8(((66 * px[2] + 129 * px[1] + 25 * px[0] + 128) >> 8) + 16);
+            }
+        }
+
+        // Sample the chroma from the average of each 2 x 2 block of pixels.
+        for (uint y = 0; y < r.h; y += 2)
+        {
+            for (uint x = 0; x < r.w; x += 2)
+            {
+                int red = 0, green = 0, blue = 0;
+
+                for (uint i = 0; i < 4; i++)
+                {
+                    const u8 *const px = &src[((x + (i % 2)) + (y + (i / 2)) * r.w) * 4];
+
+                    blue += px[0];
+                    green += px[1];
+                    red += px[2];
+                }
+
+                red /= 4;
+                green /= 4;
+                blue /= 4;
+
+                const uint idx = ((x / 2) + (y / 2) * (r.w / 2));
+                uPlane[idx] = u8(((-38 * red - 74 * green + 112 * blue + 128) >> 8) + 128);
+                vPlane[idx] = u8(((112 * red - 94 * green - 18 * blue + 128) >> 8) + 128);
+            }
+        }
+    #endif
+
+    return;
+}
+
+// Returns the resolution of the image currently in the scaler's output buffer.
+// This will equal ks_output_resolution(), except when scaling is deferred to the
+// renderer, in which case it'll be the frame's native resolution.
+//
+resolution_s ks_scaler_output_resolution(void)
+{
+    return OUTPUT_BUFFER_RES;
+}
+
+// Enables or disables the scaler's output of frames for the recorder. While
+// enabled, each frame is also scaled to the resolution set with
+// ks_set_recorder_output_resolution(), for the recorder to pick up via
+// ks_recorder_output_as_raw_ptr().
+//
+void ks_set_recorder_output_enabled(const bool state)
+{
+    // The recorder's buffers are allocated on first use, so that they don't take
+    // up memory for users that never record.
+    if (state && RECORDER_OUTPUT.outputBuffer.is_null())
+    {
+        RECORDER_OUTPUT.outputBuffer.alloc(MAX_FRAME_SIZE, "Scaler recorder output buffer");
+        RECORDER_OUTPUT.scratchBuffer.alloc(MAX_FRAME_SIZE, "Scaler recorder scratch buffer");
+    }
+
+    RECORDER_OUTPUT.isEnabled = state;
+    RECORDER_OUTPUT.output = nullptr;
+
+    return;
+}
+
+void ks_set_recorder_output_resolution(const resolution_s &r)
+{
+    k_assert(((r.w <= MAX_OUTPUT_WIDTH) && (r.h <= MAX_OUTPUT_HEIGHT)),
+             "The recorder's output resolution is out of bounds.");
+
+    RECORDER_OUTPUT.resolution = {r.w, r.h, OUTPUT_BIT_DEPTH};
+
+    return;
+}
+
+// Sets the filter with which frames are scaled for the recorder. An empty name
+// has the recorder's frames scaled with the display's up/downscaling filters.
+//
+void ks_set_recorder_scaling_filter(const std::string &name)
+{
+    RECORDER_OUTPUT.filter = (name.empty()? nullptr : ks_scaler_for_name_string(name));
+
+    return;
+}
+
+const std::string& ks_recorder_scaling_filter_name(void)
+{
+    static const std::string sameAsDisplay = "";
+
+    return (RECORDER_OUTPUT.filter? RECORDER_OUTPUT.filter->name : sameAsDisplay);
+}
+
+// Returns the recorder's version of the most recent frame; or null if there's
+// no such frame. The pointer stays valid until the scaler's next frame.
+//
+const u8* ks_recorder_output_as_raw_ptr(void)
+{
+    return RECORDER_OUTPUT.output;
+}
+
+resolution_s ks_recorder_output_resolution(void)
+{
+    return RECORDER_OUTPUT.outputRes;
+}
+
 // Returns a list of GUI-displayable names of the scaling filters that're
 // available.
 //
@@ -11,8 +11,9 @@
 
 struct captured_frame_s;
 
-// The parameters accepted by scaling functions.
-#define SCALER_FUNC_PARAMS u8 *const pixelData, const resolution_s &sourceRes, const resolution_s &targetRes
+// The parameters accepted by scaling functions. The scaled image is written into
+// outputBuffer; scratchBuffer is for any intermediate work, and must be as large.
+#define SCALER_FUNC_PARAMS u8 *const pixelData, const resolution_s &sourceRes, const resolution_s &targetRes, u8 *const outputBuffer, u8 *const scratchBuffer
 
 // IDs for the different up/downscaling filters the scaler can use.
 enum scaling_filter_id_e
@@ -45,6 +46,12 @@ resolution_s ks_output_resolution(void);
 
 bool ks_is_forced_aspect_enabled(void);
 
+bool ks_is_deferred_scaling_enabled(void);
+
+bool ks_is_hardware_scaling_enabled(void);
+
+bool ks_is_integer_scaling_enabled(void);
+
 uint ks_max_output_bit_depth(void);
 
 void ks_initialize_scaler(void);
@@ -67,6 +74,14 @@ void ks_set_output_resolution_override_enabled(const bool state);
 
 void ks_set_forced_aspect_enabled(const bool state);
 
+void ks_set_deferred_scaling_enabled(const bool state);
+
+void ks_set_hardware_scaling_enabled(const bool state);
+
+void ks_set_integer_scaling_enabled(const bool state);
+
+resolution_s ks_padded_output_resolution(const resolution_s &sourceRes, const resolution_s &targetRes);
+
 void ks_indicate_no_signal(void);
 
 void ks_indicate_invalid_signal(void);
@@ -75,6 +90,8 @@ void ks_clear_scaler_output_buffer(void);
 
 const u8* ks_scaler_output_as_raw_ptr(void);
 
+void ks_convert_bgra_to_yuv420(const u8 *const src, const resolution_s &r, u8 *const dst);
+
 const std::string &ks_upscaling_filter_name(void);
 
 const std::string& ks_downscaling_filter_name(void);
@@ -93,4 +110,16 @@ const scaling_filter_s* ks_scaler_for_name_string(const std::string &name);
 
 resolution_s ks_scaler_output_resolution(void);
 
+void ks_set_recorder_output_enabled(const bool state);
+
+void ks_set_recorder_output_resolution(const resolution_s &r);
+
+void ks_set_recorder_scaling_filter(const std::string &name);
+
+const std::string& ks_recorder_scaling_filter_name(void);
+
+const u8* ks_recorder_output_as_raw_ptr(void);
+
+resolution_s ks_recorder_output_resolution(void);
+
 #endif
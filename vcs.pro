@@ -1,9 +1,22 @@
 # Comment out to disable OpenCV. You'll have no filtering or scaler, but you also don't need to provide the dependencies.
 DEFINES += USE_OPENCV
 
+# Uncomment to record video via FFmpeg's libraries rather than via OpenCV. Gives you a choice
+# of codecs (incl. lossless ones) and control over their settings, but you'll need libavcodec,
+# libavformat and libavutil.
+#DEFINES += USE_LIBAV
+
+# Uncomment to be able to record audio (Linux only) via ALSA alongside video. Needs USE_LIBAV
+# for muxing the audio into the video, and libasound.
+#DEFINES += USE_ALSA
+
 # Enable non-critical asserts. May perform slower, but will e.g. look to guard against buffer overflow in memory access.
 #DEFINES += ENFORCE_OPTIONAL_ASSERTS
 
+# Uncomment to have the filters' SIMD paths use AVX2 rather than SSE2. The resulting build
+# will only run on CPUs that support AVX2.
+#QMAKE_CXXFLAGS += -mavx2
+
 linux {
     DEFINES += CAPTURE_API_VIDEO4LINUX
 
@@ -16,6 +29,13 @@ linux {
     contains(DEFINES, USE_OPENCV) {
         LIBS += -lopencv_imgproc -lopencv_videoio -lopencv_highgui -lopencv_core -lopencv_photo
     }
+
+    contains(DEFINES, USE_ALSA) {
+        LIBS += -lasound
+    }
+
+    # For shm_open() in the shared-memory frame output.
+    LIBS += -lrt
 }
 
 win32 {
@@ -33,6 +53,12 @@ win32 {
     RC_ICONS = "src/display/qt/images/icons/appicon.ico"
 }
 
+# FFmpeg's libraries are needed on any platform when recording via them. On
+# Windows, you may need to add their location to the library path (LIBS += -L...).
+contains(DEFINES, USE_LIBAV) {
+    LIBS += -lavformat -lavcodec -lavutil
+}
+
 QT += core gui network
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -55,6 +81,7 @@ SOURCES += \
     src/display/qt/windows/output_window.cpp \
     src/display/qt/dialogs/resolution_dialog.cpp \
     src/display/qt/d_main.cpp \
+    src/display/qt/present_scheduler.cpp \
     src/display/qt/dialogs/overlay_dialog.cpp \
     src/display/qt/dialogs/alias_dialog.cpp \
     src/display/qt/dialogs/anti_tear_dialog.cpp \
@@ -68,6 +95,10 @@ SOURCES += \
     src/display/qt/persistent_settings.cpp \
     src/common/memory/memory.cpp \
     src/record/record.cpp \
+    src/record/libav_encoder.cpp \
+    src/record/frame_export.cpp \
+    src/record/shared_output.cpp \
+    src/record/loopback_output.cpp \
     src/common/disk/disk.cpp \
     src/capture/alias.cpp \
     src/display/qt/subclasses/QOpenGLWidget_opengl_renderer.cpp \
@@ -86,6 +117,7 @@ SOURCES += \
     src/display/qt/subclasses/QTableWidget_property_table.cpp \
     src/display/qt/dialogs/signal_dialog.cpp \
     src/capture/capture_api_video4linux.cpp \
+    src/capture/audio_capture.cpp \
     src/filter/filter_funcs.cpp \
     src/common/disk/file_writers/file_writer_filter_graph_version_b.cpp \
     src/common/disk/file_reader.cpp \
@@ -114,6 +146,7 @@ HEADERS += \
     src/capture/null_rgbeasy.h \
     src/common/types.h \
     src/display/qt/windows/output_window.h \
+    src/display/qt/present_scheduler.h \
     src/display/qt/dialogs/resolution_dialog.h \
     src/scaler/scaler.h \
     src/capture/capture.h \
@@ -131,6 +164,11 @@ HEADERS += \
     src/common/memory/memory.h \
     src/common/memory/memory_interface.h \
     src/record/record.h \
+    src/record/libav_encoder.h \
+    src/record/frame_export.h \
+    src/record/shared_output.h \
+    src/record/loopback_output.h \
+    src/record/shared_frame_ring.h \
     src/common/disk/disk.h \
     src/capture/alias.h \
     src/display/qt/subclasses/QOpenGLWidget_opengl_renderer.h \
@@ -150,6 +188,7 @@ HEADERS += \
     src/display/qt/subclasses/QTableWidget_property_table.h \
     src/display/qt/dialogs/signal_dialog.h \
     src/capture/capture_api_video4linux.h \
+    src/capture/audio_capture.h \
     src/filter/filter_funcs.h \
     src/common/disk/file_writers/file_writer_filter_graph.h \
     src/common/disk/file_readers/file_reader_filter_graph.h \